@@ -0,0 +1,638 @@
+/*
+ * overhead_bench.c
+ *
+ * narwhalyzer_bench: cost of one section enter/exit pair in the runtime's
+ * own hot path, written as JSON so it can be tracked across releases.
+ *
+ * An operation opens `depth` nested sections and closes them again; the
+ * sections cycle through a pool of `sections` so that larger pools touch
+ * more statistics cache lines. Every thread first runs the same loop
+ * without instrumentation, and the cost per pair is
+ *
+ *   (instrumented time - baseline time) / (operations * depth)
+ *
+ * averaged over the threads, with the median, min and max over repetitions.
+ *
+ * The clock and the recording mode are read by the runtime once at startup,
+ * so the driver runs one child process per (clock, mode) combination and
+ * collects the results of each child through a pipe. Reports, traces and
+ * profiles of the children go to /dev/null.
+ *
+ * Usage:
+ *   narwhalyzer_bench [--threads N] [--depth LIST] [--sections LIST]
+ *                     [--clocks LIST] [--modes LIST] [--instrumentation LIST]
+ *                     [--pairs N] [--repeat N] [--output FILE]
+ *
+ * Copyright (c) 2026
+ * Licensed under GPL-3.0 License
+ */
+
+#define _GNU_SOURCE
+#include "narwhalyzer.h"
+#include "overhead_bench.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/wait.h>
+
+#ifndef NARWHALYZER_VERSION_STRING
+#define NARWHALYZER_VERSION_STRING "unknown"
+#endif
+
+#define BENCH_MAX_LIST       16
+#define BENCH_MAX_DEPTH      64
+#define BENCH_MAX_THREADS    256
+
+/* Macro and dynamic pools share the registry with the plugin sections */
+#define BENCH_MAX_SECTIONS   480
+
+typedef struct bench_list {
+    int count;
+    const char *names[BENCH_MAX_LIST];
+    long values[BENCH_MAX_LIST];
+} bench_list_t;
+
+typedef struct bench_options {
+    long max_threads;
+    long pairs;                         /* Enter/exit pairs per thread and repetition */
+    long repeat;
+    bench_list_t depths;
+    bench_list_t sections;
+    bench_list_t clocks;
+    bench_list_t modes;
+    bench_list_t instrumentation;
+    const char *output;
+    int child_fd;                       /* Result pipe in a child, -1 in the driver */
+    const char *clock;                  /* Of this child */
+    const char *mode;
+} bench_options_t;
+
+/* ============================================================================
+ * Option Parsing
+ * ============================================================================ */
+
+static void usage(FILE *out)
+{
+    fprintf(out,
+        "Usage: narwhalyzer_bench [options]\n"
+        "\n"
+        "Measure the cost of one section enter/exit pair and write JSON results.\n"
+        "\n"
+        "Options:\n"
+        "  --threads N              Largest thread count; runs 1, 2, 4, ... N (default: CPUs, max 8)\n"
+        "  --depth LIST             Nesting depths (default: 1,4,16)\n"
+        "  --sections LIST          Section pool sizes (default: 1,16,256)\n"
+        "  --clocks LIST            NARWHALYZER_CLOCK values (default: monotonic_raw,monotonic,monotonic_coarse)\n"
+        "  --modes LIST             stats, trace, profile (default: all)\n"
+        "  --instrumentation LIST   macro, dynamic, plugin (default: all)\n"
+        "  --pairs N                Pairs per thread and repetition (default: 200000)\n"
+        "  --repeat N               Repetitions, median reported (default: 5)\n"
+        "  --output FILE            Write JSON to FILE instead of stdout\n"
+        "  -h, --help               Show this help\n");
+}
+
+/* Split a comma-separated list; numeric lists also fill values[] */
+static int parse_list(char *arg, bench_list_t *list, int numeric)
+{
+    list->count = 0;
+    for (char *tok = strtok(arg, ","); tok; tok = strtok(NULL, ",")) {
+        if (list->count == BENCH_MAX_LIST) {
+            return -1;
+        }
+        if (numeric) {
+            char *end;
+            long value = strtol(tok, &end, 10);
+            if (*end != '\0' || value <= 0) {
+                return -1;
+            }
+            list->values[list->count] = value;
+        }
+        list->names[list->count++] = tok;
+    }
+    return list->count > 0 ? 0 : -1;
+}
+
+static int parse_count(const char *arg, long *value)
+{
+    char *end;
+    *value = strtol(arg, &end, 10);
+    return *end == '\0' && *value > 0 ? 0 : -1;
+}
+
+static int check_names(const bench_list_t *list, const char *const *valid, int valid_count,
+                       const char *option)
+{
+    for (int i = 0; i < list->count; i++) {
+        int found = 0;
+        for (int j = 0; j < valid_count; j++) {
+            if (strcmp(list->names[i], valid[j]) == 0) found = 1;
+        }
+        if (!found) {
+            fprintf(stderr, "narwhalyzer_bench: unknown %s '%s'\n", option, list->names[i]);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static int parse_options(int argc, char **argv, bench_options_t *opt)
+{
+    static const char *const clocks[] = { "monotonic_raw", "monotonic", "monotonic_coarse" };
+    static const char *const modes[] = { "stats", "trace", "profile" };
+    static const char *const instrumentation[] = { "macro", "dynamic", "plugin" };
+    static char default_depths[] = "1,4,16";
+    static char default_sections[] = "1,16,256";
+    static char default_clocks[] = "monotonic_raw,monotonic,monotonic_coarse";
+    static char default_modes[] = "stats,trace,profile";
+    static char default_instrumentation[] = "macro,dynamic,plugin";
+
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    opt->max_threads = cpus > 8 ? 8 : (cpus > 0 ? cpus : 1);
+    opt->pairs = 200000;
+    opt->repeat = 5;
+    opt->output = NULL;
+    opt->child_fd = -1;
+    parse_list(default_depths, &opt->depths, 1);
+    parse_list(default_sections, &opt->sections, 1);
+    parse_list(default_clocks, &opt->clocks, 0);
+    parse_list(default_modes, &opt->modes, 0);
+    parse_list(default_instrumentation, &opt->instrumentation, 0);
+
+    for (int i = 1; i < argc; i++) {
+        const char *arg = argv[i];
+        char *value = i + 1 < argc ? argv[i + 1] : NULL;
+        int status = 0;
+
+        if (strcmp(arg, "-h") == 0 || strcmp(arg, "--help") == 0) {
+            usage(stdout);
+            exit(0);
+        }
+        if (!value) {
+            fprintf(stderr, "narwhalyzer_bench: %s needs a value\n", arg);
+            return -1;
+        }
+        i++;
+        if (strcmp(arg, "--threads") == 0) {
+            status = parse_count(value, &opt->max_threads);
+        } else if (strcmp(arg, "--depth") == 0) {
+            status = parse_list(value, &opt->depths, 1);
+        } else if (strcmp(arg, "--sections") == 0) {
+            status = parse_list(value, &opt->sections, 1);
+        } else if (strcmp(arg, "--clocks") == 0) {
+            status = parse_list(value, &opt->clocks, 0);
+        } else if (strcmp(arg, "--modes") == 0) {
+            status = parse_list(value, &opt->modes, 0);
+        } else if (strcmp(arg, "--instrumentation") == 0) {
+            status = parse_list(value, &opt->instrumentation, 0);
+        } else if (strcmp(arg, "--pairs") == 0) {
+            status = parse_count(value, &opt->pairs);
+        } else if (strcmp(arg, "--repeat") == 0) {
+            status = parse_count(value, &opt->repeat);
+        } else if (strcmp(arg, "--output") == 0) {
+            opt->output = value;
+        } else if (strcmp(arg, "--child") == 0) {
+            /* Internal: --child FD,CLOCK,MODE */
+            char *fd = strtok(value, ",");
+            opt->clock = strtok(NULL, ",");
+            opt->mode = strtok(NULL, ",");
+            status = fd && opt->clock && opt->mode ? 0 : -1;
+            if (status == 0) opt->child_fd = atoi(fd);
+        } else {
+            fprintf(stderr, "narwhalyzer_bench: unknown option '%s'\n", arg);
+            usage(stderr);
+            return -1;
+        }
+        if (status != 0) {
+            fprintf(stderr, "narwhalyzer_bench: invalid value for %s: '%s'\n", arg, value);
+            return -1;
+        }
+    }
+
+    if (check_names(&opt->clocks, clocks, 3, "clock") != 0 ||
+        check_names(&opt->modes, modes, 3, "mode") != 0 ||
+        check_names(&opt->instrumentation, instrumentation, 3, "instrumentation") != 0) {
+        return -1;
+    }
+    for (int i = 0; i < opt->depths.count; i++) {
+        if (opt->depths.values[i] > BENCH_MAX_DEPTH) {
+            fprintf(stderr, "narwhalyzer_bench: depth is limited to %d\n", BENCH_MAX_DEPTH);
+            return -1;
+        }
+    }
+    for (int i = 0; i < opt->sections.count; i++) {
+        if (opt->sections.values[i] > BENCH_MAX_SECTIONS) {
+            fprintf(stderr, "narwhalyzer_bench: section pools are limited to %d\n",
+                    BENCH_MAX_SECTIONS);
+            return -1;
+        }
+    }
+    if (opt->max_threads > BENCH_MAX_THREADS) {
+        opt->max_threads = BENCH_MAX_THREADS;
+    }
+    return 0;
+}
+
+/* ============================================================================
+ * Workloads
+ * ============================================================================ */
+
+typedef enum {
+    BENCH_MACRO,                        /* Cached section index, as the macros expand to */
+    BENCH_DYNAMIC,                      /* narwhalyzer_enter_name() */
+    BENCH_PLUGIN                        /* Functions instrumented by the plugin */
+} bench_kind_t;
+
+typedef struct bench_case {
+    bench_kind_t kind;
+    int threads;
+    int depth;
+    int sections;
+    long ops;                           /* Operations per thread and repetition */
+    long repeat;
+    pthread_barrier_t barrier;
+    double *baseline_ns;                /* [repeat][threads] */
+    double *instrumented_ns;
+} bench_case_t;
+
+typedef struct bench_worker {
+    bench_case_t *bench;
+    int thread;
+} bench_worker_t;
+
+static int g_index[BENCH_MAX_SECTIONS];
+static char g_names[BENCH_MAX_SECTIONS][32];
+
+/* Sink keeping the baseline loop from being optimized away */
+static volatile int g_baseline_sink;
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static void register_pool(int sections)
+{
+    for (int s = 0; s < sections; s++) {
+        snprintf(g_names[s], sizeof(g_names[s]), "bench:%d", s);
+        g_index[s] = __narwhalyzer_register_section(g_names[s], __FILE__, s);
+    }
+}
+
+/* Same loop and section choice as run_ops(), without instrumentation */
+static void run_baseline(const bench_case_t *c, long ops)
+{
+    int ctx[BENCH_MAX_DEPTH];
+#ifdef NARWHALYZER_BENCH_PLUGIN
+    if (c->kind == BENCH_PLUGIN) {
+        for (long i = 0; i < ops; i++) {
+            bench_plugin_baseline_op(c->depth);
+        }
+        return;
+    }
+#endif
+    for (long i = 0; i < ops; i++) {
+        int base = (int)((i * c->depth) % c->sections);
+        for (int k = 0; k < c->depth; k++) {
+            ctx[k] = g_index[(base + k) % c->sections];
+            __asm__ volatile("" : : "r"(ctx[k]) : "memory");
+        }
+        for (int k = c->depth - 1; k >= 0; k--) {
+            g_baseline_sink = ctx[k];
+        }
+    }
+}
+
+static void run_ops(const bench_case_t *c, long ops)
+{
+    int ctx[BENCH_MAX_DEPTH];
+    switch (c->kind) {
+    case BENCH_MACRO:
+        for (long i = 0; i < ops; i++) {
+            int base = (int)((i * c->depth) % c->sections);
+            for (int k = 0; k < c->depth; k++) {
+                ctx[k] = __narwhalyzer_section_enter(g_index[(base + k) % c->sections]);
+            }
+            for (int k = c->depth - 1; k >= 0; k--) {
+                __narwhalyzer_section_exit(ctx[k]);
+            }
+        }
+        break;
+    case BENCH_DYNAMIC:
+        for (long i = 0; i < ops; i++) {
+            int base = (int)((i * c->depth) % c->sections);
+            for (int k = 0; k < c->depth; k++) {
+                ctx[k] = narwhalyzer_enter_name(g_names[(base + k) % c->sections]);
+            }
+            for (int k = c->depth - 1; k >= 0; k--) {
+                __narwhalyzer_section_exit(ctx[k]);
+            }
+        }
+        break;
+    case BENCH_PLUGIN:
+#ifdef NARWHALYZER_BENCH_PLUGIN
+        for (long i = 0; i < ops; i++) {
+            bench_plugin_op(c->depth);
+        }
+#endif
+        break;
+    }
+}
+
+static void *worker_main(void *arg)
+{
+    bench_worker_t *w = arg;
+    bench_case_t *c = w->bench;
+
+    /* Unmeasured round: thread state, name cache and profile tree */
+    run_baseline(c, c->ops / 10 + 1);
+    run_ops(c, c->ops / 10 + 1);
+
+    for (long r = 0; r < c->repeat; r++) {
+        size_t slot = (size_t)r * (size_t)c->threads + (size_t)w->thread;
+
+        pthread_barrier_wait(&c->barrier);
+        uint64_t start = now_ns();
+        run_baseline(c, c->ops);
+        c->baseline_ns[slot] = (double)(now_ns() - start);
+
+        /* All threads run the instrumented loop at the same time */
+        pthread_barrier_wait(&c->barrier);
+        start = now_ns();
+        run_ops(c, c->ops);
+        c->instrumented_ns[slot] = (double)(now_ns() - start);
+    }
+    return NULL;
+}
+
+static int compare_double(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+/*
+ * Run one case and write its JSON object as one line.
+ * Returns 0 on success.
+ */
+static int run_case(bench_case_t *c, const bench_options_t *opt, FILE *out)
+{
+    static const char *const kinds[] = { "macro", "dynamic", "plugin" };
+
+    size_t slots = (size_t)c->repeat * (size_t)c->threads;
+    c->baseline_ns = calloc(slots, sizeof(double));
+    c->instrumented_ns = calloc(slots, sizeof(double));
+    pthread_t threads[BENCH_MAX_THREADS];
+    bench_worker_t workers[BENCH_MAX_THREADS];
+    double per_pair[c->repeat], baseline[c->repeat];
+    int status = -1;
+
+    if (!c->baseline_ns || !c->instrumented_ns ||
+        pthread_barrier_init(&c->barrier, NULL, (unsigned)c->threads) != 0) {
+        goto out;
+    }
+
+    int started = 0;
+    for (; started < c->threads; started++) {
+        workers[started].bench = c;
+        workers[started].thread = started;
+        if (pthread_create(&threads[started], NULL, worker_main, &workers[started]) != 0) {
+            break;
+        }
+    }
+    for (int t = 0; t < started; t++) {
+        pthread_join(threads[t], NULL);
+    }
+    pthread_barrier_destroy(&c->barrier);
+    if (started < c->threads) {
+        /* Threads already started wait at the barrier forever: give up */
+        fprintf(stderr, "narwhalyzer_bench: cannot start %d threads\n", c->threads);
+        exit(2);
+    }
+
+    double pairs = (double)c->ops * (double)c->depth;
+    for (long r = 0; r < c->repeat; r++) {
+        double sum = 0.0, base_sum = 0.0;
+        for (int t = 0; t < c->threads; t++) {
+            size_t slot = (size_t)r * (size_t)c->threads + (size_t)t;
+            sum += (c->instrumented_ns[slot] - c->baseline_ns[slot]) / pairs;
+            base_sum += c->baseline_ns[slot] / (double)c->ops;
+        }
+        per_pair[r] = sum / c->threads;
+        baseline[r] = base_sum / c->threads;
+    }
+    qsort(per_pair, (size_t)c->repeat, sizeof(double), compare_double);
+    qsort(baseline, (size_t)c->repeat, sizeof(double), compare_double);
+
+    fprintf(out, "{\"clock\": \"%s\", \"mode\": \"%s\", \"instrumentation\": \"%s\", "
+                 "\"threads\": %d, \"depth\": %d, \"sections\": %d, "
+                 "\"ns_per_pair\": %.2f, \"ns_per_pair_min\": %.2f, \"ns_per_pair_max\": %.2f, "
+                 "\"baseline_ns_per_op\": %.2f}\n",
+            opt->clock, opt->mode, kinds[c->kind], c->threads, c->depth, c->sections,
+            per_pair[c->repeat / 2], per_pair[0], per_pair[c->repeat - 1],
+            baseline[c->repeat / 2]);
+    fflush(out);
+    status = 0;
+
+out:
+    free(c->baseline_ns);
+    free(c->instrumented_ns);
+    return status;
+}
+
+/*
+ * Child: sweep threads, depths and pools for this process's clock and mode.
+ */
+static int run_child(const bench_options_t *opt)
+{
+    FILE *out = fdopen(opt->child_fd, "w");
+    if (!out) return 2;
+
+    int max_sections = 1;
+    for (int i = 0; i < opt->sections.count; i++) {
+        if (opt->sections.values[i] > max_sections) max_sections = (int)opt->sections.values[i];
+    }
+    register_pool(max_sections);
+
+    for (int k = 0; k < opt->instrumentation.count; k++) {
+        const char *name = opt->instrumentation.names[k];
+        bench_kind_t kind = strcmp(name, "macro") == 0 ? BENCH_MACRO
+                          : strcmp(name, "dynamic") == 0 ? BENCH_DYNAMIC : BENCH_PLUGIN;
+#ifndef NARWHALYZER_BENCH_PLUGIN
+        if (kind == BENCH_PLUGIN) continue;
+#endif
+        for (long threads = 1; threads <= opt->max_threads;
+             threads = threads < opt->max_threads && 2 * threads > opt->max_threads
+                 ? opt->max_threads : 2 * threads) {
+            for (int d = 0; d < opt->depths.count; d++) {
+                int depth = (int)opt->depths.values[d];
+
+                /* The plugin chain has one function, hence one section, per level */
+                if (kind == BENCH_PLUGIN && depth > BENCH_PLUGIN_MAX_DEPTH) continue;
+                int pools = kind == BENCH_PLUGIN ? 1 : opt->sections.count;
+
+                for (int s = 0; s < pools; s++) {
+                    bench_case_t c = {
+                        .kind = kind,
+                        .threads = (int)threads,
+                        .depth = depth,
+                        .sections = kind == BENCH_PLUGIN ? depth : (int)opt->sections.values[s],
+                        .ops = opt->pairs / depth > 0 ? opt->pairs / depth : 1,
+                        .repeat = opt->repeat,
+                    };
+                    if (run_case(&c, opt, out) != 0) {
+                        fclose(out);
+                        return 2;
+                    }
+                }
+            }
+        }
+    }
+    fclose(out);
+    return 0;
+}
+
+/* ============================================================================
+ * Driver
+ * ============================================================================ */
+
+/*
+ * Run one child with the given clock and mode, appending its result lines
+ * to the JSON array. Returns the number of results, -1 on failure.
+ */
+static int run_configuration(char **argv, const char *clock, const char *mode,
+                             FILE *out, int first)
+{
+    int fds[2];
+    if (pipe(fds) != 0) {
+        return -1;
+    }
+
+    pid_t pid = fork();
+    if (pid < 0) {
+        close(fds[0]);
+        close(fds[1]);
+        return -1;
+    }
+    if (pid == 0) {
+        close(fds[0]);
+
+        /* The child's report is not part of the results */
+        int null = open("/dev/null", O_WRONLY);
+        if (null >= 0) {
+            dup2(null, STDOUT_FILENO);
+            close(null);
+        }
+
+        unsetenv("NARWHALYZER_TRACE");
+        unsetenv("NARWHALYZER_PROFILE");
+        unsetenv("NARWHALYZER_METRICS");
+        setenv("NARWHALYZER_CLOCK", clock, 1);
+        if (strcmp(mode, "trace") == 0) {
+            setenv("NARWHALYZER_TRACE", "/dev/null", 1);
+        } else if (strcmp(mode, "profile") == 0) {
+            setenv("NARWHALYZER_PROFILE", "/dev/null", 1);
+        }
+
+        /* Re-run ourselves with the same options, plus --child */
+        int argc = 0;
+        while (argv[argc]) argc++;
+        char **child_argv = calloc((size_t)argc + 3, sizeof(char *));
+        char child_arg[64];
+        snprintf(child_arg, sizeof(child_arg), "%d,%s,%s", fds[1], clock, mode);
+        if (child_argv) {
+            memcpy(child_argv, argv, (size_t)argc * sizeof(char *));
+            child_argv[argc] = "--child";
+            child_argv[argc + 1] = child_arg;
+            execv("/proc/self/exe", child_argv);
+        }
+        _exit(127);
+    }
+
+    close(fds[1]);
+    FILE *in = fdopen(fds[0], "r");
+    if (!in) {
+        close(fds[0]);
+        waitpid(pid, NULL, 0);
+        return -1;
+    }
+
+    int results = 0;
+    char line[1024];
+    while (fgets(line, sizeof(line), in)) {
+        line[strcspn(line, "\n")] = '\0';
+        fprintf(out, "%s\n    %s", first && results == 0 ? "" : ",", line);
+        results++;
+    }
+    fclose(in);
+
+    int status;
+    if (waitpid(pid, &status, 0) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        fprintf(stderr, "narwhalyzer_bench: run with clock %s, mode %s failed\n", clock, mode);
+        return -1;
+    }
+    fprintf(stderr, "narwhalyzer_bench: clock %s, mode %s: %d results\n", clock, mode, results);
+    return results;
+}
+
+int main(int argc, char **argv)
+{
+    /* Options are parsed from a copy: strtok() modifies its input */
+    char **args = calloc((size_t)argc + 1, sizeof(char *));
+    if (!args) return 2;
+    for (int i = 0; i < argc; i++) {
+        args[i] = strdup(argv[i]);
+    }
+
+    bench_options_t opt;
+    if (parse_options(argc, args, &opt) != 0) {
+        return 2;
+    }
+    if (opt.child_fd >= 0) {
+        return run_child(&opt);
+    }
+
+    FILE *out = stdout;
+    if (opt.output) {
+        out = fopen(opt.output, "w");
+        if (!out) {
+            fprintf(stderr, "narwhalyzer_bench: cannot open '%s': %s\n",
+                    opt.output, strerror(errno));
+            return 2;
+        }
+    }
+
+    fprintf(out, "{\n");
+    fprintf(out, "  \"benchmark\": \"narwhalyzer_bench\",\n");
+    fprintf(out, "  \"version\": \"%s\",\n", NARWHALYZER_VERSION_STRING);
+    fprintf(out, "  \"cpus\": %ld,\n", sysconf(_SC_NPROCESSORS_ONLN));
+    fprintf(out, "  \"pairs_per_thread\": %ld,\n", opt.pairs);
+    fprintf(out, "  \"repeat\": %ld,\n", opt.repeat);
+    fprintf(out, "  \"results\": [");
+
+    int status = 0, total = 0;
+    for (int c = 0; c < opt.clocks.count; c++) {
+        for (int m = 0; m < opt.modes.count; m++) {
+            int results = run_configuration(argv, opt.clocks.names[c], opt.modes.names[m],
+                                            out, total == 0);
+            if (results < 0) {
+                status = 1;
+            } else {
+                total += results;
+            }
+        }
+    }
+
+    fprintf(out, "\n  ]\n}\n");
+    if (out != stdout) {
+        fclose(out);
+    }
+    return status;
+}
@@ -0,0 +1,23 @@
+/*
+ * overhead_bench.h
+ *
+ * Interface between the narwhalyzer_bench driver and its plugin-instrumented
+ * kernels (overhead_plugin.c).
+ *
+ * Copyright (c) 2026
+ * Licensed under GPL-3.0 License
+ */
+
+#ifndef NARWHALYZER_OVERHEAD_BENCH_H
+#define NARWHALYZER_OVERHEAD_BENCH_H
+
+/* Deepest chain of annotated functions in overhead_plugin.c */
+#define BENCH_PLUGIN_MAX_DEPTH 8
+
+/* One operation: depth nested plugin sections, 1 <= depth <= 8 */
+void bench_plugin_op(int depth);
+
+/* The same call chain built without the plugin */
+void bench_plugin_baseline_op(int depth);
+
+#endif /* NARWHALYZER_OVERHEAD_BENCH_H */
@@ -0,0 +1,75 @@
+/*
+ * overhead_plugin.c
+ *
+ * Kernels instrumented by the GCC plugin for narwhalyzer_bench. Each level
+ * is its own annotated function, so an operation of depth d opens d nested
+ * sections exactly as plugin-instrumented code does.
+ *
+ * Compiled with -fplugin=narwhalyzer.so -include narwhalyzer.h, and a
+ * second time without the plugin as the uninstrumented baseline.
+ *
+ * Copyright (c) 2026
+ * Licensed under GPL-3.0 License
+ */
+
+#include "overhead_bench.h"
+
+#ifdef NARWHALYZER_BENCH_BASELINE
+#define bench_plugin_op bench_plugin_baseline_op
+#endif
+
+static volatile int bench_plugin_sink;
+
+#pragma narwhalyzer plugin_level_7
+__attribute__((noinline)) static void plugin_level_7(int depth)
+{
+    (void)depth;
+    bench_plugin_sink++;
+}
+
+#pragma narwhalyzer plugin_level_6
+__attribute__((noinline)) static void plugin_level_6(int depth)
+{
+    if (depth > 7) plugin_level_7(depth);
+}
+
+#pragma narwhalyzer plugin_level_5
+__attribute__((noinline)) static void plugin_level_5(int depth)
+{
+    if (depth > 6) plugin_level_6(depth);
+}
+
+#pragma narwhalyzer plugin_level_4
+__attribute__((noinline)) static void plugin_level_4(int depth)
+{
+    if (depth > 5) plugin_level_5(depth);
+}
+
+#pragma narwhalyzer plugin_level_3
+__attribute__((noinline)) static void plugin_level_3(int depth)
+{
+    if (depth > 4) plugin_level_4(depth);
+}
+
+#pragma narwhalyzer plugin_level_2
+__attribute__((noinline)) static void plugin_level_2(int depth)
+{
+    if (depth > 3) plugin_level_3(depth);
+}
+
+#pragma narwhalyzer plugin_level_1
+__attribute__((noinline)) static void plugin_level_1(int depth)
+{
+    if (depth > 2) plugin_level_2(depth);
+}
+
+#pragma narwhalyzer plugin_level_0
+__attribute__((noinline)) static void plugin_level_0(int depth)
+{
+    if (depth > 1) plugin_level_1(depth);
+}
+
+void bench_plugin_op(int depth)
+{
+    plugin_level_0(depth);
+}
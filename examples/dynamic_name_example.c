@@ -0,0 +1,111 @@
+/*
+ * dynamic_name_example.c
+ *
+ * Demonstrates sections whose names are only known at runtime.
+ * A small operator registry dispatches user-defined operators by name,
+ * and each operator invocation is profiled under its own section.
+ *
+ * Build with:
+ *   gcc -I<include_path> dynamic_name_example.c -L<lib_path> -lnarwhalyzer \
+ *       -lpthread -lm -o dynamic_name_example
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
+
+#include "narwhalyzer.h"
+
+/* ============================================================================
+ * A minimal operator registry
+ * ============================================================================ */
+
+typedef double (*operator_fn)(double);
+
+typedef struct user_operator {
+    char name[32];
+    operator_fn fn;
+} user_operator_t;
+
+static double op_square(double x) { return x * x; }
+static double op_sqrt(double x)   { return sqrt(fabs(x)); }
+static double op_sin(double x)    { return sin(x); }
+
+static user_operator_t g_operators[] = {
+    { "op:square", op_square },
+    { "op:sqrt",   op_sqrt },
+    { "op:sin",    op_sin },
+};
+
+#define OPERATOR_COUNT (sizeof(g_operators) / sizeof(g_operators[0]))
+
+/*
+ * Apply an operator to a vector.
+ * The section name comes from the operator, not from the call site.
+ */
+static double apply_operator(const user_operator_t *op, int n)
+{
+    double acc = 0.0;
+
+    int ctx = narwhalyzer_enter_name(op->name);
+
+    for (int i = 0; i < n; i++) {
+        acc += op->fn((double)i * 0.001);
+    }
+
+    __narwhalyzer_section_exit(ctx);
+
+    return acc;
+}
+
+/* ============================================================================
+ * Worker threads run a pipeline of operators
+ * ============================================================================ */
+
+static void *pipeline_worker(void *arg)
+{
+    int id = *(int *)arg;
+    double total = 0.0;
+
+    for (int round = 0; round < 50; round++) {
+        const user_operator_t *op = &g_operators[(round + id) % OPERATOR_COUNT];
+        total += apply_operator(op, 20000);
+    }
+
+    /* Names may also be built on the fly */
+    char name[64];
+    snprintf(name, sizeof(name), "worker_%d_summary", id);
+    int ctx = narwhalyzer_enter_name(name);
+    printf("  Worker %d total: %f\n", id, total);
+    __narwhalyzer_section_exit(ctx);
+
+    return NULL;
+}
+
+/* ============================================================================
+ * Main Program
+ * ============================================================================ */
+
+int main(void)
+{
+    printf("=== Narwhalyzer Dynamic Name Example ===\n\n");
+
+    pthread_t threads[4];
+    int ids[4];
+
+    for (int i = 0; i < 4; i++) {
+        ids[i] = i;
+        pthread_create(&threads[i], NULL, pipeline_worker, &ids[i]);
+    }
+
+    for (int i = 0; i < 4; i++) {
+        pthread_join(threads[i], NULL);
+    }
+
+    printf("\n=== Example Complete ===\n");
+    printf("\nProfiling report follows:\n\n");
+
+    return 0;
+}
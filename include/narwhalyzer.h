@@ -19,8 +19,20 @@
 extern "C" {
 #endif
 
-/* Maximum nesting depth for sections */
-#define NARWHALYZER_MAX_NESTING_DEPTH 64
+/*
+ * Maximum nesting depth for sections.
+ * Context stacks start small and grow on demand up to this limit,
+ * which only guards against runaway recursion.
+ */
+#ifndef NARWHALYZER_MAX_NESTING_DEPTH
+#define NARWHALYZER_MAX_NESTING_DEPTH 65536
+#endif
+
+/* Context frames stored inline in each thread's state */
+#define NARWHALYZER_INLINE_NESTING_DEPTH 16
+
+/* Context frames added each time a thread's stack grows */
+#define NARWHALYZER_CONTEXT_CHUNK_DEPTH 256
 
 /* Maximum number of distinct sections */
 #define NARWHALYZER_MAX_SECTIONS 1024
@@ -28,6 +40,47 @@ extern "C" {
 /* Maximum length of section name */
 #define NARWHALYZER_MAX_NAME_LEN 256
 
+/*
+ * Log-linear histogram.
+ * Values below 4 get their own bucket; above that, each power of two is
+ * split into 4 sub-buckets (about 19% relative width). The last bucket
+ * also collects every larger value.
+ */
+#define NARWHALYZER_HIST_SUB_BITS 2
+#define NARWHALYZER_HIST_BUCKETS 160
+
+typedef struct narwhalyzer_histogram {
+    uint64_t buckets[NARWHALYZER_HIST_BUCKETS];
+} narwhalyzer_histogram_t;
+
+/*
+ * Map a value to its histogram bucket.
+ */
+static inline int narwhalyzer_histogram_bucket(uint64_t value)
+{
+    if (value < (1u << NARWHALYZER_HIST_SUB_BITS)) {
+        return (int)value;
+    }
+    int exp = 63 - __builtin_clzll(value);
+    int sub = (int)(value >> (exp - NARWHALYZER_HIST_SUB_BITS)) & 
+              ((1 << NARWHALYZER_HIST_SUB_BITS) - 1);
+    int bucket = ((exp - NARWHALYZER_HIST_SUB_BITS + 1) << NARWHALYZER_HIST_SUB_BITS) + sub;
+    return bucket < NARWHALYZER_HIST_BUCKETS ? bucket : NARWHALYZER_HIST_BUCKETS - 1;
+}
+
+/*
+ * Smallest value that maps to a histogram bucket.
+ */
+static inline uint64_t narwhalyzer_histogram_bucket_lower(int bucket)
+{
+    if (bucket < (1 << NARWHALYZER_HIST_SUB_BITS)) {
+        return (uint64_t)bucket;
+    }
+    int exp = (bucket >> NARWHALYZER_HIST_SUB_BITS) + NARWHALYZER_HIST_SUB_BITS - 1;
+    uint64_t sub = (uint64_t)(bucket & ((1 << NARWHALYZER_HIST_SUB_BITS) - 1));
+    return ((1ULL << NARWHALYZER_HIST_SUB_BITS) + sub) << (exp - NARWHALYZER_HIST_SUB_BITS);
+}
+
 /*
  * Section statistics structure.
  * Holds all profiling data for a single instrumented section.
@@ -40,8 +93,48 @@ typedef struct narwhalyzer_section_stats {
     uint64_t cumulative_time_ns;        /* Total time spent in section (nanoseconds) */
     uint64_t min_time_ns;               /* Minimum single execution time */
     uint64_t max_time_ns;               /* Maximum single execution time */
+    narwhalyzer_histogram_t duration_hist; /* Nanoseconds per outermost activation */
     int parent_index;                   /* Index of parent section (-1 if root) */
     int depth;                          /* Nesting depth when this section runs */
+    
+    /*
+     * Recursion tracking. Only the outermost activation of a section on a
+     * thread contributes to cumulative/min/max time; nested activations of
+     * the same section are counted here instead.
+     */
+    uint64_t recursive_entry_count;     /* Entries while already active on the thread */
+    uint64_t max_recursion_depth;       /* Deepest activation seen (0 if never recursed) */
+    narwhalyzer_histogram_t recursion_depth_hist; /* Depth of each recursive entry (>= 2) */
+    
+    /*
+     * Concurrency occupancy: how many threads are inside the section at once.
+     * occupancy_state packs the time of the last change (upper 48 bits,
+     * nanoseconds since program start) with the current thread count
+     * (lower 16 bits), so both are updated with a single compare-and-swap.
+     */
+    uint64_t occupancy_state;
+    uint64_t max_concurrency;           /* Most threads inside at once */
+    narwhalyzer_histogram_t concurrency_time_hist; /* Nanoseconds spent at each thread count */
+    
+    /*
+     * Arrival pattern of outermost entries. Inter-arrival times are measured
+     * between successive entries on the same thread.
+     */
+    uint64_t first_entry_ns;            /* Timestamp of the first entry */
+    uint64_t last_entry_ns;             /* Timestamp of the latest entry */
+    narwhalyzer_histogram_t interarrival_hist; /* Nanoseconds between entries */
+    
+    /*
+     * Warm-up split (enabled by NARWHALYZER_WARMUP_CALLS or
+     * NARWHALYZER_WARMUP_MS). Warm-up activations are also included in the
+     * totals above; steady-state count and time are the difference.
+     */
+    uint64_t warmup_entry_count;        /* Outermost activations during warm-up */
+    uint64_t warmup_time_ns;            /* Time spent in warm-up activations */
+    uint64_t warmup_min_time_ns;
+    uint64_t warmup_max_time_ns;
+    uint64_t steady_min_time_ns;
+    uint64_t steady_max_time_ns;
 } narwhalyzer_section_stats_t;
 
 /*
@@ -52,6 +145,9 @@ typedef struct narwhalyzer_context {
     int section_index;                  /* Index into global stats array */
     uint64_t start_time_ns;             /* Entry timestamp */
     int parent_context_index;           /* Index of parent context in stack */
+    int recursion_depth;                /* Activations of this section on the thread, 1 = outermost */
+    int warmup;                         /* Non-zero if counted as a warm-up activation */
+    int cct_node;                       /* Calling-context tree node, -1 if not recorded */
 } narwhalyzer_context_t;
 
 /*
@@ -113,6 +209,174 @@ void __narwhalyzer_section_exit(int context_index);
  */
 void __narwhalyzer_scope_guard_cleanup(narwhalyzer_scope_guard_t *guard);
 
+/*
+ * Enter a section identified by a name only known at runtime.
+ * Names are interned in a process-wide table; repeated names are resolved
+ * from a small per-thread cache without taking any lock. Sections created
+ * this way are reported with the location "<dynamic>:0".
+ * 
+ * @param name  Section name (need not outlive the call)
+ * @return      Context index to pass to __narwhalyzer_section_exit,
+ *              or -1 on error
+ */
+int narwhalyzer_enter_name(const char *name);
+
+/*
+ * Close one iteration of an outer loop (e.g. a simulation time step).
+ * Section time accumulated since the previous call is attributed to this
+ * step, and the report shows how per-step time drifts over the run.
+ * Call it from a single thread, once per iteration.
+ * 
+ * @param step  Index of the iteration that just finished
+ */
+void narwhalyzer_step(uint64_t step);
+
+/*
+ * ============================================================================
+ * Sinks
+ * ============================================================================
+ *
+ * A sink receives the runtime's data: periodic snapshots of the section
+ * statistics with the change since its previous snapshot, a final
+ * snapshot at exit, and the event chunks of the trace writer. Callbacks
+ * run on a collector thread owned by the runtime, never on an
+ * instrumented thread, and are never called concurrently. The text report
+ * printed at exit is the built-in sink "report".
+ */
+
+/* Statistics of one section, as totals or as the change over an interval */
+typedef struct narwhalyzer_section_snapshot {
+    const char *name;
+    const char *file;
+    int line;
+    uint64_t entries;                   /* All entries, including recursive ones */
+    uint64_t recursive_entries;         /* Entries while already active on the thread */
+    uint64_t time_ns;                   /* Time in outermost activations */
+    uint64_t min_ns;                    /* Shortest activation; totals only, 0 in deltas */
+    uint64_t max_ns;                    /* Longest activation; totals only, 0 in deltas */
+    narwhalyzer_histogram_t duration;   /* Nanoseconds per outermost activation */
+} narwhalyzer_section_snapshot_t;
+
+typedef struct narwhalyzer_snapshot {
+    uint64_t timestamp_ns;              /* Runtime clock when taken */
+    uint64_t elapsed_ns;                /* Program time so far; the whole run when final */
+    uint64_t interval_ns;               /* Since this sink's previous snapshot */
+    int final;                          /* Non-zero for the snapshot taken at exit */
+    int section_count;
+    const narwhalyzer_section_snapshot_t *totals; /* Since program start */
+    const narwhalyzer_section_snapshot_t *deltas; /* Since this sink's previous snapshot */
+    uint64_t dropped_chunks;            /* Event chunks dropped so far because sinks fell behind */
+} narwhalyzer_snapshot_t;
+
+/* Event kinds */
+#define NARWHALYZER_EVENT_ENTER 1
+#define NARWHALYZER_EVENT_EXIT  2
+
+typedef struct narwhalyzer_event {
+    uint64_t timestamp_ns;
+    uint32_t section;                   /* Index into the snapshot's sections */
+    uint32_t kind;                      /* NARWHALYZER_EVENT_ENTER or _EXIT */
+} narwhalyzer_event_t;
+
+/* Events of one thread over a time range (requires NARWHALYZER_TRACE) */
+typedef struct narwhalyzer_event_chunk {
+    uint32_t tid;
+    uint32_t sequence;                  /* Chunk number within the thread */
+    uint32_t open_count;
+    const narwhalyzer_event_t *open;    /* Sections open when the chunk started, outermost first */
+    uint32_t event_count;
+    const narwhalyzer_event_t *events;  /* In timestamp order */
+} narwhalyzer_event_chunk_t;
+
+typedef struct narwhalyzer_sink {
+    const char *name;
+    uint64_t interval_ms;               /* Snapshot period, 0 for the final snapshot only */
+    void (*snapshot)(const narwhalyzer_snapshot_t *snapshot, void *user_data);
+    void (*event_chunk)(const narwhalyzer_event_chunk_t *chunk, void *user_data); /* May be NULL */
+    void (*close)(void *user_data);     /* After the last callback; may be NULL */
+    void *user_data;
+} narwhalyzer_sink_t;
+
+/*
+ * Register a sink. The structure is copied. Sinks registered while the
+ * program runs receive every later snapshot and chunk, and the final
+ * snapshot at exit.
+ *
+ * @param sink  Callbacks and settings
+ * @return      Sink id (>= 0), or -1 on error
+ */
+int narwhalyzer_register_sink(const narwhalyzer_sink_t *sink);
+
+/*
+ * Remove a sink. Its close callback runs on the collector thread; this
+ * call returns once it has. Must not be called from a sink callback.
+ *
+ * @param id  Id returned by narwhalyzer_register_sink
+ */
+void narwhalyzer_unregister_sink(int id);
+
+/*
+ * ============================================================================
+ * Benchmark Harness
+ * ============================================================================
+ *
+ * narwhalyzer_bench_run() calls a workload repeatedly, each call inside a
+ * section named after the benchmark, so the sections of the workload nest
+ * under it as usual. Iterations run until the warm-up has settled (MSER-5
+ * truncation rule); measurement then starts afresh and stops once the 95%
+ * confidence interval of the mean (or median) is narrow enough, or when
+ * the iteration or time budget runs out. The report lists each benchmark
+ * with the time per measured iteration of every section.
+ */
+
+typedef struct narwhalyzer_bench_config {
+    double target_ci;                   /* Relative CI half-width to stop at (default 0.01) */
+    int use_median;                     /* Stop on the median's CI instead of the mean's */
+    uint64_t min_iterations;            /* Measured iterations before stopping (default 10) */
+    uint64_t max_iterations;            /* Warm-up included (default 1000000) */
+    uint64_t max_time_ms;               /* Warm-up included (default 10000) */
+} narwhalyzer_bench_config_t;
+
+typedef struct narwhalyzer_bench_result {
+    uint64_t warmup_iterations;         /* Iterations run until the warm-up settled */
+    uint64_t iterations;                /* Measured iterations */
+    double mean_ns;
+    double mean_ci_ns;                  /* Half-width of the mean's 95% CI */
+    double median_ns;
+    double median_low_ns;               /* 95% CI of the median */
+    double median_high_ns;
+    double stddev_ns;
+    uint64_t min_ns;
+    uint64_t max_ns;
+    int steady;                         /* Warm-up settled within the budget */
+    int converged;                      /* Target CI reached within the budget */
+} narwhalyzer_bench_result_t;
+
+/*
+ * Benchmark fn(ctx) with the default configuration.
+ * 
+ * @param name  Benchmark and section name (need not outlive the call)
+ * @param fn    Workload, called once per iteration
+ * @param ctx   Passed to fn
+ * @return      0 on success, -1 on error
+ */
+int narwhalyzer_bench_run(const char *name, void (*fn)(void *ctx), void *ctx);
+
+/*
+ * Benchmark fn(ctx). Zero fields of config (or a NULL config) take their
+ * defaults; the result is also copied to *result if it is not NULL.
+ */
+int narwhalyzer_bench_run_config(const char *name, void (*fn)(void *ctx), void *ctx,
+                                 const narwhalyzer_bench_config_t *config,
+                                 narwhalyzer_bench_result_t *result);
+
+/*
+ * Mark the entry of main for the startup profiler (NARWHALYZER_STARTUP).
+ * Inserted at the top of main by the GCC plugin; only the first call
+ * counts.
+ */
+void __narwhalyzer_mark_main(void);
+
 /*
  * Get current high-resolution monotonic timestamp.
  * Uses CLOCK_MONOTONIC_RAW for best accuracy.
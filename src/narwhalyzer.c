@@ -9,54 +9,466 @@
  */
 
 #define _GNU_SOURCE
-#include "narwhalyzer.h"
+#include "narwhalyzer_internal.h"
+#include "narwhalyzer_startup.h"
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
 #include <stdatomic.h>
+#include <math.h>
 #include <pthread.h>
+#include <dlfcn.h>
+#include <link.h>
+#include <dirent.h>
+#include <unistd.h>
 
 /* ============================================================================
  * Global State
  * ============================================================================ */
 
-/* Array of all registered sections */
-static narwhalyzer_section_stats_t g_sections[NARWHALYZER_MAX_SECTIONS];
-static atomic_int g_section_count = 0;
+/* Registry used by this copy of the runtime (shared or private) */
+narwhalyzer_registry_t *g_registry = NULL;
 
-/* Thread-local context stack for tracking nested sections */
-static __thread narwhalyzer_context_t g_context_stack[NARWHALYZER_MAX_NESTING_DEPTH];
-static __thread int g_context_stack_top = -1;
+/* Exported under a well-known name so other copies can find the registry */
+extern narwhalyzer_registry_t *__narwhalyzer_registry_hook
+    __attribute__((alias("g_registry"), visibility("default")));
 
-/* Initialization flag */
-static atomic_int g_initialized = 0;
+/* Per-copy cache of the calling thread's state */
+static __thread narwhalyzer_thread_state_t *t_thread_state = NULL;
 
-/* Total program time tracking */
-static uint64_t g_program_start_time_ns = 0;
-static uint64_t g_program_end_time_ns = 0;
+/* Initialization flag (per copy) */
+static atomic_int g_initialized = 0;
 
-/* Mutex for section registration (only used when atomics aren't sufficient) */
-static pthread_mutex_t g_registration_mutex = PTHREAD_MUTEX_INITIALIZER;
+/* Finalization flag (per copy) */
+static atomic_int g_detached = 0;
 
-/* Report already printed flag */
-static atomic_int g_report_printed = 0;
+/* Clock of all timestamps, taken from the registry (per copy) */
+static clockid_t g_clock_id = CLOCK_MONOTONIC_RAW;
 
 /* ============================================================================
  * Internal Utilities
  * ============================================================================ */
 
 /*
- * Get high-resolution monotonic timestamp in nanoseconds.
+ * Get high-resolution monotonic timestamp in nanoseconds, on the clock
+ * selected by NARWHALYZER_CLOCK.
  */
 uint64_t __narwhalyzer_get_timestamp_ns(void)
 {
     struct timespec ts;
-    clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
+    clock_gettime(g_clock_id, &ts);
     return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
 }
 
+/*
+ * Copy a string into the registry arena.
+ * Caller must hold the registry mutex.
+ */
+static const char *arena_intern(narwhalyzer_registry_t *reg, const char *str)
+{
+    if (!str) return NULL;
+    
+    size_t len = strlen(str) + 1;
+    narwhalyzer_arena_chunk_t *chunk = reg->arena;
+    
+    if (!chunk || chunk->capacity - chunk->used < len) {
+        size_t capacity = len > NARWHALYZER_ARENA_CHUNK_SIZE 
+            ? len : NARWHALYZER_ARENA_CHUNK_SIZE;
+        chunk = malloc(sizeof(narwhalyzer_arena_chunk_t) + capacity);
+        if (!chunk) return NULL;
+        chunk->next = reg->arena;
+        chunk->used = 0;
+        chunk->capacity = capacity;
+        reg->arena = chunk;
+    }
+    
+    char *copy = chunk->data + chunk->used;
+    memcpy(copy, str, len);
+    chunk->used += len;
+    return copy;
+}
+
+/*
+ * FNV-1a hash of a section name.
+ */
+static uint32_t hash_name(const char *name)
+{
+    uint32_t hash = 2166136261u;
+    for (const unsigned char *p = (const unsigned char *)name; *p; p++) {
+        hash ^= *p;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+/*
+ * Thread exit handler for the registry thread key.
+ */
+static void thread_state_destroy(void *state)
+{
+    narwhalyzer_thread_state_t *ts = state;
+    narwhalyzer_trace_thread_end(g_registry, ts);
+    for (int i = 0; i < ts->chunk_count; i++) {
+        free(ts->chunks[i]);
+    }
+    free(ts->chunks);
+    free(ts->sections);
+    free(ts);
+}
+
+/*
+ * Read an unsigned integer setting from the environment.
+ */
+static uint64_t env_u64(const char *name, uint64_t default_value)
+{
+    const char *value = getenv(name);
+    if (!value || !*value) {
+        return default_value;
+    }
+    
+    char *end;
+    unsigned long long parsed = strtoull(value, &end, 10);
+    if (*end != '\0') {
+        fprintf(stderr, "narwhalyzer: warning: ignoring invalid %s=%s\n", name, value);
+        return default_value;
+    }
+    return (uint64_t)parsed;
+}
+
+/*
+ * Read the clock selected by NARWHALYZER_CLOCK. CLOCK_MONOTONIC_RAW is not
+ * slewed by NTP; CLOCK_MONOTONIC is; CLOCK_MONOTONIC_COARSE is cheaper to
+ * read but only advances once per scheduler tick.
+ */
+static clockid_t env_clock(void)
+{
+    static const struct { const char *name; clockid_t id; } clocks[] = {
+        { "monotonic_raw", CLOCK_MONOTONIC_RAW },
+        { "monotonic", CLOCK_MONOTONIC },
+        { "monotonic_coarse", CLOCK_MONOTONIC_COARSE },
+    };
+    
+    const char *value = getenv("NARWHALYZER_CLOCK");
+    if (!value || !*value) {
+        return CLOCK_MONOTONIC_RAW;
+    }
+    for (size_t i = 0; i < sizeof(clocks) / sizeof(clocks[0]); i++) {
+        if (strcmp(value, clocks[i].name) == 0) {
+            return clocks[i].id;
+        }
+    }
+    fprintf(stderr, "narwhalyzer: warning: ignoring invalid NARWHALYZER_CLOCK=%s\n", value);
+    return CLOCK_MONOTONIC_RAW;
+}
+
+/*
+ * Check whether a registry published by another copy can be shared.
+ */
+static int registry_is_compatible(const narwhalyzer_registry_t *reg)
+{
+    return reg->magic == NARWHALYZER_REGISTRY_MAGIC &&
+           reg->abi_version == NARWHALYZER_REGISTRY_ABI_VERSION &&
+           reg->size == sizeof(narwhalyzer_registry_t);
+}
+
+/*
+ * dl_iterate_phdr callback: look for a registry hook in a loaded object.
+ * Objects loaded with RTLD_LOCAL are not visible through the global scope,
+ * so each object is inspected through its own handle.
+ */
+static int find_registry_callback(struct dl_phdr_info *info, 
+                                  size_t size __attribute__((unused)),
+                                  void *data)
+{
+    narwhalyzer_registry_t **found = (narwhalyzer_registry_t **)data;
+    const char *path = (info->dlpi_name && info->dlpi_name[0]) 
+        ? info->dlpi_name : NULL;
+    
+    void *handle = dlopen(path, RTLD_LAZY | RTLD_NOLOAD);
+    if (!handle) return 0;
+    
+    narwhalyzer_registry_t **hook = dlsym(handle, "__narwhalyzer_registry_hook");
+    if (hook && *hook && *hook != g_registry) {
+        if (registry_is_compatible(*hook)) {
+            *found = *hook;
+        } else {
+            fprintf(stderr, "narwhalyzer: warning: incompatible runtime copy in %s, "
+                    "its sections are reported separately\n", 
+                    path ? path : "<main program>");
+        }
+    }
+    
+    dlclose(handle);
+    return *found != NULL;
+}
+
+/*
+ * Keep the object holding this copy of the runtime mapped until exit.
+ * The registry's thread key destructor lives in this copy's code.
+ */
+static void pin_runtime_object(void)
+{
+    Dl_info info;
+    if (dladdr((void *)&pin_runtime_object, &info) && info.dli_fname) {
+        /* Intentionally never closed */
+        dlopen(info.dli_fname, RTLD_LAZY | RTLD_NOLOAD | RTLD_NODELETE);
+    }
+}
+
+/*
+ * Get the process creation time on the runtime's clock.
+ * The kernel reports it in clock ticks since boot (typically 10 ms), so it
+ * is converted through the current CLOCK_BOOTTIME offset.
+ */
+static uint64_t read_process_start_ns(void)
+{
+    char buf[1024];
+    FILE *f = fopen("/proc/self/stat", "r");
+    if (!f) return 0;
+    size_t len = fread(buf, 1, sizeof(buf) - 1, f);
+    fclose(f);
+    buf[len] = '\0';
+
+    /* The command name may contain spaces: fields resume after the last ')' */
+    char *p = strrchr(buf, ')');
+    if (!p) return 0;
+
+    /* Field 22 (starttime), counting from field 3 (state) after the ')' */
+    unsigned long long start_ticks = 0;
+    p++;
+    for (int field = 3; field <= 22; field++) {
+        char *end;
+        while (*p == ' ') p++;
+        if (field == 22) {
+            start_ticks = strtoull(p, &end, 10);
+            break;
+        }
+        end = strchr(p, ' ');
+        if (!end) return 0;
+        p = end;
+    }
+
+    long hz = sysconf(_SC_CLK_TCK);
+    struct timespec boot;
+    if (start_ticks == 0 || hz <= 0 || clock_gettime(CLOCK_BOOTTIME, &boot) != 0) {
+        return 0;
+    }
+
+    uint64_t now_ns = __narwhalyzer_get_timestamp_ns();
+    uint64_t boot_ns = (uint64_t)boot.tv_sec * 1000000000ULL + (uint64_t)boot.tv_nsec;
+    uint64_t start_boot_ns = start_ticks * (1000000000ULL / (uint64_t)hz);
+    uint64_t age_ns = boot_ns > start_boot_ns ? boot_ns - start_boot_ns : 0;
+
+    return age_ns < now_ns ? now_ns - age_ns : 0;
+}
+
+static void report_snapshot(const narwhalyzer_snapshot_t *snap, void *user_data);
+
+/*
+ * Find the process-wide registry or create it.
+ * Constructors run under the dynamic loader lock, so two copies cannot
+ * race to create the registry while modules are being loaded.
+ */
+static narwhalyzer_registry_t *attach_registry(void)
+{
+    narwhalyzer_registry_t *reg = NULL;
+    dl_iterate_phdr(find_registry_callback, &reg);
+    if (reg) {
+        return reg;
+    }
+    
+    reg = calloc(1, sizeof(narwhalyzer_registry_t));
+    if (!reg) {
+        fprintf(stderr, "narwhalyzer: error: cannot allocate section registry\n");
+        abort();
+    }
+    
+    reg->magic = NARWHALYZER_REGISTRY_MAGIC;
+    reg->abi_version = NARWHALYZER_REGISTRY_ABI_VERSION;
+    reg->size = sizeof(narwhalyzer_registry_t);
+    pthread_mutex_init(&reg->mutex, NULL);
+    pthread_key_create(&reg->thread_key, thread_state_destroy);
+    reg->clock_id = (int)env_clock();
+    g_clock_id = (clockid_t)reg->clock_id;
+    reg->program_start_time_ns = __narwhalyzer_get_timestamp_ns();
+    reg->warmup_calls = env_u64("NARWHALYZER_WARMUP_CALLS", 0);
+    reg->warmup_ns = env_u64("NARWHALYZER_WARMUP_MS", 0) * 1000000ULL;
+    reg->startup_enabled = env_u64("NARWHALYZER_STARTUP", 0);
+    reg->occupancy_enabled = env_u64("NARWHALYZER_OCCUPANCY", 0);
+    reg->arrivals_enabled = env_u64("NARWHALYZER_ARRIVALS", 0);
+    narwhalyzer_trace_open(reg);
+    narwhalyzer_metrics_start(reg);
+    narwhalyzer_sinks_init(reg);
+    narwhalyzer_sink_t report = { .name = "report", .snapshot = report_snapshot };
+    narwhalyzer_sinks_add(reg, &report, 1);
+    if (getenv("NARWHALYZER_PROFILE")) {
+        reg->profile_pid = (uint64_t)getpid();
+    }
+    if (reg->startup_enabled) {
+        reg->process_start_ns = read_process_start_ns();
+    }
+    
+    pin_runtime_object();
+    
+    return reg;
+}
+
+/*
+ * Get the calling thread's state, creating it on first use.
+ */
+static narwhalyzer_thread_state_t *get_thread_state(void)
+{
+    narwhalyzer_thread_state_t *ts = t_thread_state;
+    if (__builtin_expect(ts != NULL, 1)) {
+        return ts;
+    }
+    
+    ts = pthread_getspecific(g_registry->thread_key);
+    if (!ts) {
+        ts = calloc(1, sizeof(narwhalyzer_thread_state_t));
+        if (!ts) return NULL;
+        ts->sections = calloc(NARWHALYZER_MAX_SECTIONS, sizeof(narwhalyzer_thread_section_t));
+        if (!ts->sections) {
+            free(ts);
+            return NULL;
+        }
+        ts->context_stack_top = -1;
+        ts->context_capacity = NARWHALYZER_INLINE_NESTING_DEPTH;
+        ts->start_time_ns = __narwhalyzer_get_timestamp_ns();
+        narwhalyzer_trace_thread_start(g_registry, ts);
+        narwhalyzer_cct_thread_start(g_registry, ts);
+        pthread_setspecific(g_registry->thread_key, ts);
+    }
+    
+    t_thread_state = ts;
+    return ts;
+}
+
+/*
+ * Add one chunk of frames to the thread's context stack.
+ * Returns 0 on success, -1 if the stack cannot grow.
+ */
+static int grow_context_stack(narwhalyzer_thread_state_t *ts)
+{
+    if (ts->context_capacity >= NARWHALYZER_MAX_NESTING_DEPTH) {
+        return -1;
+    }
+    
+    narwhalyzer_context_t **chunks = realloc(ts->chunks, 
+        (ts->chunk_count + 1) * sizeof(narwhalyzer_context_t *));
+    if (!chunks) {
+        return -1;
+    }
+    ts->chunks = chunks;
+    
+    narwhalyzer_context_t *chunk = malloc(NARWHALYZER_CONTEXT_CHUNK_DEPTH * 
+                                          sizeof(narwhalyzer_context_t));
+    if (!chunk) {
+        return -1;
+    }
+    
+    ts->chunks[ts->chunk_count++] = chunk;
+    ts->context_capacity += NARWHALYZER_CONTEXT_CHUNK_DEPTH;
+    return 0;
+}
+
+/*
+ * Record a value in a shared histogram.
+ */
+static inline void histogram_record(narwhalyzer_histogram_t *hist, uint64_t value)
+{
+    __atomic_fetch_add(&hist->buckets[narwhalyzer_histogram_bucket(value)], 1, 
+                       __ATOMIC_RELAXED);
+}
+
+/*
+ * Lower a shared minimum (using compare-and-swap).
+ */
+static inline void update_min(uint64_t *target, uint64_t value)
+{
+    uint64_t old = __atomic_load_n(target, __ATOMIC_RELAXED);
+    while (value < old) {
+        if (__atomic_compare_exchange_n(target, &old, value,
+                                          0, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+            break;
+        }
+    }
+}
+
+/*
+ * Raise a shared maximum (using compare-and-swap).
+ */
+static inline void update_max(uint64_t *target, uint64_t value)
+{
+    uint64_t old = __atomic_load_n(target, __ATOMIC_RELAXED);
+    while (value > old) {
+        if (__atomic_compare_exchange_n(target, &old, value,
+                                          0, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+            break;
+        }
+    }
+}
+
+/*
+ * Layout of narwhalyzer_section_stats_t.occupancy_state.
+ */
+#define OCCUPANCY_COUNT_BITS 16
+#define OCCUPANCY_COUNT_MASK ((1ULL << OCCUPANCY_COUNT_BITS) - 1)
+#define OCCUPANCY_TIME_MASK  ((1ULL << (64 - OCCUPANCY_COUNT_BITS)) - 1)
+
+/*
+ * Change the number of threads inside a section by delta (+1 or -1).
+ * The time spent at the previous thread count is credited to the
+ * concurrency histogram, so the histogram is time-weighted and exact
+ * up to the ordering of concurrent timestamps.
+ */
+static inline void update_occupancy(narwhalyzer_section_stats_t *s, 
+                                    uint64_t now_ns, int delta)
+{
+    uint64_t now = (now_ns - g_registry->program_start_time_ns) & OCCUPANCY_TIME_MASK;
+    uint64_t old = __atomic_load_n(&s->occupancy_state, __ATOMIC_RELAXED);
+    uint64_t count, since, desired;
+    
+    do {
+        count = old & OCCUPANCY_COUNT_MASK;
+        since = old >> OCCUPANCY_COUNT_BITS;
+        if (delta < 0 && count == 0) {
+            return; /* Unbalanced exit */
+        }
+        /* Another thread may have published a slightly later timestamp */
+        uint64_t stamp = ((now - since) & OCCUPANCY_TIME_MASK) > (OCCUPANCY_TIME_MASK >> 1)
+            ? since : now;
+        desired = (stamp << OCCUPANCY_COUNT_BITS) | 
+                  ((count + (uint64_t)(int64_t)delta) & OCCUPANCY_COUNT_MASK);
+    } while (!__atomic_compare_exchange_n(&s->occupancy_state, &old, desired,
+                                           0, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+    
+    if (count > 0) {
+        uint64_t elapsed = ((desired >> OCCUPANCY_COUNT_BITS) - since) & OCCUPANCY_TIME_MASK;
+        __atomic_fetch_add(&s->concurrency_time_hist.buckets[narwhalyzer_histogram_bucket(count)],
+                           elapsed, __ATOMIC_RELAXED);
+    }
+    if (delta > 0 && count + 1 > s->max_concurrency) {
+        update_max(&s->max_concurrency, count + 1);
+    }
+}
+
+/*
+ * Count a dropped section entry.
+ * Warns on the 1st, 2nd, 4th, 8th... occurrence so that a runaway recursion
+ * does not turn every entry into a write to stderr.
+ */
+static void report_nesting_overflow(void)
+{
+    uint64_t n = __atomic_add_fetch(&g_registry->nesting_overflows, 1, __ATOMIC_RELAXED);
+    if ((n & (n - 1)) == 0) {
+        fprintf(stderr, "narwhalyzer: warning: maximum nesting depth exceeded "
+                "(%lu entries dropped so far)\n", (unsigned long)n);
+    }
+}
+
 /*
  * Compare function for sorting sections by cumulative time (descending).
  */
@@ -65,8 +477,8 @@ static int compare_sections_by_time(const void *a, const void *b)
     const int *ia = (const int *)a;
     const int *ib = (const int *)b;
     
-    uint64_t time_a = g_sections[*ia].cumulative_time_ns;
-    uint64_t time_b = g_sections[*ib].cumulative_time_ns;
+    uint64_t time_a = g_registry->sections[*ia].cumulative_time_ns;
+    uint64_t time_b = g_registry->sections[*ib].cumulative_time_ns;
     
     if (time_b > time_a) return 1;
     if (time_b < time_a) return -1;
@@ -111,6 +523,71 @@ static void print_table_separator(int name_width)
     printf("+\n");
 }
 
+/*
+ * Total number of samples in a histogram.
+ */
+static uint64_t histogram_count(const narwhalyzer_histogram_t *hist)
+{
+    uint64_t total = 0;
+    for (int b = 0; b < NARWHALYZER_HIST_BUCKETS; b++) {
+        total += hist->buckets[b];
+    }
+    return total;
+}
+
+/*
+ * Estimate a quantile (0..1) from a histogram.
+ * Interpolates linearly inside the bucket holding the quantile.
+ */
+static uint64_t histogram_quantile(const narwhalyzer_histogram_t *hist, double q)
+{
+    uint64_t total = histogram_count(hist);
+    if (total == 0) return 0;
+    
+    double rank = q * (double)(total - 1);
+    uint64_t seen = 0;
+    for (int b = 0; b < NARWHALYZER_HIST_BUCKETS; b++) {
+        uint64_t count = hist->buckets[b];
+        if (count == 0) continue;
+        if ((double)(seen + count) > rank) {
+            uint64_t lower = narwhalyzer_histogram_bucket_lower(b);
+            uint64_t upper = narwhalyzer_histogram_bucket_lower(b + 1);
+            double fraction = (rank - (double)seen + 0.5) / (double)count;
+            return lower + (uint64_t)(fraction * (double)(upper - lower - 1));
+        }
+        seen += count;
+    }
+    return narwhalyzer_histogram_bucket_lower(NARWHALYZER_HIST_BUCKETS - 1);
+}
+
+/*
+ * Estimate mean and coefficient of variation from a histogram,
+ * using the midpoint of each bucket.
+ */
+static double histogram_cv(const narwhalyzer_histogram_t *hist, double *mean_out)
+{
+    double n = 0.0, sum = 0.0, sum_sq = 0.0;
+    for (int b = 0; b < NARWHALYZER_HIST_BUCKETS; b++) {
+        uint64_t count = hist->buckets[b];
+        if (count == 0) continue;
+        double lower = (double)narwhalyzer_histogram_bucket_lower(b);
+        double upper = (double)narwhalyzer_histogram_bucket_lower(b + 1);
+        double mid = (lower + upper - 1.0) / 2.0;
+        n += (double)count;
+        sum += (double)count * mid;
+        sum_sq += (double)count * mid * mid;
+    }
+    if (n == 0.0) {
+        if (mean_out) *mean_out = 0.0;
+        return 0.0;
+    }
+    
+    double mean = sum / n;
+    double variance = sum_sq / n - mean * mean;
+    if (mean_out) *mean_out = mean;
+    return (mean > 0.0 && variance > 0.0) ? sqrt(variance) / mean : 0.0;
+}
+
 /*
  * Build hierarchy information from parent indices.
  */
@@ -136,7 +613,7 @@ static void add_child(hierarchy_node_t *node, int child_idx)
 static void print_hierarchy_recursive(hierarchy_node_t *nodes, int idx, 
                                        const char *prefix, int is_last)
 {
-    narwhalyzer_section_stats_t *s = &g_sections[idx];
+    narwhalyzer_section_stats_t *s = &g_registry->sections[idx];
     char time_buf[32];
     format_time(s->cumulative_time_ns, time_buf, sizeof(time_buf));
     
@@ -181,7 +658,7 @@ static void print_flat_summary(int section_count, uint64_t total_time_ns)
     /* Calculate maximum name width */
     int max_name_width = 12; /* Minimum width for "Section Name" */
     for (int i = 0; i < section_count; i++) {
-        int len = strlen(g_sections[i].name);
+        int len = strlen(g_registry->sections[i].name);
         if (len > max_name_width) max_name_width = len;
     }
     if (max_name_width > 40) max_name_width = 40; /* Cap at 40 chars */
@@ -196,7 +673,12 @@ static void print_flat_summary(int section_count, uint64_t total_time_ns)
     char total_time_buf[32];
     format_time(total_time_ns, total_time_buf, sizeof(total_time_buf));
     printf("Total Program Time: %s\n", total_time_buf);
-    printf("Sections Instrumented: %d\n\n", section_count);
+    printf("Sections Instrumented: %d\n", section_count);
+    if (g_registry->nesting_overflows > 0) {
+        printf("Entries Dropped (nesting > %d): %lu\n", NARWHALYZER_MAX_NESTING_DEPTH,
+               (unsigned long)g_registry->nesting_overflows);
+    }
+    printf("\n");
     
     printf("═══ FLAT SUMMARY (sorted by cumulative time) ═══\n\n");
     
@@ -208,12 +690,13 @@ static void print_flat_summary(int section_count, uint64_t total_time_ns)
     
     for (int i = 0; i < section_count; i++) {
         int idx = sorted_indices[i];
-        narwhalyzer_section_stats_t *s = &g_sections[idx];
+        narwhalyzer_section_stats_t *s = &g_registry->sections[idx];
         
         if (s->entry_count == 0) continue;
         
         char cumul_buf[32], mean_buf[32], min_buf[32], max_buf[32];
-        uint64_t mean_time = s->cumulative_time_ns / s->entry_count;
+        uint64_t outer_count = s->entry_count - s->recursive_entry_count;
+        uint64_t mean_time = outer_count ? s->cumulative_time_ns / outer_count : 0;
         
         format_time(s->cumulative_time_ns, cumul_buf, sizeof(cumul_buf));
         format_time(mean_time, mean_buf, sizeof(mean_buf));
@@ -244,6 +727,62 @@ static void print_flat_summary(int section_count, uint64_t total_time_ns)
     free(sorted_indices);
 }
 
+/*
+ * Print warm-up and steady-state statistics side by side.
+ */
+static void print_warmup_summary(int section_count)
+{
+    narwhalyzer_registry_t *reg = g_registry;
+    if (!reg->warmup_calls && !reg->warmup_ns) return;
+    
+    printf("\n═══ WARM-UP vs STEADY STATE (");
+    if (reg->warmup_calls) {
+        printf("first %lu calls per thread", (unsigned long)reg->warmup_calls);
+    }
+    if (reg->warmup_calls && reg->warmup_ns) {
+        printf(" or ");
+    }
+    if (reg->warmup_ns) {
+        printf("first %lu ms of each thread", (unsigned long)(reg->warmup_ns / 1000000ULL));
+    }
+    printf(") ═══\n\n");
+    
+    printf("  %-24s %9s %12s %12s | %9s %12s %12s %12s | %7s\n",
+           "Section", "Warm N", "Warm Mean", "Warm Max",
+           "Steady N", "Steady Mean", "Steady Min", "Steady Max", "Ratio");
+    
+    for (int i = 0; i < section_count; i++) {
+        narwhalyzer_section_stats_t *s = &reg->sections[i];
+        if (s->entry_count == 0) continue;
+        
+        uint64_t outer_count = s->entry_count - s->recursive_entry_count;
+        uint64_t warm_n = s->warmup_entry_count;
+        uint64_t steady_n = outer_count > warm_n ? outer_count - warm_n : 0;
+        uint64_t steady_time = s->cumulative_time_ns - s->warmup_time_ns;
+        uint64_t warm_mean = warm_n ? s->warmup_time_ns / warm_n : 0;
+        uint64_t steady_mean = steady_n ? steady_time / steady_n : 0;
+        
+        char warm_mean_buf[32], warm_max_buf[32];
+        char steady_mean_buf[32], steady_min_buf[32], steady_max_buf[32];
+        format_time(warm_mean, warm_mean_buf, sizeof(warm_mean_buf));
+        format_time(warm_n ? s->warmup_max_time_ns : 0, warm_max_buf, sizeof(warm_max_buf));
+        format_time(steady_mean, steady_mean_buf, sizeof(steady_mean_buf));
+        format_time(steady_n ? s->steady_min_time_ns : 0, steady_min_buf, sizeof(steady_min_buf));
+        format_time(steady_n ? s->steady_max_time_ns : 0, steady_max_buf, sizeof(steady_max_buf));
+        
+        char ratio_buf[16] = "-";
+        if (warm_n && steady_n && steady_mean > 0) {
+            snprintf(ratio_buf, sizeof(ratio_buf), "%.2fx", 
+                     (double)warm_mean / (double)steady_mean);
+        }
+        
+        printf("  %-24.24s %9lu %12s %12s | %9lu %12s %12s %12s | %7s\n",
+               s->name, (unsigned long)warm_n, warm_mean_buf, warm_max_buf,
+               (unsigned long)steady_n, steady_mean_buf, steady_min_buf, 
+               steady_max_buf, ratio_buf);
+    }
+}
+
 /*
  * Print the hierarchical view.
  */
@@ -264,7 +803,7 @@ static void print_hierarchy_view(int section_count)
         nodes[i].child_count = 0;
         nodes[i].child_capacity = 0;
         
-        int parent = g_sections[i].parent_index;
+        int parent = g_registry->sections[i].parent_index;
         if (parent < 0) {
             root_sections[root_count++] = i;
         } else if (parent < section_count) {
@@ -275,7 +814,7 @@ static void print_hierarchy_view(int section_count)
     /* Print from each root */
     for (int i = 0; i < root_count; i++) {
         int idx = root_sections[i];
-        narwhalyzer_section_stats_t *s = &g_sections[idx];
+        narwhalyzer_section_stats_t *s = &g_registry->sections[idx];
         
         if (s->entry_count == 0) continue;
         
@@ -300,162 +839,1104 @@ static void print_hierarchy_view(int section_count)
 }
 
 /*
- * Print location details for all sections.
+ * Print recursion statistics for sections that recursed.
  */
-static void print_section_details(int section_count)
+static void print_recursion_view(int section_count)
 {
-    printf("═══ SECTION DETAILS ═══\n\n");
+    int header_printed = 0;
     
     for (int i = 0; i < section_count; i++) {
-        narwhalyzer_section_stats_t *s = &g_sections[i];
-        if (s->entry_count == 0) continue;
+        narwhalyzer_section_stats_t *s = &g_registry->sections[i];
+        if (s->recursive_entry_count == 0) continue;
         
+        if (!header_printed) {
+            printf("═══ RECURSION (time counted once per outermost activation) ═══\n\n");
+            header_printed = 1;
+        }
+        
+        uint64_t outer_count = s->entry_count - s->recursive_entry_count;
         printf("  %s\n", s->name);
-        printf("    Location: %s:%d\n", s->file ? s->file : "<unknown>", s->line);
-        printf("    Entries:  %lu\n", (unsigned long)s->entry_count);
+        printf("    Outermost entries: %lu, nested entries: %lu, max depth: %lu\n",
+               (unsigned long)outer_count,
+               (unsigned long)s->recursive_entry_count,
+               (unsigned long)s->max_recursion_depth);
+        printf("    Depth histogram:\n");
+        printf("      %-13s %12lu\n", "1", (unsigned long)outer_count);
+        
+        for (int b = 0; b < NARWHALYZER_HIST_BUCKETS; b++) {
+            uint64_t count = s->recursion_depth_hist.buckets[b];
+            if (count == 0) continue;
+            
+            uint64_t lower = narwhalyzer_histogram_bucket_lower(b);
+            uint64_t upper = narwhalyzer_histogram_bucket_lower(b + 1) - 1;
+            char range[32];
+            if (lower == upper) {
+                snprintf(range, sizeof(range), "%lu", (unsigned long)lower);
+            } else {
+                snprintf(range, sizeof(range), "%lu-%lu", 
+                         (unsigned long)lower, (unsigned long)upper);
+            }
+            printf("      %-13s %12lu\n", range, (unsigned long)count);
+        }
         printf("\n");
     }
 }
 
-/* ============================================================================
- * Public API Implementation
- * ============================================================================ */
+/*
+ * Wall time during which at least one thread was inside a section.
+ */
+static uint64_t occupied_time_ns(const narwhalyzer_section_stats_t *s)
+{
+    uint64_t total = 0;
+    for (int b = 1; b < NARWHALYZER_HIST_BUCKETS; b++) {
+        total += s->concurrency_time_hist.buckets[b];
+    }
+    return total;
+}
 
 /*
- * Initialize the runtime.
+ * Print concurrency occupancy.
+ * Skipped entirely when no section was ever entered by two threads at once.
  */
-__attribute__((constructor(101)))
-void __narwhalyzer_init(void)
+static void print_concurrency_view(int section_count)
 {
-    int expected = 0;
-    if (!atomic_compare_exchange_strong(&g_initialized, &expected, 1)) {
-        return; /* Already initialized */
+    int any_concurrent = 0;
+    for (int i = 0; i < section_count; i++) {
+        if (g_registry->sections[i].max_concurrency > 1) {
+            any_concurrent = 1;
+            break;
+        }
     }
+    if (!any_concurrent) return;
     
-    g_program_start_time_ns = __narwhalyzer_get_timestamp_ns();
-    
-    /* Initialize section array */
-    memset(g_sections, 0, sizeof(g_sections));
+    printf("═══ CONCURRENCY (threads inside each section) ═══\n\n");
     
-    /* Register atexit handler as backup */
-    atexit(__narwhalyzer_fini);
+    for (int i = 0; i < section_count; i++) {
+        narwhalyzer_section_stats_t *s = &g_registry->sections[i];
+        if (s->entry_count == 0) continue;
+        
+        uint64_t occupied = occupied_time_ns(s);
+        double average = occupied > 0 
+            ? (double)s->cumulative_time_ns / (double)occupied : 0.0;
+        char occupied_buf[32];
+        format_time(occupied, occupied_buf, sizeof(occupied_buf));
+        
+        printf("  %s\n", s->name);
+        printf("    Max threads: %lu, time-weighted average: %.2f, occupied wall time: %s\n",
+               (unsigned long)s->max_concurrency, average, occupied_buf);
+        printf("    Time at thread count:\n");
+        
+        for (int b = 1; b < NARWHALYZER_HIST_BUCKETS; b++) {
+            uint64_t ns = s->concurrency_time_hist.buckets[b];
+            if (ns == 0) continue;
+            
+            uint64_t lower = narwhalyzer_histogram_bucket_lower(b);
+            uint64_t upper = narwhalyzer_histogram_bucket_lower(b + 1) - 1;
+            char range[32], time_buf[32];
+            if (lower == upper) {
+                snprintf(range, sizeof(range), "%lu", (unsigned long)lower);
+            } else {
+                snprintf(range, sizeof(range), "%lu-%lu", 
+                         (unsigned long)lower, (unsigned long)upper);
+            }
+            format_time(ns, time_buf, sizeof(time_buf));
+            printf("      %-13s %12s %6.1f%%\n", range, time_buf,
+                   occupied > 0 ? 100.0 * (double)ns / (double)occupied : 0.0);
+        }
+        printf("\n");
+    }
 }
 
 /*
- * Check if initialized.
+ * Print call rate and inter-arrival distribution.
  */
-int __narwhalyzer_is_initialized(void)
+static void print_arrival_view(int section_count)
 {
-    return atomic_load(&g_initialized);
+    int header_printed = 0;
+    
+    for (int i = 0; i < section_count; i++) {
+        narwhalyzer_section_stats_t *s = &g_registry->sections[i];
+        uint64_t gaps = histogram_count(&s->interarrival_hist);
+        if (gaps == 0) continue;
+        
+        if (!header_printed) {
+            printf("═══ ARRIVALS (time between successive entries per thread) ═══\n\n");
+            header_printed = 1;
+        }
+        
+        uint64_t outer_count = s->entry_count - s->recursive_entry_count;
+        uint64_t window = s->last_entry_ns - s->first_entry_ns;
+        double rate = window > 0 ? (double)(outer_count - 1) * 1e9 / (double)window : 0.0;
+        double cv = histogram_cv(&s->interarrival_hist, NULL);
+        
+        char p10[32], p50[32], p90[32], p99[32];
+        format_time(histogram_quantile(&s->interarrival_hist, 0.10), p10, sizeof(p10));
+        format_time(histogram_quantile(&s->interarrival_hist, 0.50), p50, sizeof(p50));
+        format_time(histogram_quantile(&s->interarrival_hist, 0.90), p90, sizeof(p90));
+        format_time(histogram_quantile(&s->interarrival_hist, 0.99), p99, sizeof(p99));
+        
+        printf("  %s\n", s->name);
+        printf("    Call rate: %.1f/s, burstiness (CV): %.2f%s\n", rate, cv,
+               cv > 1.5 ? " (bursty)" : cv < 0.5 ? " (steady)" : "");
+        printf("    Inter-arrival p10: %s, p50: %s, p90: %s, p99: %s\n",
+               p10, p50, p90, p99);
+        printf("\n");
+    }
 }
 
 /*
- * Finalize and print report.
+ * Print location details for all sections.
  */
-__attribute__((destructor(101)))
-void __narwhalyzer_fini(void)
+static void print_section_details(int section_count)
 {
-    int expected = 0;
-    if (!atomic_compare_exchange_strong(&g_report_printed, &expected, 1)) {
-        return; /* Report already printed */
+    printf("═══ SECTION DETAILS ═══\n\n");
+    
+    for (int i = 0; i < section_count; i++) {
+        narwhalyzer_section_stats_t *s = &g_registry->sections[i];
+        if (s->entry_count == 0) continue;
+        
+        printf("  %s\n", s->name);
+        printf("    Location: %s:%d\n", s->file ? s->file : "<unknown>", s->line);
+        printf("    Entries:  %lu\n", (unsigned long)s->entry_count);
+        if (histogram_count(&s->duration_hist) > 0) {
+            char p50[32], p90[32], p99[32];
+            format_time(histogram_quantile(&s->duration_hist, 0.50), p50, sizeof(p50));
+            format_time(histogram_quantile(&s->duration_hist, 0.90), p90, sizeof(p90));
+            format_time(histogram_quantile(&s->duration_hist, 0.99), p99, sizeof(p99));
+            printf("    Duration p50: %s, p90: %s, p99: %s\n", p50, p90, p99);
+        }
+        printf("\n");
+    }
+}
+
+/* ============================================================================
+ * Step Time Series
+ * ============================================================================ */
+
+/*
+ * Merge adjacent window pairs, halving the number of windows in use.
+ */
+static void merge_step_windows(narwhalyzer_step_series_t *series, int section_count)
+{
+    int merged = series->window_count / 2;
+    
+    for (int w = 0; w < merged; w++) {
+        narwhalyzer_step_window_t *a = &series->windows[2 * w];
+        narwhalyzer_step_window_t *b = &series->windows[2 * w + 1];
+        narwhalyzer_step_window_t out = {
+            .first_step = a->first_step,
+            .last_step = b->last_step,
+            .steps = a->steps + b->steps,
+            .wall_ns = a->wall_ns + b->wall_ns,
+        };
+        series->windows[w] = out;
+        
+        for (int i = 0; i < section_count; i++) {
+            series->time_ns[w][i] = series->time_ns[2 * w][i] + series->time_ns[2 * w + 1][i];
+            series->calls[w][i] = series->calls[2 * w][i] + series->calls[2 * w + 1][i];
+        }
+    }
+    
+    series->window_count = merged;
+    series->steps_per_window *= 2;
+}
+
+/*
+ * Find the step at which a per-window series shifts the most.
+ * Fits one mean before and one after each candidate split and keeps the
+ * split with the smallest squared error. Returns the first window after the
+ * split, or 0 if the series is too short.
+ */
+static int find_step_shift(const double *values, int count, double *before, double *after)
+{
+    int best = 0;
+    double best_cost = 0.0;
+    
+    for (int k = 1; k < count; k++) {
+        double mean_a = 0.0, mean_b = 0.0, cost = 0.0;
+        for (int w = 0; w < k; w++) mean_a += values[w];
+        for (int w = k; w < count; w++) mean_b += values[w];
+        mean_a /= k;
+        mean_b /= count - k;
+        for (int w = 0; w < k; w++) cost += (values[w] - mean_a) * (values[w] - mean_a);
+        for (int w = k; w < count; w++) cost += (values[w] - mean_b) * (values[w] - mean_b);
+        
+        if (best == 0 || cost < best_cost) {
+            best = k;
+            best_cost = cost;
+            *before = mean_a;
+            *after = mean_b;
+        }
+    }
+    
+    return best;
+}
+
+/*
+ * Print one character per window, scaled between the series min and max.
+ */
+static void print_sparkline(const double *values, int count)
+{
+    static const char *levels[] = { "▁", "▂", "▃", "▄", "▅", "▆", "▇", "█" };
+    
+    double lo = values[0], hi = values[0];
+    for (int w = 1; w < count; w++) {
+        if (values[w] < lo) lo = values[w];
+        if (values[w] > hi) hi = values[w];
+    }
+    
+    for (int w = 0; w < count; w++) {
+        int level = hi > lo ? (int)((values[w] - lo) / (hi - lo) * 7.0 + 0.5) : 0;
+        printf("%s", levels[level]);
+    }
+}
+
+/*
+ * Print per-step time of each section over the run.
+ */
+static void print_step_view(int section_count)
+{
+    narwhalyzer_step_series_t *series = g_registry->steps;
+    if (!series || series->window_count < 2) return;
+    
+    int windows = series->window_count;
+    uint64_t total_steps = 0;
+    for (int w = 0; w < windows; w++) {
+        total_steps += series->windows[w].steps;
     }
     
-    g_program_end_time_ns = __narwhalyzer_get_timestamp_ns();
-    uint64_t total_time_ns = g_program_end_time_ns - g_program_start_time_ns;
+    printf("═══ STEP TIME SERIES (%lu steps, %lu per window) ═══\n\n",
+           (unsigned long)total_steps, (unsigned long)series->steps_per_window);
     
-    int section_count = atomic_load(&g_section_count);
+    double values[NARWHALYZER_STEP_WINDOWS];
+    
+    /* Row -1 is the wall time of the step itself */
+    for (int i = -1; i < section_count; i++) {
+        uint64_t sum = 0;
+        for (int w = 0; w < windows; w++) {
+            uint64_t ns = i < 0 ? series->windows[w].wall_ns : series->time_ns[w][i];
+            values[w] = series->windows[w].steps 
+                ? (double)ns / (double)series->windows[w].steps : 0.0;
+            sum += ns;
+        }
+        if (sum == 0) continue;
+        
+        double before = 0.0, after = 0.0;
+        int shift = find_step_shift(values, windows, &before, &after);
+        
+        char first_buf[32], last_buf[32];
+        format_time((uint64_t)values[0], first_buf, sizeof(first_buf));
+        format_time((uint64_t)values[windows - 1], last_buf, sizeof(last_buf));
+        
+        printf("  %s\n", i < 0 ? "(step wall time)" : g_registry->sections[i].name);
+        printf("    Per step: %s in steps %lu-%lu, %s in steps %lu-%lu\n",
+               first_buf, (unsigned long)series->windows[0].first_step,
+               (unsigned long)series->windows[0].last_step,
+               last_buf, (unsigned long)series->windows[windows - 1].first_step,
+               (unsigned long)series->windows[windows - 1].last_step);
+        printf("    ");
+        print_sparkline(values, windows);
+        printf("\n");
+        
+        /* Tell "each call got slower" apart from "more calls per step" */
+        if (i >= 0) {
+            double calls_first = (double)series->calls[0][i] / (double)series->windows[0].steps;
+            double calls_last = (double)series->calls[windows - 1][i] /
+                                (double)series->windows[windows - 1].steps;
+            if (calls_first > 0.0 && fabs(calls_last - calls_first) >= 0.1 * calls_first) {
+                printf("    Calls per step: %.1f -> %.1f\n", calls_first, calls_last);
+            }
+        }
+        
+        /* Only report shifts worth looking at */
+        if (shift > 0 && before > 0.0) {
+            double change = 100.0 * (after - before) / before;
+            if (change >= 10.0 || change <= -10.0) {
+                char before_buf[32], after_buf[32];
+                format_time((uint64_t)before, before_buf, sizeof(before_buf));
+                format_time((uint64_t)after, after_buf, sizeof(after_buf));
+                printf("    Shift at step %lu: %s -> %s per step (%+.0f%%)\n",
+                       (unsigned long)series->windows[shift].first_step,
+                       before_buf, after_buf, change);
+            }
+        }
+        printf("\n");
+    }
+}
+
+/*
+ * Print the benchmarks run with narwhalyzer_bench_run(), with the sections
+ * nested in each one per measured iteration.
+ */
+static void print_bench_view(void)
+{
+    narwhalyzer_bench_t *bench = g_registry->benches;
+    if (!bench) return;
+    
+    printf("═══ BENCHMARKS ═══\n\n");
+    
+    for (; bench; bench = bench->next) {
+        narwhalyzer_bench_result_t *r = &bench->result;
+        printf("  %s\n", g_registry->sections[bench->section_index].name);
+        printf("    Iterations: %lu measured, %lu warm-up%s\n",
+               (unsigned long)r->iterations, (unsigned long)r->warmup_iterations,
+               r->steady ? "" : " (no steady state detected)");
+        if (r->iterations == 0) {
+            printf("\n");
+            continue;
+        }
+        
+        char mean_buf[32], median_buf[32], low_buf[32], high_buf[32];
+        char min_buf[32], max_buf[32], stddev_buf[32];
+        format_time((uint64_t)r->mean_ns, mean_buf, sizeof(mean_buf));
+        format_time((uint64_t)r->median_ns, median_buf, sizeof(median_buf));
+        format_time((uint64_t)r->median_low_ns, low_buf, sizeof(low_buf));
+        format_time((uint64_t)r->median_high_ns, high_buf, sizeof(high_buf));
+        format_time(r->min_ns, min_buf, sizeof(min_buf));
+        format_time(r->max_ns, max_buf, sizeof(max_buf));
+        format_time((uint64_t)r->stddev_ns, stddev_buf, sizeof(stddev_buf));
+        
+        if (r->iterations > 1 && r->mean_ns > 0.0) {
+            printf("    Mean: %s +- %.2f%%   Median: %s [%s, %s]\n", mean_buf,
+                   100.0 * r->mean_ci_ns / r->mean_ns, median_buf, low_buf, high_buf);
+        } else {
+            printf("    Mean: %s   Median: %s\n", mean_buf, median_buf);
+        }
+        printf("    Min: %s   Max: %s   Stddev: %s\n", min_buf, max_buf, stddev_buf);
+        if (r->converged) {
+            printf("    Stopped: %s 95%% CI within +-%.2f%%\n",
+                   bench->use_median ? "median" : "mean", 100.0 * bench->target_ci);
+        } else {
+            printf("    Stopped: budget exhausted before the %s CI reached +-%.2f%%\n",
+                   bench->use_median ? "median" : "mean", 100.0 * bench->target_ci);
+        }
+        
+        /* Sections entered from the benchmark, per measured iteration */
+        uint64_t own_ns = bench->section_index < bench->section_count
+            ? bench->time_ns[bench->section_index] : 0;
+        int header = 0;
+        for (int i = 0; i < bench->section_count; i++) {
+            if (i == bench->section_index || bench->calls[i] == 0) continue;
+            if (!header) {
+                printf("    Per iteration:\n");
+                header = 1;
+            }
+            char time_buf[32];
+            format_time(bench->time_ns[i] / r->iterations, time_buf, sizeof(time_buf));
+            printf("      %-32s %8.1f calls %12s", g_registry->sections[i].name,
+                   (double)bench->calls[i] / (double)r->iterations, time_buf);
+            if (own_ns > 0) {
+                printf(" %6.1f%%", 100.0 * (double)bench->time_ns[i] / (double)own_ns);
+            }
+            printf("\n");
+        }
+        printf("\n");
+    }
+}
+
+/* ============================================================================
+ * Startup Profiling
+ * ============================================================================
+ *
+ * With NARWHALYZER_STARTUP set, the time between process creation and main
+ * is reported as a synthetic "startup" section tree. The runtime is only
+ * initialized once every object has been loaded and relocated, so earlier
+ * phases are reconstructed at exit: the process creation time comes from
+ * /proc/self/stat, and the optional LD_AUDIT module (narwhalyzer_audit.c)
+ * leaves timestamped loader events in a memory file.
+ */
+
+#define NARWHALYZER_STARTUP_FILE         "<startup>"
+#define NARWHALYZER_STARTUP_MAX_RECORDS  1024
+
+static int add_section_locked(narwhalyzer_registry_t *reg, const char *name,
+                              const char *file, int line);
+
+/* Where the end of startup was taken from, for the report */
+static const char *g_startup_main_source = NULL;
+
+/* Non-zero if the audit module provided loader events */
+static int g_startup_audited = 0;
+
+/* Start of the startup tree, 0 if startup sections are disabled */
+static uint64_t g_startup_start_ns = 0;
+
+/*
+ * Read the records left by the audit module, if it was loaded.
+ * Returns the number of records read.
+ */
+static int read_startup_records(narwhalyzer_startup_record_t *records, int max_records)
+{
+    static const char prefix[] = "/memfd:" NARWHALYZER_STARTUP_MEMFD_NAME;
+
+    DIR *dir = opendir("/proc/self/fd");
+    if (!dir) return 0;
+
+    int fd = -1;
+    struct dirent *ent;
+    while ((ent = readdir(dir)) != NULL) {
+        char target[256];
+        ssize_t n = readlinkat(dirfd(dir), ent->d_name, target, sizeof(target) - 1);
+        if (n <= 0) continue;
+        target[n] = '\0';
+
+        /* Target reads "/memfd:<name> (deleted)" */
+        if (strncmp(target, prefix, sizeof(prefix) - 1) == 0 &&
+            (target[sizeof(prefix) - 1] == ' ' || target[sizeof(prefix) - 1] == '\0')) {
+            fd = atoi(ent->d_name);
+            break;
+        }
+    }
+    closedir(dir);
+
+    if (fd < 0) return 0;
+
+    ssize_t bytes = pread(fd, records,
+                          (size_t)max_records * sizeof(narwhalyzer_startup_record_t), 0);
+    int count = bytes > 0 ? (int)(bytes / (ssize_t)sizeof(narwhalyzer_startup_record_t)) : 0;
+
+    /* Records are on CLOCK_MONOTONIC_RAW; move them to the runtime's clock */
+    if (g_clock_id != CLOCK_MONOTONIC_RAW && count > 0) {
+        struct timespec raw;
+        clock_gettime(CLOCK_MONOTONIC_RAW, &raw);
+        int64_t offset_ns = (int64_t)__narwhalyzer_get_timestamp_ns() -
+                            ((int64_t)raw.tv_sec * 1000000000LL + (int64_t)raw.tv_nsec);
+        for (int i = 0; i < count; i++) {
+            records[i].timestamp_ns = (uint64_t)((int64_t)records[i].timestamp_ns + offset_ns);
+        }
+    }
+    return count;
+}
+
+/*
+ * Add a section that ran once from start_ns to end_ns.
+ * Returns the section index, or -1 if the interval is empty.
+ */
+static int add_startup_section(narwhalyzer_registry_t *reg, const char *name,
+                               int parent, uint64_t start_ns, uint64_t end_ns)
+{
+    if (end_ns <= start_ns) return -1;
+
+    pthread_mutex_lock(&reg->mutex);
+    int idx = add_section_locked(reg, name, NARWHALYZER_STARTUP_FILE, 0);
+    pthread_mutex_unlock(&reg->mutex);
+    if (idx < 0) return -1;
+
+    uint64_t elapsed = end_ns - start_ns;
+    narwhalyzer_section_stats_t *s = &reg->sections[idx];
+    s->entry_count = 1;
+    s->cumulative_time_ns = elapsed;
+    s->min_time_ns = elapsed;
+    s->max_time_ns = elapsed;
+    s->steady_min_time_ns = elapsed;
+    s->steady_max_time_ns = elapsed;
+    s->parent_index = parent;
+    s->depth = parent >= 0 ? reg->sections[parent].depth + 1 : 0;
+    s->max_concurrency = 1;
+    s->concurrency_time_hist.buckets[1] = elapsed;
+    s->first_entry_ns = start_ns;
+    s->last_entry_ns = start_ns;
+
+    return idx;
+}
+
+/*
+ * Build the synthetic startup tree:
+ *
+ *   startup                   process creation -> main
+ *     startup:exec            process creation -> audit module loaded
+ *     startup:loading         mapping of the initial objects
+ *       load:<object>         mapping of one object
+ *     startup:relocation      relocation and constructors run before the runtime
+ *     startup:constructors    remaining constructors -> main
+ *
+ * Without the audit module, loading and relocation are a single
+ * "startup:loading" phase. Returns the start of the tree, 0 if none.
+ */
+static uint64_t build_startup_tree(narwhalyzer_registry_t *reg, int section_count)
+{
+    if (!reg->startup_enabled) return 0;
+
+    narwhalyzer_startup_record_t *records =
+        malloc(NARWHALYZER_STARTUP_MAX_RECORDS * sizeof(narwhalyzer_startup_record_t));
+    if (!records) return 0;
+    int record_count = read_startup_records(records, NARWHALYZER_STARTUP_MAX_RECORDS);
+
+    uint64_t audit_begin_ns = 0, consistent_ns = 0, preinit_ns = 0;
+    for (int i = 0; i < record_count; i++) {
+        switch (records[i].kind) {
+        case NARWHALYZER_STARTUP_AUDIT_BEGIN: audit_begin_ns = records[i].timestamp_ns; break;
+        case NARWHALYZER_STARTUP_CONSISTENT:  consistent_ns = records[i].timestamp_ns; break;
+        case NARWHALYZER_STARTUP_PREINIT:     preinit_ns = records[i].timestamp_ns; break;
+        default: break;
+        }
+    }
+
+    /* End of startup: explicit mark, then the loader, then the first section */
+    uint64_t init_ns = reg->program_start_time_ns;
+    uint64_t main_ns = __atomic_load_n(&reg->main_entry_ns, __ATOMIC_ACQUIRE);
+    g_startup_main_source = "main entry";
+    if (!main_ns && preinit_ns) {
+        main_ns = preinit_ns;
+        g_startup_main_source = "end of constructors (audit module)";
+    }
+    if (!main_ns) {
+        for (int i = 0; i < section_count; i++) {
+            uint64_t first = reg->sections[i].first_entry_ns;
+            if (first && (!main_ns || first < main_ns)) main_ns = first;
+        }
+        g_startup_main_source = "first section entry";
+    }
+    if (!main_ns || main_ns < init_ns) {
+        main_ns = init_ns;
+        g_startup_main_source = "runtime initialization";
+    }
+
+    uint64_t start_ns = reg->process_start_ns;
+    if (!start_ns || (audit_begin_ns && audit_begin_ns < start_ns)) {
+        start_ns = audit_begin_ns;
+    }
+    if (!start_ns || start_ns >= init_ns) {
+        free(records);
+        return 0;
+    }
+
+    int root = add_startup_section(reg, "startup", -1, start_ns, main_ns);
+
+    if (audit_begin_ns && consistent_ns) {
+        g_startup_audited = 1;
+        add_startup_section(reg, "startup:exec", root, start_ns, audit_begin_ns);
+        int loading = add_startup_section(reg, "startup:loading", root,
+                                          audit_begin_ns, consistent_ns);
+
+        /* An object is mapped between the previous event and its own */
+        uint64_t prev_ns = audit_begin_ns;
+        for (int i = 0; i < record_count && loading >= 0; i++) {
+            if (records[i].kind != NARWHALYZER_STARTUP_OBJECT_OPEN) continue;
+
+            char name[NARWHALYZER_STARTUP_NAME_SIZE + 8];
+            records[i].name[NARWHALYZER_STARTUP_NAME_SIZE - 1] = '\0';
+            snprintf(name, sizeof(name), "load:%s", records[i].name);
+            add_startup_section(reg, name, loading, prev_ns, records[i].timestamp_ns);
+            prev_ns = records[i].timestamp_ns;
+        }
+
+        add_startup_section(reg, "startup:relocation", root, consistent_ns, init_ns);
+    } else {
+        add_startup_section(reg, "startup:loading", root, start_ns, init_ns);
+    }
+
+    add_startup_section(reg, "startup:constructors", root, init_ns, main_ns);
+
+    free(records);
+    return start_ns;
+}
+
+/*
+ * Print where the startup boundaries were taken from.
+ */
+static void print_startup_view(uint64_t startup_start_ns)
+{
+    if (!startup_start_ns) return;
+
+    narwhalyzer_registry_t *reg = g_registry;
+
+    printf("\n═══ STARTUP ═══\n\n");
+    printf("  Start: %s\n", reg->process_start_ns == startup_start_ns
+           ? "process creation (/proc/self/stat, clock tick resolution)"
+           : "audit module loaded");
+    printf("  End:   %s\n", g_startup_main_source);
+    if (!g_startup_audited) {
+        printf("  Per-object load times need LD_AUDIT=libnarwhalyzer_audit.so\n");
+    }
+}
+
+/* ============================================================================
+ * Text Report
+ * ============================================================================ */
+
+static void print_report(uint64_t total_time_ns)
+{
+    int section_count = atomic_load(&g_registry->section_count);
     
     if (section_count == 0) {
         return; /* No sections instrumented */
     }
     
     print_flat_summary(section_count, total_time_ns);
+    print_startup_view(g_startup_start_ns);
+    print_warmup_summary(section_count);
     print_hierarchy_view(section_count);
+    print_recursion_view(section_count);
+    print_concurrency_view(section_count);
+    print_arrival_view(section_count);
+    print_step_view(section_count);
+    print_bench_view();
     print_section_details(section_count);
     
     printf("═══ END OF NARWHALYZER REPORT ═══\n\n");
 }
 
 /*
- * Register a new section.
+ * Built-in sink printing the report. It reads the registry directly and
+ * only needs the final snapshot's program time.
  */
-int __narwhalyzer_register_section(const char *name, const char *file, int line)
+static void report_snapshot(const narwhalyzer_snapshot_t *snap, void *user_data)
+{
+    (void)user_data;
+    if (snap->final) {
+        print_report(snap->elapsed_ns);
+    }
+}
+
+/* ============================================================================
+ * Public API Implementation
+ * ============================================================================ */
+
+/*
+ * Attach this copy of the runtime to the process-wide registry.
+ * The constructor and destructor below are static so that the dynamic
+ * linker cannot interpose them with another copy's definitions: every
+ * copy must attach and detach itself exactly once.
+ */
+static void runtime_init(void)
+{
+    int expected = 0;
+    if (!atomic_compare_exchange_strong(&g_initialized, &expected, 1)) {
+        return; /* Already initialized */
+    }
+    
+    g_registry = attach_registry();
+    g_clock_id = (clockid_t)g_registry->clock_id;
+    atomic_fetch_add(&g_registry->attached_copies, 1);
+}
+
+/*
+ * Detach this copy and print the report when the last copy detaches,
+ * so unloading a module does not truncate the report.
+ */
+static void runtime_fini(void)
 {
-    /* Ensure initialization */
     if (!atomic_load(&g_initialized)) {
-        __narwhalyzer_init();
+        return;
     }
     
-    pthread_mutex_lock(&g_registration_mutex);
+    int expected = 0;
+    if (!atomic_compare_exchange_strong(&g_detached, &expected, 1)) {
+        return; /* This copy already detached */
+    }
     
-    /* Check if section already registered (same name, file, line) */
-    int count = atomic_load(&g_section_count);
-    for (int i = 0; i < count; i++) {
-        if (g_sections[i].line == line && 
-            g_sections[i].file && file &&
-            strcmp(g_sections[i].file, file) == 0 &&
-            strcmp(g_sections[i].name, name) == 0) {
-            pthread_mutex_unlock(&g_registration_mutex);
-            return i;
-        }
+    narwhalyzer_registry_t *reg = g_registry;
+    if (atomic_fetch_sub(&reg->attached_copies, 1) > 1) {
+        return; /* Other copies are still loaded */
+    }
+    
+    expected = 0;
+    if (!atomic_compare_exchange_strong(&reg->report_printed, &expected, 1)) {
+        return; /* Report already printed */
     }
     
-    /* Allocate new section */
-    int idx = atomic_fetch_add(&g_section_count, 1);
-    if (idx >= NARWHALYZER_MAX_SECTIONS) {
-        atomic_fetch_sub(&g_section_count, 1);
-        pthread_mutex_unlock(&g_registration_mutex);
+    reg->program_end_time_ns = __narwhalyzer_get_timestamp_ns();
+    narwhalyzer_metrics_stop(reg);
+    
+    /* Startup sections extend the program back to process creation */
+    g_startup_start_ns = build_startup_tree(reg, atomic_load(&reg->section_count));
+    /* The exiting thread's state may belong to another copy's TLS */
+    narwhalyzer_trace_close(reg, pthread_getspecific(reg->thread_key));
+    uint64_t program_start_ns = g_startup_start_ns ? g_startup_start_ns
+                                                   : reg->program_start_time_ns;
+    uint64_t total_time_ns = reg->program_end_time_ns - program_start_ns;
+    narwhalyzer_profile_write(reg, total_time_ns);
+    
+    /* The text report is the first sink to get the final snapshot */
+    narwhalyzer_sinks_finish(reg, total_time_ns);
+}
+
+__attribute__((constructor(101)))
+static void runtime_constructor(void)
+{
+    runtime_init();
+    
+    /* Register atexit handler as backup */
+    atexit(runtime_fini);
+}
+
+__attribute__((destructor(101)))
+static void runtime_destructor(void)
+{
+    runtime_fini();
+}
+
+/*
+ * Initialize the runtime.
+ */
+void __narwhalyzer_init(void)
+{
+    runtime_init();
+}
+
+/*
+ * Check if initialized.
+ */
+int __narwhalyzer_is_initialized(void)
+{
+    return atomic_load(&g_initialized);
+}
+
+/*
+ * Finalize and print report.
+ */
+void __narwhalyzer_fini(void)
+{
+    runtime_fini();
+}
+
+/*
+ * Allocate and publish a new section.
+ * Caller must hold the registry mutex.
+ */
+static int add_section_locked(narwhalyzer_registry_t *reg, const char *name,
+                              const char *file, int line)
+{
+    int count = atomic_load(&reg->section_count);
+    if (count >= NARWHALYZER_MAX_SECTIONS) {
         fprintf(stderr, "narwhalyzer: warning: maximum section count exceeded\n");
         return -1;
     }
     
-    /* Initialize section */
-    narwhalyzer_section_stats_t *s = &g_sections[idx];
-    s->name = name;
-    s->file = file;
+    /* Initialize section before publishing it */
+    int idx = count;
+    narwhalyzer_section_stats_t *s = &reg->sections[idx];
+    s->name = arena_intern(reg, name);
+    s->file = arena_intern(reg, file);
     s->line = line;
     s->entry_count = 0;
     s->cumulative_time_ns = 0;
     s->min_time_ns = UINT64_MAX;
     s->max_time_ns = 0;
+    memset(&s->duration_hist, 0, sizeof(s->duration_hist));
     s->parent_index = -1;
     s->depth = 0;
+    s->recursive_entry_count = 0;
+    s->max_recursion_depth = 0;
+    memset(&s->recursion_depth_hist, 0, sizeof(s->recursion_depth_hist));
+    s->occupancy_state = 0;
+    s->max_concurrency = 0;
+    memset(&s->concurrency_time_hist, 0, sizeof(s->concurrency_time_hist));
+    s->first_entry_ns = 0;
+    s->last_entry_ns = 0;
+    memset(&s->interarrival_hist, 0, sizeof(s->interarrival_hist));
+    s->warmup_entry_count = 0;
+    s->warmup_time_ns = 0;
+    s->warmup_min_time_ns = UINT64_MAX;
+    s->warmup_max_time_ns = 0;
+    s->steady_min_time_ns = UINT64_MAX;
+    s->steady_max_time_ns = 0;
+    
+    if (!s->name) {
+        fprintf(stderr, "narwhalyzer: warning: cannot allocate section name\n");
+        return -1;
+    }
     
-    pthread_mutex_unlock(&g_registration_mutex);
+    atomic_store(&reg->section_count, idx + 1);
     
     return idx;
 }
 
+/*
+ * Mark the entry of main, ending the startup phase.
+ * Only the first call counts.
+ */
+void __narwhalyzer_mark_main(void)
+{
+    if (!atomic_load(&g_initialized)) {
+        runtime_init();
+    }
+    
+    uint64_t expected = 0;
+    __atomic_compare_exchange_n(&g_registry->main_entry_ns, &expected,
+                                __narwhalyzer_get_timestamp_ns(), 0,
+                                __ATOMIC_RELEASE, __ATOMIC_RELAXED);
+}
+
+/*
+ * Close one iteration of the caller's outer loop.
+ * The time each section accumulated since the previous call is added to
+ * the current window of the step time series.
+ */
+void narwhalyzer_step(uint64_t step)
+{
+    if (!atomic_load(&g_initialized)) {
+        runtime_init();
+    }
+    
+    narwhalyzer_registry_t *reg = g_registry;
+    uint64_t now = __narwhalyzer_get_timestamp_ns();
+    
+    pthread_mutex_lock(&reg->mutex);
+    
+    narwhalyzer_step_series_t *series = reg->steps;
+    if (!series) {
+        series = calloc(1, sizeof(narwhalyzer_step_series_t));
+        if (!series) {
+            pthread_mutex_unlock(&reg->mutex);
+            return;
+        }
+        series->steps_per_window = 1;
+        series->last_step_ns = reg->program_start_time_ns;
+        reg->steps = series;
+    }
+    
+    int section_count = atomic_load(&reg->section_count);
+    
+    /* Open a new window when the current one is full */
+    int w = series->window_count - 1;
+    if (w < 0 || series->windows[w].steps >= series->steps_per_window) {
+        if (series->window_count == NARWHALYZER_STEP_WINDOWS) {
+            merge_step_windows(series, section_count);
+        }
+        w = series->window_count++;
+        memset(&series->windows[w], 0, sizeof(series->windows[w]));
+        memset(series->time_ns[w], 0, sizeof(series->time_ns[w]));
+        memset(series->calls[w], 0, sizeof(series->calls[w]));
+        series->windows[w].first_step = step;
+    }
+    
+    /* Time is credited to the step in which an activation exits */
+    for (int i = 0; i < section_count; i++) {
+        narwhalyzer_section_stats_t *s = &reg->sections[i];
+        uint64_t time_ns = __atomic_load_n(&s->cumulative_time_ns, __ATOMIC_RELAXED);
+        uint64_t calls = __atomic_load_n(&s->entry_count, __ATOMIC_RELAXED) -
+                         __atomic_load_n(&s->recursive_entry_count, __ATOMIC_RELAXED);
+        series->time_ns[w][i] += time_ns - series->prev_time_ns[i];
+        series->calls[w][i] += calls - series->prev_calls[i];
+        series->prev_time_ns[i] = time_ns;
+        series->prev_calls[i] = calls;
+    }
+    
+    series->windows[w].last_step = step;
+    series->windows[w].steps++;
+    series->windows[w].wall_ns += now - series->last_step_ns;
+    series->last_step_ns = now;
+    
+    pthread_mutex_unlock(&reg->mutex);
+}
+
+/*
+ * Register a new section.
+ */
+int __narwhalyzer_register_section(const char *name, const char *file, int line)
+{
+    /* Ensure initialization */
+    if (!atomic_load(&g_initialized)) {
+        runtime_init();
+    }
+    
+    narwhalyzer_registry_t *reg = g_registry;
+    pthread_mutex_lock(&reg->mutex);
+    
+    /* Check if section already registered (same name, file, line) */
+    int count = atomic_load(&reg->section_count);
+    for (int i = 0; i < count; i++) {
+        if (reg->sections[i].line == line && 
+            reg->sections[i].file && file &&
+            strcmp(reg->sections[i].file, file) == 0 &&
+            strcmp(reg->sections[i].name, name) == 0) {
+            pthread_mutex_unlock(&reg->mutex);
+            return i;
+        }
+    }
+    
+    int idx = add_section_locked(reg, name, file, line);
+    
+    pthread_mutex_unlock(&reg->mutex);
+    
+    return idx;
+}
+
+/*
+ * Probe the dynamic name table without locking.
+ * Slots only ever go from empty to a fully initialized section.
+ */
+static int find_dynamic_section(narwhalyzer_registry_t *reg, const char *name,
+                                uint32_t hash)
+{
+    for (uint32_t i = 0; i < NARWHALYZER_NAME_TABLE_SIZE; i++) {
+        uint32_t slot = (hash + i) & (NARWHALYZER_NAME_TABLE_SIZE - 1);
+        int entry = atomic_load_explicit(&reg->name_table[slot], memory_order_acquire);
+        if (entry == 0) {
+            return -1;
+        }
+        
+        int idx = entry - 1;
+        if (reg->name_hash[idx] == hash && strcmp(reg->sections[idx].name, name) == 0) {
+            return idx;
+        }
+    }
+    return -1;
+}
+
+/*
+ * Find or register the section for a runtime-provided name.
+ */
+static int lookup_dynamic_section(narwhalyzer_registry_t *reg, const char *name,
+                                  uint32_t hash)
+{
+    int idx = find_dynamic_section(reg, name, hash);
+    if (idx >= 0) {
+        return idx;
+    }
+    
+    pthread_mutex_lock(&reg->mutex);
+    
+    /* Another thread may have inserted the name meanwhile */
+    idx = find_dynamic_section(reg, name, hash);
+    if (idx < 0) {
+        idx = add_section_locked(reg, name, NARWHALYZER_DYNAMIC_FILE, 0);
+        if (idx >= 0) {
+            reg->name_hash[idx] = hash;
+            for (uint32_t i = 0; i < NARWHALYZER_NAME_TABLE_SIZE; i++) {
+                uint32_t slot = (hash + i) & (NARWHALYZER_NAME_TABLE_SIZE - 1);
+                if (atomic_load_explicit(&reg->name_table[slot], memory_order_relaxed) == 0) {
+                    atomic_store_explicit(&reg->name_table[slot], idx + 1, 
+                                          memory_order_release);
+                    break;
+                }
+            }
+        }
+    }
+    
+    pthread_mutex_unlock(&reg->mutex);
+    
+    return idx;
+}
+
+int narwhalyzer_name_section(const char *name)
+{
+    return lookup_dynamic_section(g_registry, name, hash_name(name));
+}
+
+/*
+ * Enter a section identified by a runtime string.
+ */
+int narwhalyzer_enter_name(const char *name)
+{
+    if (!name) {
+        return -1;
+    }
+    
+    if (!atomic_load(&g_initialized)) {
+        runtime_init();
+    }
+    
+    narwhalyzer_thread_state_t *ts = get_thread_state();
+    if (!ts) {
+        return -1;
+    }
+    
+    uint32_t hash = hash_name(name);
+    narwhalyzer_name_cache_entry_t *entry = 
+        &ts->name_cache[hash & (NARWHALYZER_NAME_CACHE_SIZE - 1)];
+    
+    /* Fast path: recently used name, no lock and no shared table access */
+    if (entry->name && entry->hash == hash && 
+        (entry->name == name || strcmp(entry->name, name) == 0)) {
+        return __narwhalyzer_section_enter(entry->section_index);
+    }
+    
+    int idx = lookup_dynamic_section(g_registry, name, hash);
+    if (idx < 0) {
+        return -1;
+    }
+    
+    entry->name = g_registry->sections[idx].name;
+    entry->hash = hash;
+    entry->section_index = idx;
+    
+    return __narwhalyzer_section_enter(idx);
+}
+
 /*
  * Record section entry.
  */
 int __narwhalyzer_section_enter(int section_index)
 {
-    if (section_index < 0 || section_index >= atomic_load(&g_section_count)) {
+    narwhalyzer_registry_t *reg = g_registry;
+    if (!reg || section_index < 0 || 
+        section_index >= atomic_load(&reg->section_count)) {
         return -1;
     }
     
-    /* Push context onto stack */
-    int ctx_idx = ++g_context_stack_top;
-    if (ctx_idx >= NARWHALYZER_MAX_NESTING_DEPTH) {
-        g_context_stack_top--;
-        fprintf(stderr, "narwhalyzer: warning: maximum nesting depth exceeded\n");
+    narwhalyzer_thread_state_t *ts = get_thread_state();
+    if (!ts) {
         return -1;
     }
     
-    narwhalyzer_context_t *ctx = &g_context_stack[ctx_idx];
+    /* Push context onto stack */
+    int ctx_idx = ts->context_stack_top + 1;
+    if (__builtin_expect(ctx_idx >= ts->context_capacity, 0)) {
+        if (grow_context_stack(ts) != 0) {
+            report_nesting_overflow();
+            return -1;
+        }
+    }
+    ts->context_stack_top = ctx_idx;
+    
+    narwhalyzer_context_t *ctx = context_at(ts, ctx_idx);
     ctx->section_index = section_index;
     ctx->start_time_ns = __narwhalyzer_get_timestamp_ns();
     ctx->parent_context_index = ctx_idx > 0 ? ctx_idx - 1 : -1;
+    ctx->cct_node = ts->cct ? narwhalyzer_cct_enter(ts, ctx_idx, section_index) : -1;
     
     /* Update section stats */
-    narwhalyzer_section_stats_t *s = &g_sections[section_index];
+    narwhalyzer_section_stats_t *s = &reg->sections[section_index];
     __atomic_fetch_add(&s->entry_count, 1, __ATOMIC_RELAXED);
+    narwhalyzer_trace_record(ts, ctx->start_time_ns, section_index, NARWHALYZER_TRACE_ENTER);
+    
+    /* Track recursion: only the outermost activation accumulates time */
+    narwhalyzer_thread_section_t *tsec = &ts->sections[section_index];
+    uint32_t recursion_depth = ++tsec->active_depth;
+    ctx->recursion_depth = (int)recursion_depth;
+    ctx->warmup = 0;
+    if (__builtin_expect(recursion_depth > 1, 0)) {
+        __atomic_fetch_add(&s->recursive_entry_count, 1, __ATOMIC_RELAXED);
+        histogram_record(&s->recursion_depth_hist, recursion_depth);
+        update_max(&s->max_recursion_depth, recursion_depth);
+        return ctx_idx;
+    }
+    
+    /* Occupancy is a CAS on a word shared by all threads, so it is opt-in */
+    if (reg->occupancy_enabled) {
+        update_occupancy(s, ctx->start_time_ns, +1);
+    }
+    
+    /* First entry, checked once per thread (startup profiling needs it) */
+    if (tsec->last_entry_ns == 0 && s->first_entry_ns == 0) {
+        uint64_t unset = 0;
+        __atomic_compare_exchange_n(&s->first_entry_ns, &unset, ctx->start_time_ns,
+                                    0, __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+    }
     
+    /* Arrival pattern: writes shared by all threads, so opt-in */
+    if (reg->arrivals_enabled) {
+        if (tsec->last_entry_ns != 0) {
+            histogram_record(&s->interarrival_hist, ctx->start_time_ns - tsec->last_entry_ns);
+        }
+        __atomic_store_n(&s->last_entry_ns, ctx->start_time_ns, __ATOMIC_RELAXED);
+    }
+    tsec->last_entry_ns = ctx->start_time_ns;
+    
+    /* Warm-up: first N calls per thread, or first T ms of the thread */
+    if (reg->warmup_calls || reg->warmup_ns) {
+        ctx->warmup = tsec->outer_calls++ < reg->warmup_calls ||
+                      (reg->warmup_ns && ctx->start_time_ns - ts->start_time_ns < reg->warmup_ns);
+    }
     /* Record parent relationship (first time only) */
     if (s->parent_index == -1 && ctx_idx > 0) {
-        int parent_section = g_context_stack[ctx_idx - 1].section_index;
-        s->parent_index = parent_section;
+        int parent_section = context_at(ts, ctx_idx - 1)->section_index;
+        if (parent_section != section_index) {
+            s->parent_index = parent_section;
+        }
     }
     s->depth = ctx_idx;
     
@@ -467,18 +1948,50 @@ int __narwhalyzer_section_enter(int section_index)
  */
 void __narwhalyzer_section_exit(int context_index)
 {
-    if (context_index < 0 || context_index > g_context_stack_top) {
+    narwhalyzer_thread_state_t *ts = t_thread_state;
+    if (!ts) {
+        ts = get_thread_state();
+        if (!ts) return;
+    }
+    
+    if (context_index < 0 || context_index > ts->context_stack_top) {
         return;
     }
     
     uint64_t end_time_ns = __narwhalyzer_get_timestamp_ns();
     
-    narwhalyzer_context_t *ctx = &g_context_stack[context_index];
+    narwhalyzer_context_t *ctx = context_at(ts, context_index);
     uint64_t elapsed_ns = end_time_ns - ctx->start_time_ns;
     
+    /* Pop context from stack */
+    if (context_index == ts->context_stack_top) {
+        ts->context_stack_top--;
+    }
+    narwhalyzer_trace_record(ts, end_time_ns, ctx->section_index, NARWHALYZER_TRACE_EXIT);
+    
+    if (ctx->cct_node > 0) {
+        narwhalyzer_cct_node_t *node = cct_node_at(ts->cct, ctx->cct_node);
+        node->count++;
+        node->inclusive_ns += elapsed_ns;
+    }
+    
+    narwhalyzer_thread_section_t *tsec = &ts->sections[ctx->section_index];
+    if (tsec->active_depth > 0) {
+        tsec->active_depth--;
+    }
+    
+    /* Nested activations are already covered by the outermost one */
+    if (ctx->recursion_depth > 1) {
+        return;
+    }
+    
     /* Update section statistics */
-    narwhalyzer_section_stats_t *s = &g_sections[ctx->section_index];
+    narwhalyzer_section_stats_t *s = &g_registry->sections[ctx->section_index];
     __atomic_fetch_add(&s->cumulative_time_ns, elapsed_ns, __ATOMIC_RELAXED);
+    histogram_record(&s->duration_hist, elapsed_ns);
+    if (g_registry->occupancy_enabled) {
+        update_occupancy(s, end_time_ns, -1);
+    }
     
     /* Update min (using compare-and-swap) */
     uint64_t old_min = s->min_time_ns;
@@ -498,9 +2011,18 @@ void __narwhalyzer_section_exit(int context_index)
         }
     }
     
-    /* Pop context from stack */
-    if (context_index == g_context_stack_top) {
-        g_context_stack_top--;
+    /* Warm-up vs steady-state split, only when a warm-up is configured */
+    if (!g_registry->warmup_calls && !g_registry->warmup_ns) {
+        return;
+    }
+    if (ctx->warmup) {
+        __atomic_fetch_add(&s->warmup_entry_count, 1, __ATOMIC_RELAXED);
+        __atomic_fetch_add(&s->warmup_time_ns, elapsed_ns, __ATOMIC_RELAXED);
+        update_min(&s->warmup_min_time_ns, elapsed_ns);
+        update_max(&s->warmup_max_time_ns, elapsed_ns);
+    } else {
+        update_min(&s->steady_min_time_ns, elapsed_ns);
+        update_max(&s->steady_max_time_ns, elapsed_ns);
     }
 }
 
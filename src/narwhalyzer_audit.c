@@ -0,0 +1,92 @@
+/*
+ * narwhalyzer_audit.c
+ *
+ * Optional rtld-audit module for the Narwhalyzer startup profiler.
+ * Loaded with LD_AUDIT, it timestamps the dynamic loader's progress
+ * (object mapping, link map consistency, end of constructors) before the
+ * runtime library itself is initialized.
+ *
+ * Usage:
+ *   NARWHALYZER_STARTUP=1 LD_AUDIT=/path/to/libnarwhalyzer_audit.so ./program
+ *
+ * Copyright (c) 2026
+ * Licensed under GPL-3.0 License
+ */
+
+#define _GNU_SOURCE
+#include "narwhalyzer_startup.h"
+
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <link.h>
+#include <sys/mman.h>
+
+/* Memory file receiving the records, -1 if unavailable */
+static int g_fd = -1;
+
+/* Set once the initial link map is consistent */
+static int g_loaded = 0;
+
+/*
+ * Append one record. Audit callbacks are serialized by the loader lock.
+ */
+static void append_record(uint32_t kind, const char *name)
+{
+    if (g_fd < 0) {
+        return;
+    }
+
+    narwhalyzer_startup_record_t rec;
+    memset(&rec, 0, sizeof(rec));
+
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
+    rec.timestamp_ns = (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+    rec.kind = kind;
+
+    if (name) {
+        /* Keep the file name only */
+        const char *base = strrchr(name, '/');
+        base = base ? base + 1 : name;
+        strncpy(rec.name, base[0] ? base : "<main program>", sizeof(rec.name) - 1);
+    }
+
+    if (write(g_fd, &rec, sizeof(rec)) != (ssize_t)sizeof(rec)) {
+        close(g_fd);
+        g_fd = -1;
+    }
+}
+
+unsigned int la_version(unsigned int version)
+{
+    g_fd = memfd_create(NARWHALYZER_STARTUP_MEMFD_NAME, MFD_CLOEXEC);
+    append_record(NARWHALYZER_STARTUP_AUDIT_BEGIN, NULL);
+
+    return version < LAV_CURRENT ? version : LAV_CURRENT;
+}
+
+unsigned int la_objopen(struct link_map *map, Lmid_t lmid,
+                        uintptr_t *cookie __attribute__((unused)))
+{
+    /* Only objects of the initial namespace are part of startup */
+    if (!g_loaded && lmid == LM_ID_BASE) {
+        append_record(NARWHALYZER_STARTUP_OBJECT_OPEN, map->l_name);
+    }
+
+    /* No symbol binding callbacks: they would slow down every call */
+    return 0;
+}
+
+void la_activity(uintptr_t *cookie __attribute__((unused)), unsigned int flag)
+{
+    if (!g_loaded && flag == LA_ACT_CONSISTENT) {
+        g_loaded = 1;
+        append_record(NARWHALYZER_STARTUP_CONSISTENT, NULL);
+    }
+}
+
+void la_preinit(uintptr_t *cookie __attribute__((unused)))
+{
+    append_record(NARWHALYZER_STARTUP_PREINIT, NULL);
+}
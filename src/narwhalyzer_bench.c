@@ -0,0 +1,333 @@
+/*
+ * narwhalyzer_bench.c
+ *
+ * Benchmark harness. narwhalyzer_bench_run() times each call of a
+ * workload inside a section named after the benchmark, in two phases:
+ *
+ * 1. Warm-up: iterations are grouped in batches of 5, and as the series
+ *    of batch means grows by a quarter the MSER-5 rule picks the truncation
+ *    point that minimizes the standard error of the remaining batch means.
+ *    Once that point lies in the first half of the series, the transient
+ *    (cold caches, page faults, frequency ramp-up, lazy binding) is over.
+ * 2. Measurement: the section totals are snapshotted and iterations run
+ *    until the 95% confidence interval of the mean (Student t) or of the
+ *    median (order statistics) is within the target relative half-width.
+ *
+ * The difference between the section totals at the end and at the
+ * snapshot gives the time and calls of every nested section per measured
+ * iteration, which the report prints with the benchmark.
+ *
+ * Copyright (c) 2026
+ * Licensed under GPL-3.0 License
+ */
+
+#define _GNU_SOURCE
+#include "narwhalyzer_internal.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#define NARWHALYZER_BENCH_DEFAULT_CI         0.01
+#define NARWHALYZER_BENCH_DEFAULT_MIN        10
+#define NARWHALYZER_BENCH_DEFAULT_MAX        1000000
+#define NARWHALYZER_BENCH_DEFAULT_MS         10000
+
+/* MSER batch size, and batches needed before the rule is trusted */
+#define NARWHALYZER_BENCH_BATCH              5
+#define NARWHALYZER_BENCH_MIN_BATCHES        10
+
+/* Two-sided 95% normal quantile */
+#define NARWHALYZER_BENCH_Z95                1.959963984540054
+
+typedef struct bench_samples {
+    uint64_t *values;
+    uint64_t count;
+    uint64_t capacity;
+} bench_samples_t;
+
+typedef struct bench_means {
+    double *values;
+    uint64_t count;
+    uint64_t capacity;
+} bench_means_t;
+
+static int samples_push(bench_samples_t *samples, uint64_t value)
+{
+    if (samples->count == samples->capacity) {
+        uint64_t capacity = samples->capacity ? 2 * samples->capacity : 1024;
+        uint64_t *values = realloc(samples->values, capacity * sizeof(uint64_t));
+        if (!values) return -1;
+        samples->values = values;
+        samples->capacity = capacity;
+    }
+    samples->values[samples->count++] = value;
+    return 0;
+}
+
+static int means_push(bench_means_t *means, double value)
+{
+    if (means->count == means->capacity) {
+        uint64_t capacity = means->capacity ? 2 * means->capacity : 256;
+        double *values = realloc(means->values, capacity * sizeof(double));
+        if (!values) return -1;
+        means->values = values;
+        means->capacity = capacity;
+    }
+    means->values[means->count++] = value;
+    return 0;
+}
+
+static int compare_u64(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
+
+/* ============================================================================
+ * Statistics
+ * ============================================================================ */
+
+/*
+ * MSER-5: truncation point, in batches, minimizing the squared standard
+ * error of the mean of the batches that remain.
+ */
+static uint64_t mser_truncation(const double *means, uint64_t batches)
+{
+    /* Suffix sums, walking the truncation point from the end */
+    uint64_t best = 0;
+    double best_score = 0.0, sum = 0.0, sum_sq = 0.0;
+    for (uint64_t d = batches; d-- > 0;) {
+        sum += means[d];
+        sum_sq += means[d] * means[d];
+        double n = batches - d;
+        if (n < 2) continue;
+        double score = (sum_sq - sum * sum / n) / (n * n);
+        if (d + 2 == batches || score <= best_score) {
+            best = d;
+            best_score = score;
+        }
+    }
+    return best;
+}
+
+/* Two-sided 95% Student t quantile (Cornish-Fisher expansion) */
+static double t95(double df)
+{
+    double z = NARWHALYZER_BENCH_Z95;
+    double z3 = z * z * z, z5 = z3 * z * z;
+    return z + (z3 + z) / (4.0 * df) + (5.0 * z5 + 16.0 * z3 + 3.0 * z) / (96.0 * df * df);
+}
+
+/*
+ * Fill in the result from the measured samples, sorting them into sorted
+ * for the median. Returns the relative CI half-width of the statistic the
+ * benchmark stops on.
+ */
+static double summarize(const bench_samples_t *samples, uint64_t *sorted, int use_median,
+                        narwhalyzer_bench_result_t *r)
+{
+    uint64_t n = samples->count;
+    r->iterations = n;
+    if (n == 0) return HUGE_VAL;
+
+    double sum = 0.0;
+    r->min_ns = UINT64_MAX;
+    r->max_ns = 0;
+    for (uint64_t i = 0; i < n; i++) {
+        uint64_t v = samples->values[i];
+        sum += (double)v;
+        if (v < r->min_ns) r->min_ns = v;
+        if (v > r->max_ns) r->max_ns = v;
+    }
+    r->mean_ns = sum / (double)n;
+
+    double ss = 0.0;
+    for (uint64_t i = 0; i < n; i++) {
+        double d = (double)samples->values[i] - r->mean_ns;
+        ss += d * d;
+    }
+    r->stddev_ns = n > 1 ? sqrt(ss / (double)(n - 1)) : 0.0;
+    r->mean_ci_ns = n > 1 ? t95((double)(n - 1)) * r->stddev_ns / sqrt((double)n) : HUGE_VAL;
+
+    memcpy(sorted, samples->values, n * sizeof(uint64_t));
+    qsort(sorted, n, sizeof(uint64_t), compare_u64);
+    r->median_ns = n % 2 ? (double)sorted[n / 2]
+                         : ((double)sorted[n / 2 - 1] + (double)sorted[n / 2]) / 2.0;
+
+    /* Order statistics n/2 -+ z*sqrt(n)/2 bound the median with 95% confidence */
+    double spread = NARWHALYZER_BENCH_Z95 * sqrt((double)n) / 2.0;
+    double lo = floor((double)n / 2.0 - spread);
+    double hi = ceil((double)n / 2.0 + spread);
+    r->median_low_ns = (double)sorted[lo > 0.0 ? (uint64_t)lo : 0];
+    r->median_high_ns = (double)sorted[hi < (double)(n - 1) ? (uint64_t)hi : n - 1];
+
+    if (use_median) {
+        return r->median_ns > 0.0
+            ? (r->median_high_ns - r->median_low_ns) / 2.0 / r->median_ns : HUGE_VAL;
+    }
+    return r->mean_ns > 0.0 ? r->mean_ci_ns / r->mean_ns : HUGE_VAL;
+}
+
+/* ============================================================================
+ * Harness
+ * ============================================================================ */
+
+/* Outermost calls and time of every section so far */
+static void read_totals(narwhalyzer_registry_t *reg, int count, uint64_t *time_ns,
+                        uint64_t *calls)
+{
+    for (int i = 0; i < count; i++) {
+        narwhalyzer_section_stats_t *s = &reg->sections[i];
+        time_ns[i] = __atomic_load_n(&s->cumulative_time_ns, __ATOMIC_RELAXED);
+        calls[i] = __atomic_load_n(&s->entry_count, __ATOMIC_RELAXED) -
+                   __atomic_load_n(&s->recursive_entry_count, __ATOMIC_RELAXED);
+    }
+}
+
+/* Run and time one iteration inside the benchmark's section */
+static uint64_t run_iteration(int section, void (*fn)(void *ctx), void *ctx)
+{
+    int context = __narwhalyzer_section_enter(section);
+    uint64_t start_ns = __narwhalyzer_get_timestamp_ns();
+    fn(ctx);
+    uint64_t end_ns = __narwhalyzer_get_timestamp_ns();
+    __narwhalyzer_section_exit(context);
+    return end_ns - start_ns;
+}
+
+int narwhalyzer_bench_run_config(const char *name, void (*fn)(void *ctx), void *ctx,
+                                 const narwhalyzer_bench_config_t *config,
+                                 narwhalyzer_bench_result_t *result)
+{
+    if (!name || !fn) {
+        return -1;
+    }
+    if (!__narwhalyzer_is_initialized()) {
+        __narwhalyzer_init();
+    }
+    narwhalyzer_registry_t *reg = g_registry;
+
+    narwhalyzer_bench_config_t cfg = { 0 };
+    if (config) cfg = *config;
+    if (cfg.target_ci <= 0.0) cfg.target_ci = NARWHALYZER_BENCH_DEFAULT_CI;
+    if (!cfg.min_iterations) cfg.min_iterations = NARWHALYZER_BENCH_DEFAULT_MIN;
+    if (!cfg.max_iterations) cfg.max_iterations = NARWHALYZER_BENCH_DEFAULT_MAX;
+    if (!cfg.max_time_ms) cfg.max_time_ms = NARWHALYZER_BENCH_DEFAULT_MS;
+    if (cfg.min_iterations < 2) cfg.min_iterations = 2;
+
+    int section = narwhalyzer_name_section(name);
+    narwhalyzer_bench_t *bench = calloc(1, sizeof(narwhalyzer_bench_t));
+    if (section < 0 || !bench) {
+        free(bench);
+        return -1;
+    }
+    bench->section_index = section;
+    bench->target_ci = cfg.target_ci;
+    bench->use_median = cfg.use_median;
+    narwhalyzer_bench_result_t *r = &bench->result;
+
+    uint64_t deadline_ns = __narwhalyzer_get_timestamp_ns() + cfg.max_time_ms * 1000000ULL;
+    uint64_t budget = cfg.max_iterations;
+    bench_samples_t samples = { 0 };
+
+    /*
+     * Warm-up: at most half the budget, so measurement always gets a
+     * share. Only batch means are kept, and MSER runs each time their
+     * number grows by a quarter, so warm-up stays linear in its length.
+     */
+    uint64_t warmup_deadline_ns = deadline_ns - cfg.max_time_ms * 500000ULL;
+    bench_means_t means = { 0 };
+    uint64_t next_mser = NARWHALYZER_BENCH_MIN_BATCHES;
+    while (r->warmup_iterations < budget / 2 &&
+           __narwhalyzer_get_timestamp_ns() < warmup_deadline_ns) {
+        double sum = 0.0;
+        for (int i = 0; i < NARWHALYZER_BENCH_BATCH; i++) {
+            sum += (double)run_iteration(section, fn, ctx);
+        }
+        r->warmup_iterations += NARWHALYZER_BENCH_BATCH;
+        if (means_push(&means, sum / NARWHALYZER_BENCH_BATCH) != 0) break;
+        if (means.count < next_mser) continue;
+
+        next_mser = means.count + means.count / 4 + 1;
+        if (mser_truncation(means.values, means.count) < means.count / 2) {
+            r->steady = 1;
+            break;
+        }
+    }
+    free(means.values);
+
+    /* Measurement, starting from fresh section totals */
+    int start_count = atomic_load(&reg->section_count);
+    uint64_t *start_time = calloc(NARWHALYZER_MAX_SECTIONS, sizeof(uint64_t));
+    uint64_t *start_calls = calloc(NARWHALYZER_MAX_SECTIONS, sizeof(uint64_t));
+    if (!start_time || !start_calls) {
+        free(start_time);
+        free(start_calls);
+        free(samples.values);
+        free(bench);
+        return -1;
+    }
+    read_totals(reg, start_count, start_time, start_calls);
+
+    uint64_t *sorted = NULL;
+    uint64_t next_check = cfg.min_iterations;
+    while (r->warmup_iterations + samples.count < budget &&
+           __narwhalyzer_get_timestamp_ns() < deadline_ns) {
+        if (samples_push(&samples, run_iteration(section, fn, ctx)) != 0) break;
+        if (samples.count < next_check) continue;
+
+        /* Check about every 10% of growth so sorting stays cheap */
+        next_check = samples.count + samples.count / 10 + 1;
+        uint64_t *grown = realloc(sorted, samples.capacity * sizeof(uint64_t));
+        if (!grown) break;
+        sorted = grown;
+        if (summarize(&samples, sorted, cfg.use_median, r) <= cfg.target_ci) {
+            r->converged = 1;
+            break;
+        }
+    }
+    if (!r->converged && samples.count > 0) {
+        uint64_t *grown = realloc(sorted, samples.capacity * sizeof(uint64_t));
+        if (grown) {
+            sorted = grown;
+            summarize(&samples, sorted, cfg.use_median, r);
+        }
+    }
+
+    /* Per-section time and calls over the measured iterations */
+    int end_count = atomic_load(&reg->section_count);
+    bench->section_count = end_count;
+    bench->time_ns = calloc((size_t)end_count, sizeof(uint64_t));
+    bench->calls = calloc((size_t)end_count, sizeof(uint64_t));
+    if (bench->time_ns && bench->calls) {
+        read_totals(reg, end_count, bench->time_ns, bench->calls);
+        for (int i = 0; i < start_count; i++) {
+            bench->time_ns[i] -= start_time[i];
+            bench->calls[i] -= start_calls[i];
+        }
+    } else {
+        bench->section_count = 0;
+    }
+
+    free(start_time);
+    free(start_calls);
+    free(sorted);
+    free(samples.values);
+
+    if (result) *result = *r;
+
+    /* Keep completion order for the report */
+    pthread_mutex_lock(&reg->mutex);
+    narwhalyzer_bench_t **tail = &reg->benches;
+    while (*tail) tail = &(*tail)->next;
+    *tail = bench;
+    pthread_mutex_unlock(&reg->mutex);
+    return 0;
+}
+
+int narwhalyzer_bench_run(const char *name, void (*fn)(void *ctx), void *ctx)
+{
+    return narwhalyzer_bench_run_config(name, fn, ctx, NULL, NULL);
+}
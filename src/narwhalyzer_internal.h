@@ -0,0 +1,375 @@
+/*
+ * narwhalyzer_internal.h
+ *
+ * Internal data structures shared by the translation units of the
+ * Narwhalyzer runtime. Not installed; layout changes must bump
+ * NARWHALYZER_REGISTRY_ABI_VERSION.
+ *
+ * Copyright (c) 2026
+ * Licensed under GPL-3.0 License
+ */
+
+#ifndef NARWHALYZER_INTERNAL_H
+#define NARWHALYZER_INTERNAL_H
+
+#include "narwhalyzer.h"
+#include "narwhalyzer_trace_format.h"
+
+#include <stdatomic.h>
+#include <pthread.h>
+
+/*
+ * Internal symbols stay local to each copy of the runtime, so that copies
+ * embedded in different shared objects never bind to each other.
+ */
+#define NARWHALYZER_HIDDEN __attribute__((visibility("hidden")))
+
+/* ============================================================================
+ * Process-Wide Registry
+ * ============================================================================
+ *
+ * Several shared objects may each link their own copy of libnarwhalyzer.a,
+ * and modules may be dlopen'd and dlclose'd at any time. All copies must
+ * agree on a single set of sections, otherwise each copy prints a partial
+ * report. The first copy to initialize allocates the registry on the heap
+ * and publishes it through the exported __narwhalyzer_registry_hook symbol;
+ * later copies locate an existing hook by walking the loaded objects.
+ *
+ * Section names and file names are copied into a string arena owned by the
+ * registry so that they stay valid after the module that registered them
+ * has been unloaded.
+ */
+
+#define NARWHALYZER_REGISTRY_MAGIC       0x4e57484cu  /* "NWHL" */
+#define NARWHALYZER_REGISTRY_ABI_VERSION 17
+#define NARWHALYZER_ARENA_CHUNK_SIZE     16384
+
+/* Open-addressing table of dynamic section names (power of two) */
+#define NARWHALYZER_NAME_TABLE_SIZE      (2 * NARWHALYZER_MAX_SECTIONS)
+
+/* Direct-mapped per-thread cache of recent dynamic name lookups */
+#define NARWHALYZER_NAME_CACHE_SIZE      64
+
+/* Pseudo file name for sections created by narwhalyzer_enter_name() */
+#define NARWHALYZER_DYNAMIC_FILE         "<dynamic>"
+
+typedef struct narwhalyzer_arena_chunk {
+    struct narwhalyzer_arena_chunk *next;
+    size_t used;
+    size_t capacity;
+    char data[];
+} narwhalyzer_arena_chunk_t;
+
+/*
+ * Per-thread runtime state.
+ * Owned by the registry through a pthread key so that every copy of the
+ * runtime sees the same context stack for a given thread.
+ */
+typedef struct narwhalyzer_name_cache_entry {
+    const char *name;                   /* Interned name, NULL if empty */
+    uint32_t hash;
+    int section_index;
+} narwhalyzer_name_cache_entry_t;
+
+/* Per-thread state of one section */
+typedef struct narwhalyzer_thread_section {
+    uint32_t active_depth;              /* Open activations on this thread */
+    uint32_t outer_calls;               /* Outermost activations on this thread */
+    uint64_t last_entry_ns;             /* Previous outermost entry on this thread */
+} narwhalyzer_thread_section_t;
+
+/*
+ * Per-thread trace buffer (NARWHALYZER_TRACE). Events are appended without
+ * synchronization and written out as one chunk when the buffer is full or
+ * the thread exits.
+ */
+typedef struct narwhalyzer_trace_buffer {
+    narwhalyzer_trace_chunk_header_t header; /* Header of the chunk being filled */
+    narwhalyzer_trace_frame_t *frames;  /* Open sections when the chunk started */
+    uint32_t frame_capacity;
+    uint32_t event_count;
+    uint32_t event_capacity;
+    narwhalyzer_trace_event_t *events;
+} narwhalyzer_trace_buffer_t;
+
+/* Trace file shared by all threads, defined in narwhalyzer_trace.c */
+typedef struct narwhalyzer_trace narwhalyzer_trace_t;
+
+/* Metrics endpoint, defined in narwhalyzer_metrics.c */
+typedef struct narwhalyzer_metrics narwhalyzer_metrics_t;
+
+/* Registered sinks and their collector, defined in narwhalyzer_sink.c */
+typedef struct narwhalyzer_sinks narwhalyzer_sinks_t;
+
+/*
+ * Per-thread calling-context tree (NARWHALYZER_PROFILE). Each node is one
+ * path of sections from the thread's root; node 0 is the root. Nodes live
+ * in fixed-size blocks that never move, so the tree can be written out
+ * while the owning thread still runs. Contexts beyond the node limit are
+ * not recorded and their time stays with the deepest recorded ancestor.
+ */
+#define NARWHALYZER_CCT_BLOCK_NODES      1024
+#define NARWHALYZER_CCT_MAX_NODES        (64 * NARWHALYZER_CCT_BLOCK_NODES)
+
+typedef struct narwhalyzer_cct_node {
+    int section;                        /* -1 for the root */
+    int parent;
+    int first_child;                    /* 0 if none */
+    int next_sibling;                   /* 0 if none */
+    uint64_t count;                     /* Completed activations */
+    uint64_t inclusive_ns;
+} narwhalyzer_cct_node_t;
+
+typedef struct narwhalyzer_cct {
+    struct narwhalyzer_cct *next;       /* All trees of the process, newest first */
+    uint32_t tid;
+    atomic_int node_count;
+    uint64_t dropped;                   /* Activations beyond the node limit */
+    narwhalyzer_cct_node_t *blocks[NARWHALYZER_CCT_MAX_NODES / NARWHALYZER_CCT_BLOCK_NODES];
+} narwhalyzer_cct_t;
+
+typedef struct narwhalyzer_thread_state {
+    narwhalyzer_context_t context_stack[NARWHALYZER_INLINE_NESTING_DEPTH];
+    int context_stack_top;
+    int context_capacity;               /* Inline frames + allocated chunk frames */
+    int chunk_count;
+    narwhalyzer_context_t **chunks;     /* Frames beyond the inline stack */
+    narwhalyzer_name_cache_entry_t name_cache[NARWHALYZER_NAME_CACHE_SIZE];
+    narwhalyzer_thread_section_t *sections; /* NARWHALYZER_MAX_SECTIONS entries */
+    uint64_t start_time_ns;             /* First instrumented entry of the thread */
+    narwhalyzer_trace_buffer_t *trace_buffer; /* NULL unless tracing */
+    narwhalyzer_cct_t *cct;             /* NULL unless NARWHALYZER_PROFILE is set */
+} narwhalyzer_thread_state_t;
+
+/*
+ * Per-step time series recorded by narwhalyzer_step().
+ * Each window aggregates steps_per_window consecutive steps. When all
+ * windows are used, adjacent pairs are merged and the window width doubles,
+ * so memory stays bounded and the whole run remains covered.
+ */
+#define NARWHALYZER_STEP_WINDOWS         64
+
+typedef struct narwhalyzer_step_window {
+    uint64_t first_step;                /* Step index passed to narwhalyzer_step() */
+    uint64_t last_step;
+    uint64_t steps;                     /* Steps aggregated in this window */
+    uint64_t wall_ns;                   /* Wall time of those steps */
+} narwhalyzer_step_window_t;
+
+typedef struct narwhalyzer_step_series {
+    uint64_t steps_per_window;
+    int window_count;
+    uint64_t last_step_ns;              /* End of the previous step */
+    uint64_t prev_time_ns[NARWHALYZER_MAX_SECTIONS]; /* Section totals at the previous step */
+    uint64_t prev_calls[NARWHALYZER_MAX_SECTIONS];
+    narwhalyzer_step_window_t windows[NARWHALYZER_STEP_WINDOWS];
+    uint64_t time_ns[NARWHALYZER_STEP_WINDOWS][NARWHALYZER_MAX_SECTIONS];
+    uint64_t calls[NARWHALYZER_STEP_WINDOWS][NARWHALYZER_MAX_SECTIONS];
+} narwhalyzer_step_series_t;
+
+/*
+ * Benchmark recorded by narwhalyzer_bench_run(), with the time and calls of
+ * every section during its measured iterations.
+ */
+typedef struct narwhalyzer_bench {
+    struct narwhalyzer_bench *next;
+    int section_index;                  /* The benchmark's own section, named after it */
+    double target_ci;
+    int use_median;
+    narwhalyzer_bench_result_t result;
+    int section_count;                  /* Sections registered at the end */
+    uint64_t *time_ns;                  /* Per section, over the measured iterations */
+    uint64_t *calls;
+} narwhalyzer_bench_t;
+
+typedef struct narwhalyzer_registry {
+    uint32_t magic;                     /* NARWHALYZER_REGISTRY_MAGIC */
+    uint32_t abi_version;               /* Layout version of this structure */
+    size_t size;                        /* sizeof(narwhalyzer_registry_t) */
+    pthread_mutex_t mutex;              /* Protects registration and arena */
+    atomic_int section_count;
+    atomic_int attached_copies;         /* Runtime copies not yet finalized */
+    atomic_int report_printed;
+    uint64_t nesting_overflows;         /* Entries dropped beyond the nesting limit */
+    uint64_t warmup_calls;              /* NARWHALYZER_WARMUP_CALLS, 0 if unset */
+    uint64_t warmup_ns;                 /* NARWHALYZER_WARMUP_MS in ns, 0 if unset */
+    uint64_t startup_enabled;           /* NARWHALYZER_STARTUP, 0 if unset */
+    uint64_t occupancy_enabled;         /* NARWHALYZER_OCCUPANCY, 0 if unset */
+    uint64_t arrivals_enabled;          /* NARWHALYZER_ARRIVALS, 0 if unset */
+    int clock_id;                       /* NARWHALYZER_CLOCK, shared by all copies */
+    uint64_t process_start_ns;          /* Process creation time, 0 if unknown */
+    uint64_t main_entry_ns;             /* First __narwhalyzer_mark_main() call, 0 if none */
+    narwhalyzer_step_series_t *steps;   /* Allocated by the first narwhalyzer_step() */
+    narwhalyzer_bench_t *benches;       /* In completion order */
+    narwhalyzer_trace_t *trace;         /* NARWHALYZER_TRACE writer, NULL if disabled */
+    uint64_t profile_pid;               /* Process that read NARWHALYZER_PROFILE, 0 if unset */
+    narwhalyzer_cct_t *cct_list;        /* Calling-context trees of all threads */
+    narwhalyzer_metrics_t *metrics;     /* NARWHALYZER_METRICS endpoint, NULL if disabled */
+    narwhalyzer_sinks_t *sinks;         /* Snapshot and event sinks */
+    uint64_t program_start_time_ns;
+    uint64_t program_end_time_ns;
+    pthread_key_t thread_key;           /* Per-thread narwhalyzer_thread_state_t */
+    narwhalyzer_arena_chunk_t *arena;   /* Interned section and file names */
+    atomic_int name_table[NARWHALYZER_NAME_TABLE_SIZE]; /* Section index + 1, 0 if empty */
+    uint32_t name_hash[NARWHALYZER_MAX_SECTIONS];       /* Hash of each dynamic name */
+    narwhalyzer_section_stats_t sections[NARWHALYZER_MAX_SECTIONS];
+} narwhalyzer_registry_t;
+
+/* Registry used by this copy of the runtime (shared or private) */
+extern narwhalyzer_registry_t *g_registry NARWHALYZER_HIDDEN;
+
+/*
+ * Get a context frame by stack index.
+ * The first frames live inline in the thread state; deeper frames live in
+ * fixed-size chunks that are never moved once allocated.
+ */
+static inline narwhalyzer_context_t *context_at(narwhalyzer_thread_state_t *ts, int idx)
+{
+    if (__builtin_expect(idx < NARWHALYZER_INLINE_NESTING_DEPTH, 1)) {
+        return &ts->context_stack[idx];
+    }
+    int offset = idx - NARWHALYZER_INLINE_NESTING_DEPTH;
+    return &ts->chunks[offset / NARWHALYZER_CONTEXT_CHUNK_DEPTH]
+                      [offset % NARWHALYZER_CONTEXT_CHUNK_DEPTH];
+}
+
+/* ============================================================================
+ * Trace Writer (narwhalyzer_trace.c)
+ * ============================================================================ */
+
+/* Expand %p in an output path; forked children also get a .<pid> suffix */
+NARWHALYZER_HIDDEN void narwhalyzer_expand_path(const char *pattern, char *out, size_t out_size,
+                                                int forked);
+
+/* Open the trace file named by NARWHALYZER_TRACE, if set */
+NARWHALYZER_HIDDEN void narwhalyzer_trace_open(narwhalyzer_registry_t *reg);
+
+/* Attach a trace buffer to a new thread */
+NARWHALYZER_HIDDEN void narwhalyzer_trace_thread_start(narwhalyzer_registry_t *reg,
+                                                       narwhalyzer_thread_state_t *ts);
+
+/* Write the thread's buffered events as one chunk and start a new one */
+NARWHALYZER_HIDDEN void narwhalyzer_trace_flush(narwhalyzer_registry_t *reg,
+                                                narwhalyzer_thread_state_t *ts);
+
+/* Flush and release the thread's trace buffer */
+NARWHALYZER_HIDDEN void narwhalyzer_trace_thread_end(narwhalyzer_registry_t *reg,
+                                                     narwhalyzer_thread_state_t *ts);
+
+/* Flush the calling thread and write the section table, index and footer */
+NARWHALYZER_HIDDEN void narwhalyzer_trace_close(narwhalyzer_registry_t *reg,
+                                                narwhalyzer_thread_state_t *ts);
+
+/*
+ * Append an event to the thread's trace buffer.
+ * Called after the context stack reflects the event, so that a chunk
+ * started by the flush below snapshots the right open sections.
+ */
+static inline void narwhalyzer_trace_record(narwhalyzer_thread_state_t *ts, uint64_t timestamp_ns,
+                                            int section_index, uint32_t kind)
+{
+    narwhalyzer_trace_buffer_t *buf = ts->trace_buffer;
+    if (__builtin_expect(buf == NULL, 1)) {
+        return;
+    }
+    
+    narwhalyzer_trace_event_t *ev = &buf->events[buf->event_count++];
+    ev->timestamp_ns = timestamp_ns;
+    ev->section = (uint32_t)section_index;
+    ev->kind = kind;
+    
+    if (buf->event_count == buf->event_capacity) {
+        narwhalyzer_trace_flush(g_registry, ts);
+    }
+}
+
+/* ============================================================================
+ * Calling-Context Profile (narwhalyzer_profile.c)
+ * ============================================================================ */
+
+/* Create the calling-context tree of a new thread */
+NARWHALYZER_HIDDEN void narwhalyzer_cct_thread_start(narwhalyzer_registry_t *reg,
+                                                     narwhalyzer_thread_state_t *ts);
+
+/* Add a child node, or return -1 if the tree is full */
+NARWHALYZER_HIDDEN int narwhalyzer_cct_add_child(narwhalyzer_cct_t *cct, int parent, int section);
+
+/* Write NARWHALYZER_PROFILE */
+NARWHALYZER_HIDDEN void narwhalyzer_profile_write(narwhalyzer_registry_t *reg,
+                                                  uint64_t total_time_ns);
+
+/* ============================================================================
+ * Metrics Endpoint (narwhalyzer_metrics.c)
+ * ============================================================================ */
+
+/* Start serving NARWHALYZER_METRICS, if set */
+NARWHALYZER_HIDDEN void narwhalyzer_metrics_start(narwhalyzer_registry_t *reg);
+
+/* Stop the serving thread and remove a Unix socket */
+NARWHALYZER_HIDDEN void narwhalyzer_metrics_stop(narwhalyzer_registry_t *reg);
+
+/* Section for a runtime-provided name, registered on first use (narwhalyzer.c) */
+NARWHALYZER_HIDDEN int narwhalyzer_name_section(const char *name);
+
+/* ============================================================================
+ * Sinks (narwhalyzer_sink.c)
+ * ============================================================================ */
+
+/* Create the sink table */
+NARWHALYZER_HIDDEN void narwhalyzer_sinks_init(narwhalyzer_registry_t *reg);
+
+/* Copy the live statistics of all sections; returns the section count */
+NARWHALYZER_HIDDEN int narwhalyzer_take_totals(narwhalyzer_registry_t *reg,
+                                               narwhalyzer_section_snapshot_t *totals);
+
+/* Register a sink; built-in sinks do not start the collector thread */
+NARWHALYZER_HIDDEN int narwhalyzer_sinks_add(narwhalyzer_registry_t *reg,
+                                             const narwhalyzer_sink_t *sink, int builtin);
+
+/* Queue a chunk just written by the trace writer for the event sinks */
+NARWHALYZER_HIDDEN void narwhalyzer_sinks_event_chunk(narwhalyzer_registry_t *reg,
+                                                      const narwhalyzer_trace_chunk_header_t *header,
+                                                      const narwhalyzer_trace_frame_t *frames,
+                                                      const narwhalyzer_trace_event_t *events);
+
+/* Deliver the final snapshot, close all sinks and stop the collector */
+NARWHALYZER_HIDDEN void narwhalyzer_sinks_finish(narwhalyzer_registry_t *reg,
+                                                 uint64_t elapsed_ns);
+
+static inline narwhalyzer_cct_node_t *cct_node_at(narwhalyzer_cct_t *cct, int idx)
+{
+    return &cct->blocks[idx / NARWHALYZER_CCT_BLOCK_NODES][idx % NARWHALYZER_CCT_BLOCK_NODES];
+}
+
+/*
+ * Find or create the node of a section entered below the frame at
+ * ctx_idx - 1. The child found is moved to the front of its siblings, so
+ * the loop of a hot call site usually stops at the first comparison.
+ */
+static inline int narwhalyzer_cct_enter(narwhalyzer_thread_state_t *ts, int ctx_idx, int section)
+{
+    narwhalyzer_cct_t *cct = ts->cct;
+    int parent = ctx_idx > 0 ? context_at(ts, ctx_idx - 1)->cct_node : 0;
+    if (parent < 0) {
+        cct->dropped++;
+        return -1;
+    }
+
+    narwhalyzer_cct_node_t *p = cct_node_at(cct, parent);
+    int prev = 0;
+    for (int c = p->first_child; c != 0; prev = c, c = cct_node_at(cct, c)->next_sibling) {
+        narwhalyzer_cct_node_t *n = cct_node_at(cct, c);
+        if (n->section == section) {
+            if (prev != 0) {
+                cct_node_at(cct, prev)->next_sibling = n->next_sibling;
+                n->next_sibling = p->first_child;
+                p->first_child = c;
+            }
+            return c;
+        }
+    }
+
+    return narwhalyzer_cct_add_child(cct, parent, section);
+}
+
+#endif /* NARWHALYZER_INTERNAL_H */
@@ -0,0 +1,460 @@
+/*
+ * narwhalyzer_metrics.c
+ *
+ * Live metrics endpoint. With NARWHALYZER_METRICS=unix:<path> or
+ * NARWHALYZER_METRICS=tcp:[127.0.0.1:]<port>, a background thread serves
+ * the merged section statistics in the Prometheus text exposition format
+ * over HTTP. Each scrape first copies every section's statistics with
+ * relaxed atomic loads, as the sink collector does, and renders all
+ * families from that copy, so a value appears the same everywhere in one
+ * response and histogram buckets, _count and _sum come from one read.
+ * Instrumented threads never wait for a scrape; a scrape may see an
+ * activation's count before its time, which the next scrape corrects.
+ *
+ * TCP endpoints only bind loopback addresses. Forked children close the
+ * inherited socket and do not serve.
+ *
+ * Copyright (c) 2026
+ * Licensed under GPL-3.0 License
+ */
+
+#define _GNU_SOURCE
+#include "narwhalyzer_internal.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+/* Largest request header read from a client */
+#define NARWHALYZER_METRICS_REQUEST_MAX  4096
+
+/* Clients that send nothing for this long are dropped */
+#define NARWHALYZER_METRICS_TIMEOUT_MS   2000
+
+/*
+ * Duration histogram bucket bounds exported to Prometheus: every second
+ * power of two from 2^10 ns (about 1 us) to 2^36 ns (about 69 s). Powers
+ * of two are bucket boundaries of the internal histogram, so these
+ * buckets are exact sums of internal ones.
+ */
+#define NARWHALYZER_METRICS_LE_FIRST     10
+#define NARWHALYZER_METRICS_LE_LAST      36
+#define NARWHALYZER_METRICS_LE_STEP      2
+
+struct narwhalyzer_metrics {
+    int fd;                             /* Listening socket, -1 once closed */
+    pthread_t thread;
+    atomic_int stop;
+    pid_t pid;                          /* Process serving the endpoint */
+    char unix_path[sizeof(((struct sockaddr_un *)0)->sun_path)]; /* Empty for TCP */
+    char endpoint[4096];                /* NARWHALYZER_METRICS as given */
+    narwhalyzer_section_snapshot_t *totals; /* Scrape scratch space */
+};
+
+/* Only one endpoint per process; the fork handler needs to find it */
+static narwhalyzer_metrics_t *g_metrics = NULL;
+
+/* ============================================================================
+ * Exposition Format
+ * ============================================================================ */
+
+/* Write a label value with \, " and newline escaped */
+static void write_label_value(FILE *out, const char *value)
+{
+    for (const char *p = value ? value : ""; *p; p++) {
+        if (*p == '\\' || *p == '"') {
+            fputc('\\', out);
+            fputc(*p, out);
+        } else if (*p == '\n') {
+            fputs("\\n", out);
+        } else {
+            fputc(*p, out);
+        }
+    }
+}
+
+static void write_labels(FILE *out, const narwhalyzer_section_snapshot_t *s)
+{
+    fputs("section=\"", out);
+    write_label_value(out, s->name);
+    fputs("\",file=\"", out);
+    write_label_value(out, s->file);
+    fprintf(out, "\",line=\"%d\"", s->line);
+}
+
+static void write_header(FILE *out, const char *name, const char *type, const char *help)
+{
+    fprintf(out, "# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+}
+
+/*
+ * Write one counter or gauge family with a value per used section.
+ * field is the byte offset of a uint64_t in narwhalyzer_section_snapshot_t.
+ */
+static void write_section_family(FILE *out, const narwhalyzer_section_snapshot_t *totals,
+                                 int section_count, const char *name, const char *type,
+                                 const char *help, size_t field, double scale)
+{
+    write_header(out, name, type, help);
+    for (int i = 0; i < section_count; i++) {
+        const narwhalyzer_section_snapshot_t *s = &totals[i];
+        if (s->entries == 0) continue;
+
+        uint64_t value = *(const uint64_t *)((const char *)s + field);
+        fprintf(out, "%s{", name);
+        write_labels(out, s);
+        if (scale == 1.0) {
+            fprintf(out, "} %llu\n", (unsigned long long)value);
+        } else {
+            fprintf(out, "} %.9g\n", (double)value * scale);
+        }
+    }
+}
+
+static void write_duration_histograms(FILE *out, const narwhalyzer_section_snapshot_t *totals,
+                                      int section_count)
+{
+    const char *name = "narwhalyzer_section_duration_seconds";
+    write_header(out, name, "histogram", "Duration of outermost section activations.");
+
+    for (int i = 0; i < section_count; i++) {
+        const narwhalyzer_section_snapshot_t *s = &totals[i];
+        if (s->entries == 0) continue;
+
+        uint64_t cumulative = 0;
+        int b = 0;
+        for (int e = NARWHALYZER_METRICS_LE_FIRST; e <= NARWHALYZER_METRICS_LE_LAST;
+             e += NARWHALYZER_METRICS_LE_STEP) {
+            int bound = narwhalyzer_histogram_bucket(1ULL << e);
+            for (; b < bound; b++) {
+                cumulative += s->duration.buckets[b];
+            }
+            fprintf(out, "%s_bucket{", name);
+            write_labels(out, s);
+            fprintf(out, ",le=\"%.9g\"} %llu\n", (double)(1ULL << e) * 1e-9,
+                    (unsigned long long)cumulative);
+        }
+        for (; b < NARWHALYZER_HIST_BUCKETS; b++) {
+            cumulative += s->duration.buckets[b];
+        }
+
+        /* _count is the bucket total, so the series stays consistent */
+        fprintf(out, "%s_bucket{", name);
+        write_labels(out, s);
+        fprintf(out, ",le=\"+Inf\"} %llu\n", (unsigned long long)cumulative);
+        fprintf(out, "%s_sum{", name);
+        write_labels(out, s);
+        fprintf(out, "} %.9g\n", (double)s->time_ns * 1e-9);
+        fprintf(out, "%s_count{", name);
+        write_labels(out, s);
+        fprintf(out, "} %llu\n", (unsigned long long)cumulative);
+    }
+}
+
+/*
+ * Render all metrics from one snapshot of the registry into a malloc'ed
+ * buffer.
+ */
+static char *render_metrics(narwhalyzer_registry_t *reg, size_t *size)
+{
+    char *body = NULL;
+    FILE *out = open_memstream(&body, size);
+    if (!out) return NULL;
+
+    narwhalyzer_section_snapshot_t *totals = reg->metrics->totals;
+    int section_count = narwhalyzer_take_totals(reg, totals);
+    uint64_t now_ns = __narwhalyzer_get_timestamp_ns();
+
+    write_header(out, "narwhalyzer_uptime_seconds", "gauge",
+                 "Time since the runtime started.");
+    fprintf(out, "narwhalyzer_uptime_seconds %.9g\n",
+            (double)(now_ns - reg->program_start_time_ns) * 1e-9);
+    write_header(out, "narwhalyzer_sections", "gauge", "Registered sections.");
+    fprintf(out, "narwhalyzer_sections %d\n", section_count);
+    write_header(out, "narwhalyzer_nesting_overflows_total", "counter",
+                 "Section entries dropped beyond the nesting limit.");
+    fprintf(out, "narwhalyzer_nesting_overflows_total %llu\n",
+            (unsigned long long)__atomic_load_n(&reg->nesting_overflows, __ATOMIC_RELAXED));
+
+    write_section_family(out, totals, section_count, "narwhalyzer_section_entries_total",
+                         "counter", "Section entries, including recursive ones.",
+                         offsetof(narwhalyzer_section_snapshot_t, entries), 1.0);
+    write_section_family(out, totals, section_count,
+                         "narwhalyzer_section_recursive_entries_total", "counter",
+                         "Section entries while already active on the thread.",
+                         offsetof(narwhalyzer_section_snapshot_t, recursive_entries), 1.0);
+    write_section_family(out, totals, section_count, "narwhalyzer_section_seconds_total",
+                         "counter", "Time spent in outermost section activations.",
+                         offsetof(narwhalyzer_section_snapshot_t, time_ns), 1e-9);
+    write_section_family(out, totals, section_count, "narwhalyzer_section_max_seconds", "gauge",
+                         "Longest outermost activation so far.",
+                         offsetof(narwhalyzer_section_snapshot_t, max_ns), 1e-9);
+    if (reg->occupancy_enabled) {
+        /* Gauges outside the snapshot, read once each */
+        write_header(out, "narwhalyzer_section_max_concurrency", "gauge",
+                     "Most threads inside the section at once.");
+        for (int i = 0; i < section_count; i++) {
+            if (totals[i].entries == 0) continue;
+            uint64_t max = __atomic_load_n(&reg->sections[i].max_concurrency, __ATOMIC_RELAXED);
+            fputs("narwhalyzer_section_max_concurrency{", out);
+            write_labels(out, &totals[i]);
+            fprintf(out, "} %llu\n", (unsigned long long)max);
+        }
+
+        /* Threads inside each section now: the low 16 bits of the occupancy state */
+        write_header(out, "narwhalyzer_section_active_threads", "gauge",
+                     "Threads currently inside the section.");
+        for (int i = 0; i < section_count; i++) {
+            if (totals[i].entries == 0) continue;
+            uint64_t state = __atomic_load_n(&reg->sections[i].occupancy_state, __ATOMIC_RELAXED);
+            fputs("narwhalyzer_section_active_threads{", out);
+            write_labels(out, &totals[i]);
+            fprintf(out, "} %llu\n", (unsigned long long)(state & 0xffff));
+        }
+    }
+
+    write_duration_histograms(out, totals, section_count);
+
+    if (fclose(out) != 0) {
+        free(body);
+        return NULL;
+    }
+    return body;
+}
+
+/* ============================================================================
+ * HTTP Server
+ * ============================================================================ */
+
+static void send_all(int fd, const char *data, size_t size)
+{
+    while (size > 0) {
+        ssize_t n = send(fd, data, size, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return;
+        data += n;
+        size -= (size_t)n;
+    }
+}
+
+static void send_response(int fd, const char *status, const char *body, size_t size)
+{
+    char header[256];
+    int len = snprintf(header, sizeof(header),
+                       "HTTP/1.0 %s\r\n"
+                       "Content-Type: text/plain; version=0.0.4; charset=utf-8\r\n"
+                       "Content-Length: %zu\r\n"
+                       "Connection: close\r\n\r\n", status, size);
+    send_all(fd, header, (size_t)len);
+    send_all(fd, body, size);
+}
+
+/*
+ * Serve one request. Any GET is answered with the metrics, so the
+ * endpoint works with /metrics as well as with a bare socket path.
+ */
+static void serve_client(narwhalyzer_registry_t *reg, int fd)
+{
+    struct timeval timeout = {
+        .tv_sec = NARWHALYZER_METRICS_TIMEOUT_MS / 1000,
+        .tv_usec = (NARWHALYZER_METRICS_TIMEOUT_MS % 1000) * 1000,
+    };
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+    char request[NARWHALYZER_METRICS_REQUEST_MAX + 1];
+    size_t used = 0;
+    while (used < NARWHALYZER_METRICS_REQUEST_MAX) {
+        ssize_t n = recv(fd, request + used, NARWHALYZER_METRICS_REQUEST_MAX - used, 0);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        used += (size_t)n;
+        request[used] = '\0';
+        if (strstr(request, "\r\n\r\n") || strstr(request, "\n\n")) break;
+    }
+    request[used] = '\0';
+
+    if (strncmp(request, "GET ", 4) != 0) {
+        const char *message = "only GET is supported\n";
+        send_response(fd, "405 Method Not Allowed", message, strlen(message));
+        return;
+    }
+
+    size_t size = 0;
+    char *body = render_metrics(reg, &size);
+    if (!body) {
+        const char *message = "cannot render metrics\n";
+        send_response(fd, "500 Internal Server Error", message, strlen(message));
+        return;
+    }
+    send_response(fd, "200 OK", body, size);
+    free(body);
+}
+
+static void *metrics_thread(void *arg)
+{
+    narwhalyzer_registry_t *reg = arg;
+    narwhalyzer_metrics_t *m = reg->metrics;
+
+    while (!atomic_load(&m->stop)) {
+        int client = accept4(m->fd, NULL, NULL, SOCK_CLOEXEC);
+        if (client < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            break; /* Socket shut down */
+        }
+        serve_client(reg, client);
+        close(client);
+    }
+    return NULL;
+}
+
+/* ============================================================================
+ * Endpoint Setup
+ * ============================================================================ */
+
+/*
+ * Bind the socket named by NARWHALYZER_METRICS.
+ * Returns the listening socket, or -1 with a warning printed.
+ */
+static int open_endpoint(narwhalyzer_metrics_t *m)
+{
+    const char *spec = m->endpoint;
+    int fd = -1;
+
+    if (strncmp(spec, "unix:", 5) == 0) {
+        struct sockaddr_un addr = { .sun_family = AF_UNIX };
+        narwhalyzer_expand_path(spec + 5, m->unix_path, sizeof(m->unix_path), 0);
+        if (m->unix_path[0] == '\0' || strlen(m->unix_path) >= sizeof(addr.sun_path)) {
+            fprintf(stderr, "narwhalyzer: warning: invalid metrics socket path %s\n", spec + 5);
+            return -1;
+        }
+        memcpy(addr.sun_path, m->unix_path, strlen(m->unix_path) + 1);
+        unlink(m->unix_path); /* Stale socket of an earlier run */
+
+        fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd < 0 || bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) goto fail;
+    } else if (strncmp(spec, "tcp:", 4) == 0) {
+        struct sockaddr_in addr = { .sin_family = AF_INET, .sin_addr.s_addr = htonl(INADDR_LOOPBACK) };
+        const char *port = spec + 4;
+        const char *colon = strrchr(port, ':');
+        if (colon) {
+            char host[64];
+            size_t len = (size_t)(colon - port);
+            if (len >= sizeof(host)) len = sizeof(host) - 1;
+            memcpy(host, port, len);
+            host[len] = '\0';
+            if (inet_pton(AF_INET, host, &addr.sin_addr) != 1 ||
+                (ntohl(addr.sin_addr.s_addr) >> 24) != 127) {
+                fprintf(stderr, "narwhalyzer: warning: metrics endpoint must be a loopback "
+                        "address: %s\n", spec);
+                return -1;
+            }
+            port = colon + 1;
+        }
+        char *end;
+        unsigned long value = strtoul(port, &end, 10);
+        if (*port == '\0' || *end != '\0' || value == 0 || value > 65535) {
+            fprintf(stderr, "narwhalyzer: warning: invalid metrics port in %s\n", spec);
+            return -1;
+        }
+        addr.sin_port = htons((uint16_t)value);
+
+        fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        int one = 1;
+        if (fd >= 0) setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        if (fd < 0 || bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) goto fail;
+    } else {
+        fprintf(stderr, "narwhalyzer: warning: ignoring invalid NARWHALYZER_METRICS=%s "
+                "(expected unix:<path> or tcp:<port>)\n", spec);
+        return -1;
+    }
+
+    if (listen(fd, 16) != 0) goto fail;
+    return fd;
+
+fail:
+    fprintf(stderr, "narwhalyzer: warning: cannot serve metrics on %s: %s\n", spec, strerror(errno));
+    if (fd >= 0) close(fd);
+    m->unix_path[0] = '\0';
+    return -1;
+}
+
+/*
+ * The serving thread does not exist in a forked child: drop the inherited
+ * socket so the parent keeps answering alone.
+ */
+static void metrics_atfork_child(void)
+{
+    narwhalyzer_metrics_t *m = g_metrics;
+    if (m && m->fd >= 0) {
+        close(m->fd);
+        m->fd = -1;
+    }
+}
+
+void narwhalyzer_metrics_start(narwhalyzer_registry_t *reg)
+{
+    const char *spec = getenv("NARWHALYZER_METRICS");
+    if (!spec || !*spec || g_metrics) {
+        return;
+    }
+
+    narwhalyzer_metrics_t *m = calloc(1, sizeof(*m));
+    if (!m) return;
+    m->totals = calloc(NARWHALYZER_MAX_SECTIONS, sizeof(*m->totals));
+    if (!m->totals) {
+        free(m);
+        return;
+    }
+    snprintf(m->endpoint, sizeof(m->endpoint), "%s", spec);
+    m->fd = open_endpoint(m);
+    if (m->fd < 0) {
+        free(m->totals);
+        free(m);
+        return;
+    }
+    m->pid = getpid();
+    reg->metrics = m;
+
+    /* Signals meant for the application must not land on the server */
+    sigset_t all, old;
+    sigfillset(&all);
+    pthread_sigmask(SIG_SETMASK, &all, &old);
+    int rc = pthread_create(&m->thread, NULL, metrics_thread, reg);
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+    if (rc != 0) {
+        fprintf(stderr, "narwhalyzer: warning: cannot start metrics thread\n");
+        close(m->fd);
+        if (m->unix_path[0]) unlink(m->unix_path);
+        reg->metrics = NULL;
+        free(m->totals);
+        free(m);
+        return;
+    }
+
+    g_metrics = m;
+    pthread_atfork(NULL, NULL, metrics_atfork_child);
+}
+
+void narwhalyzer_metrics_stop(narwhalyzer_registry_t *reg)
+{
+    narwhalyzer_metrics_t *m = reg->metrics;
+    if (!m || m->fd < 0 || m->pid != getpid()) {
+        return;
+    }
+
+    /* Shutting the socket down wakes the thread blocked in accept() */
+    atomic_store(&m->stop, 1);
+    shutdown(m->fd, SHUT_RDWR);
+    pthread_join(m->thread, NULL);
+    close(m->fd);
+    m->fd = -1;
+    if (m->unix_path[0]) unlink(m->unix_path);
+}
@@ -61,6 +61,7 @@ static struct plugin_info narwhalyzer_info = {
             "\n"
             "Options:\n"
             "  -fplugin-arg-narwhalyzer-verbose    Enable verbose output\n"
+            "  -fplugin-arg-narwhalyzer-startup    Mark the entry of main for startup profiling\n"
             "\n"
             "Pragma forms:\n"
             "  #pragma narwhalyzer section_name         - Structured (function)\n"
@@ -77,6 +78,7 @@ static struct plugin_info narwhalyzer_info = {
  * ============================================================================ */
 
 static bool g_verbose = false;
+static bool g_mark_main = false;        /* Insert __narwhalyzer_mark_main() */
 
 /* Pragma type enumeration */
 enum class pragma_type {
@@ -139,6 +141,17 @@ static tree build_string_addr(const char *str)
     return build1(ADDR_EXPR, ptr_type, str_cst);
 }
 
+/*
+ * Check whether a function is the program's main and must be marked for
+ * startup profiling. Only done on request, as the marker makes the
+ * object depend on the runtime even without any pragma.
+ */
+static bool is_marked_main(tree fndecl)
+{
+    return g_mark_main && DECL_NAME(fndecl) && MAIN_NAME_P(DECL_NAME(fndecl)) &&
+           DECL_FILE_SCOPE_P(fndecl) && TREE_PUBLIC(fndecl);
+}
+
 /*
  * Declare an external function.
  */
@@ -410,7 +423,7 @@ public:
         bool has_regions = g_function_regions.find(fndecl) != g_function_regions.end();
         bool already_done = g_instrumented_functions.find(fndecl) != g_instrumented_functions.end();
         
-        return (has_structured || has_regions) && !already_done;
+        return (has_structured || has_regions || is_marked_main(fndecl)) && !already_done;
     }
     
     virtual unsigned int execute(function *fn) override
@@ -437,6 +450,11 @@ public:
             instrument_regions(fn, region_it->second);
         }
         
+        /* Mark the end of process startup for the startup profiler */
+        if (is_marked_main(fndecl)) {
+            insert_main_marker(fn);
+        }
+        
         g_instrumented_functions.insert(fndecl);
         
         return 0;
@@ -448,6 +466,7 @@ private:
     tree get_or_create_section_index_var(const pragma_info &pinfo);
     void insert_entry_instrumentation(function *fn, tree section_var);
     void insert_exit_instrumentation(function *fn, tree ctx_var);
+    void insert_main_marker(function *fn);
     
     /* Helper to find the first statement at or after a given line */
     gimple_stmt_iterator find_stmt_at_line(function *fn, int line, basic_block *out_bb);
@@ -483,6 +502,30 @@ tree narwhalyzer_pass::get_or_create_section_index_var(const pragma_info &pinfo)
     return var;
 }
 
+/*
+ * Insert a call to __narwhalyzer_mark_main() on entry to main.
+ * The call goes on the entry edge so that a loop starting at the first
+ * statement of main does not repeat it.
+ */
+void narwhalyzer_pass::insert_main_marker(function *fn)
+{
+    tree mark_fn = declare_runtime_function(
+        "__narwhalyzer_mark_main",
+        void_type_node,
+        0);
+    
+    gcall *mark_call = gimple_build_call(mark_fn, 0);
+    gimple_set_location(mark_call, DECL_SOURCE_LOCATION(fn->decl));
+    gsi_insert_on_edge_immediate(single_succ_edge(ENTRY_BLOCK_PTR_FOR_FN(fn)),
+                                 mark_call);
+    
+    if (g_verbose) {
+        inform(DECL_SOURCE_LOCATION(fn->decl),
+               "narwhalyzer: marking entry of %qE for startup profiling",
+               DECL_NAME(fn->decl));
+    }
+}
+
 /*
  * Insert instrumentation at function entry and all exits.
  */
@@ -816,6 +859,8 @@ int plugin_init(struct plugin_name_args *plugin_info,
     for (int i = 0; i < plugin_info->argc; i++) {
         if (strcmp(plugin_info->argv[i].key, "verbose") == 0) {
             g_verbose = true;
+        } else if (strcmp(plugin_info->argv[i].key, "startup") == 0) {
+            g_mark_main = true;
         }
     }
     
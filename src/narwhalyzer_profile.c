@@ -0,0 +1,227 @@
+/*
+ * narwhalyzer_profile.c
+ *
+ * Calling-context profile. With NARWHALYZER_PROFILE=<path>, every thread
+ * keeps a tree of the section paths it has executed, with the number of
+ * activations and inclusive time of each path. At exit the trees and the
+ * section statistics are written as a line-oriented text file that the
+ * narwhalyzer-report tool converts to other formats.
+ *
+ * File format (fields separated by tabs, strings escaped with \t, \n and
+ * \\):
+ *
+ *   narwhalyzer-profile  1
+ *   pid        <pid>
+ *   command    <argv[0]>
+ *   total_ns   <program time>
+ *   section    <index> <entries> <cumulative_ns> <min_ns> <max_ns> <line> <name> <file>
+ *   hist       <section> <duration|recursion|concurrency|interarrival> <lower>:<count> ...
+ *   thread     <tid> <nodes> <dropped>
+ *   node       <id> <parent> <section> <count> <inclusive_ns>
+ *
+ * Node ids are per thread; node 0 is the thread's root and is not written.
+ * A node always follows its parent.
+ *
+ * Copyright (c) 2026
+ * Licensed under GPL-3.0 License
+ */
+
+#define _GNU_SOURCE
+#include "narwhalyzer_internal.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+#define NARWHALYZER_PROFILE_VERSION      1
+
+/* ============================================================================
+ * Calling-Context Trees
+ * ============================================================================ */
+
+/*
+ * Create the tree of a new thread and link it into the registry, so that it
+ * is still written after the thread has exited.
+ */
+void narwhalyzer_cct_thread_start(narwhalyzer_registry_t *reg, narwhalyzer_thread_state_t *ts)
+{
+    if (!reg->profile_pid) return;
+
+    narwhalyzer_cct_t *cct = calloc(1, sizeof(narwhalyzer_cct_t));
+    if (!cct) return;
+    cct->blocks[0] = calloc(NARWHALYZER_CCT_BLOCK_NODES, sizeof(narwhalyzer_cct_node_t));
+    if (!cct->blocks[0]) {
+        free(cct);
+        return;
+    }
+
+    cct->tid = (uint32_t)syscall(SYS_gettid);
+    cct->blocks[0][0].section = -1;
+    cct->blocks[0][0].parent = -1;
+    atomic_store(&cct->node_count, 1);
+
+    pthread_mutex_lock(&reg->mutex);
+    cct->next = reg->cct_list;
+    reg->cct_list = cct;
+    pthread_mutex_unlock(&reg->mutex);
+
+    ts->cct = cct;
+}
+
+/*
+ * Append a node for a section below parent. Only the owning thread adds
+ * nodes; the count is published last so a concurrent writer never sees a
+ * node before it is initialized.
+ */
+int narwhalyzer_cct_add_child(narwhalyzer_cct_t *cct, int parent, int section)
+{
+    int idx = atomic_load_explicit(&cct->node_count, memory_order_relaxed);
+    if (idx >= NARWHALYZER_CCT_MAX_NODES) {
+        cct->dropped++;
+        return -1;
+    }
+
+    int block = idx / NARWHALYZER_CCT_BLOCK_NODES;
+    if (!cct->blocks[block]) {
+        cct->blocks[block] = calloc(NARWHALYZER_CCT_BLOCK_NODES, sizeof(narwhalyzer_cct_node_t));
+        if (!cct->blocks[block]) {
+            cct->dropped++;
+            return -1;
+        }
+    }
+
+    narwhalyzer_cct_node_t *node = cct_node_at(cct, idx);
+    narwhalyzer_cct_node_t *p = cct_node_at(cct, parent);
+    node->section = section;
+    node->parent = parent;
+    node->next_sibling = p->first_child;
+    p->first_child = idx;
+
+    atomic_store_explicit(&cct->node_count, idx + 1, memory_order_release);
+    return idx;
+}
+
+/* ============================================================================
+ * Profile Writer
+ * ============================================================================ */
+
+/*
+ * Write a string field, escaping the field and line separators.
+ */
+static void write_escaped(FILE *out, const char *text)
+{
+    for (const char *p = text ? text : ""; *p; p++) {
+        switch (*p) {
+        case '\t': fputs("\\t", out); break;
+        case '\n': fputs("\\n", out); break;
+        case '\\': fputs("\\\\", out); break;
+        default:   fputc(*p, out); break;
+        }
+    }
+}
+
+static void write_histogram(FILE *out, int section, const char *kind,
+                            const narwhalyzer_histogram_t *hist)
+{
+    int written = 0;
+
+    for (int b = 0; b < NARWHALYZER_HIST_BUCKETS; b++) {
+        uint64_t count = __atomic_load_n(&hist->buckets[b], __ATOMIC_RELAXED);
+        if (count == 0) continue;
+        if (!written) {
+            fprintf(out, "hist\t%d\t%s", section, kind);
+            written = 1;
+        }
+        fprintf(out, "\t%llu:%llu", (unsigned long long)narwhalyzer_histogram_bucket_lower(b),
+                (unsigned long long)count);
+    }
+
+    if (written) fputc('\n', out);
+}
+
+/*
+ * Read argv[0] of the process.
+ */
+static void read_command(char *buf, size_t size)
+{
+    buf[0] = '\0';
+    FILE *f = fopen("/proc/self/cmdline", "r");
+    if (!f) return;
+    size_t n = fread(buf, 1, size - 1, f);
+    buf[n] = '\0';
+    fclose(f);
+}
+
+/*
+ * Write the profile file named by NARWHALYZER_PROFILE.
+ */
+void narwhalyzer_profile_write(narwhalyzer_registry_t *reg, uint64_t total_time_ns)
+{
+    const char *pattern = getenv("NARWHALYZER_PROFILE");
+    if (!reg->profile_pid || !pattern || !*pattern) return;
+
+    char path[4096];
+    narwhalyzer_expand_path(pattern, path, sizeof(path), (uint64_t)getpid() != reg->profile_pid);
+
+    FILE *out = fopen(path, "w");
+    if (!out) {
+        fprintf(stderr, "narwhalyzer: warning: cannot write profile %s\n", path);
+        return;
+    }
+
+    char command[4096];
+    read_command(command, sizeof(command));
+
+    fprintf(out, "narwhalyzer-profile\t%d\n", NARWHALYZER_PROFILE_VERSION);
+    fprintf(out, "pid\t%d\n", (int)getpid());
+    fputs("command\t", out);
+    write_escaped(out, command);
+    fputc('\n', out);
+    fprintf(out, "total_ns\t%llu\n", (unsigned long long)total_time_ns);
+
+    int section_count = atomic_load(&reg->section_count);
+    for (int i = 0; i < section_count; i++) {
+        narwhalyzer_section_stats_t *s = &reg->sections[i];
+        uint64_t entries = __atomic_load_n(&s->entry_count, __ATOMIC_RELAXED);
+        uint64_t min_ns = __atomic_load_n(&s->min_time_ns, __ATOMIC_RELAXED);
+
+        fprintf(out, "section\t%d\t%llu\t%llu\t%llu\t%llu\t%d\t", i,
+                (unsigned long long)entries,
+                (unsigned long long)__atomic_load_n(&s->cumulative_time_ns, __ATOMIC_RELAXED),
+                (unsigned long long)(min_ns == UINT64_MAX ? 0 : min_ns),
+                (unsigned long long)__atomic_load_n(&s->max_time_ns, __ATOMIC_RELAXED),
+                s->line);
+        write_escaped(out, s->name);
+        fputc('\t', out);
+        write_escaped(out, s->file);
+        fputc('\n', out);
+
+        write_histogram(out, i, "duration", &s->duration_hist);
+        write_histogram(out, i, "recursion", &s->recursion_depth_hist);
+        write_histogram(out, i, "concurrency", &s->concurrency_time_hist);
+        write_histogram(out, i, "interarrival", &s->interarrival_hist);
+    }
+
+    pthread_mutex_lock(&reg->mutex);
+    narwhalyzer_cct_t *list = reg->cct_list;
+    pthread_mutex_unlock(&reg->mutex);
+
+    for (narwhalyzer_cct_t *cct = list; cct; cct = cct->next) {
+        int count = atomic_load_explicit(&cct->node_count, memory_order_acquire);
+        if (count <= 1) continue;
+
+        fprintf(out, "thread\t%u\t%d\t%llu\n", cct->tid, count - 1,
+                (unsigned long long)cct->dropped);
+        for (int i = 1; i < count; i++) {
+            narwhalyzer_cct_node_t *n = cct_node_at(cct, i);
+            fprintf(out, "node\t%d\t%d\t%d\t%llu\t%llu\n", i, n->parent, n->section,
+                    (unsigned long long)n->count, (unsigned long long)n->inclusive_ns);
+        }
+    }
+
+    if (fclose(out) != 0) {
+        fprintf(stderr, "narwhalyzer: warning: cannot write profile %s\n", path);
+    }
+}
@@ -0,0 +1,583 @@
+/*
+ * narwhalyzer_sink.c
+ *
+ * Sink registry and collector thread. Sinks receive periodic snapshots of
+ * the section statistics, the trace writer's event chunks and a final
+ * snapshot at exit. All callbacks run on one collector thread, started
+ * when the first user sink is registered, so instrumented threads only
+ * ever queue event chunks. Without user sinks no thread is started and
+ * the built-in text report runs at exit as before.
+ *
+ * Copyright (c) 2026
+ * Licensed under GPL-3.0 License
+ */
+
+#define _GNU_SOURCE
+#include "narwhalyzer_internal.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+
+/* Registered sinks, built-in ones included */
+#define NARWHALYZER_MAX_SINKS            32
+
+/* Event chunks waiting for the collector; later chunks are dropped */
+#define NARWHALYZER_SINK_QUEUE_BYTES     (64u << 20)
+
+_Static_assert(sizeof(narwhalyzer_event_t) == sizeof(narwhalyzer_trace_event_t) &&
+               offsetof(narwhalyzer_event_t, section) ==
+               offsetof(narwhalyzer_trace_event_t, section) &&
+               offsetof(narwhalyzer_event_t, kind) == offsetof(narwhalyzer_trace_event_t, kind),
+               "trace events are passed to sinks unchanged");
+
+typedef struct sink_slot {
+    int used;
+    int builtin;                        /* Runs at exit without a collector thread */
+    int closing;                        /* Unregistered, the collector closes it */
+    uint64_t seq;                       /* Registration order */
+    narwhalyzer_sink_t sink;
+    uint64_t last_ns;                   /* Previous snapshot, program start at first */
+    uint64_t next_ns;                   /* Next periodic snapshot, UINT64_MAX if none */
+    narwhalyzer_section_snapshot_t *prev; /* Totals at the previous snapshot */
+} sink_slot_t;
+
+typedef struct queued_chunk {
+    struct queued_chunk *next;
+    size_t bytes;
+    narwhalyzer_event_chunk_t chunk;    /* Points into data */
+    narwhalyzer_event_t data[];         /* Open sections, then events */
+} queued_chunk_t;
+
+struct narwhalyzer_sinks {
+    pthread_mutex_t sink_mutex;         /* Sink table; held while callbacks run */
+    pthread_cond_t closed;              /* A closing sink was removed */
+    sink_slot_t slots[NARWHALYZER_MAX_SINKS];
+    uint64_t next_seq;
+    int user_sinks;                     /* Registered sinks that are not built in */
+    atomic_int chunk_sinks;             /* Sinks with an event_chunk callback */
+    atomic_uint_fast64_t dropped_chunks;
+    narwhalyzer_section_snapshot_t *totals; /* Collector scratch space */
+    narwhalyzer_section_snapshot_t *deltas;
+
+    pthread_mutex_t queue_mutex;        /* Everything below */
+    pthread_cond_t wake;
+    queued_chunk_t *head;
+    queued_chunk_t *tail;
+    size_t queued_bytes;
+    uint64_t next_due_ns;               /* Earliest periodic snapshot */
+    int running;                        /* Collector thread started */
+    int close_requested;                /* A sink waits to be closed */
+    int finishing;                      /* Final snapshot requested */
+    int finished;                       /* Final snapshot delivered */
+    uint64_t final_elapsed_ns;
+    pthread_t thread;
+    pid_t pid;                          /* Process owning the collector */
+};
+
+/* The fork handler needs to find the sinks */
+static narwhalyzer_sinks_t *g_sinks = NULL;
+
+/* ============================================================================
+ * Snapshots
+ * ============================================================================ */
+
+/*
+ * Read the live statistics of all sections, each value once. Other
+ * threads keep updating them, so fields of one section may be from
+ * slightly different moments. Also used by the metrics endpoint.
+ */
+int narwhalyzer_take_totals(narwhalyzer_registry_t *reg, narwhalyzer_section_snapshot_t *totals)
+{
+    int count = atomic_load(&reg->section_count);
+    for (int i = 0; i < count; i++) {
+        narwhalyzer_section_stats_t *s = &reg->sections[i];
+        narwhalyzer_section_snapshot_t *t = &totals[i];
+        t->name = s->name;
+        t->file = s->file;
+        t->line = s->line;
+        t->entries = __atomic_load_n(&s->entry_count, __ATOMIC_RELAXED);
+        t->recursive_entries = __atomic_load_n(&s->recursive_entry_count, __ATOMIC_RELAXED);
+        t->time_ns = __atomic_load_n(&s->cumulative_time_ns, __ATOMIC_RELAXED);
+        t->min_ns = __atomic_load_n(&s->min_time_ns, __ATOMIC_RELAXED);
+        t->max_ns = __atomic_load_n(&s->max_time_ns, __ATOMIC_RELAXED);
+        if (t->min_ns == UINT64_MAX) t->min_ns = 0;
+        for (int b = 0; b < NARWHALYZER_HIST_BUCKETS; b++) {
+            t->duration.buckets[b] = __atomic_load_n(&s->duration_hist.buckets[b],
+                                                     __ATOMIC_RELAXED);
+        }
+    }
+    return count;
+}
+
+/*
+ * Deliver a snapshot to one sink and remember its totals for the next
+ * delta. Caller holds sink_mutex.
+ */
+static void deliver_snapshot(narwhalyzer_sinks_t *sinks, sink_slot_t *slot, int count,
+                             uint64_t now_ns, uint64_t elapsed_ns, int final)
+{
+    for (int i = 0; i < count; i++) {
+        const narwhalyzer_section_snapshot_t *t = &sinks->totals[i];
+        const narwhalyzer_section_snapshot_t *p = &slot->prev[i];
+        narwhalyzer_section_snapshot_t *d = &sinks->deltas[i];
+        *d = *t;
+        d->entries = t->entries - p->entries;
+        d->recursive_entries = t->recursive_entries - p->recursive_entries;
+        d->time_ns = t->time_ns - p->time_ns;
+        d->min_ns = 0;
+        d->max_ns = 0;
+        for (int b = 0; b < NARWHALYZER_HIST_BUCKETS; b++) {
+            d->duration.buckets[b] = t->duration.buckets[b] - p->duration.buckets[b];
+        }
+    }
+
+    narwhalyzer_snapshot_t snapshot = {
+        .timestamp_ns = now_ns,
+        .elapsed_ns = elapsed_ns,
+        .interval_ns = now_ns - slot->last_ns,
+        .final = final,
+        .section_count = count,
+        .totals = sinks->totals,
+        .deltas = sinks->deltas,
+        .dropped_chunks = atomic_load(&sinks->dropped_chunks),
+    };
+    if (slot->sink.snapshot) {
+        slot->sink.snapshot(&snapshot, slot->sink.user_data);
+    }
+
+    memcpy(slot->prev, sinks->totals, (size_t)count * sizeof(*slot->prev));
+    slot->last_ns = now_ns;
+    if (slot->sink.interval_ms) {
+        slot->next_ns = now_ns + slot->sink.interval_ms * 1000000ULL;
+    }
+}
+
+/* Call the close callback and free the slot. Caller holds sink_mutex. */
+static void close_slot(narwhalyzer_sinks_t *sinks, sink_slot_t *slot)
+{
+    if (slot->sink.close) {
+        slot->sink.close(slot->sink.user_data);
+    }
+    if (slot->sink.event_chunk) atomic_fetch_sub(&sinks->chunk_sinks, 1);
+    if (!slot->builtin) sinks->user_sinks--;
+    free(slot->prev);
+    memset(slot, 0, sizeof(*slot));
+}
+
+/* Close the unregistered sinks. Caller holds sink_mutex. */
+static void close_pending(narwhalyzer_sinks_t *sinks)
+{
+    int closed = 0;
+    for (int i = 0; i < NARWHALYZER_MAX_SINKS; i++) {
+        sink_slot_t *slot = &sinks->slots[i];
+        if (slot->used && slot->closing) {
+            close_slot(sinks, slot);
+            closed = 1;
+        }
+    }
+    if (closed) pthread_cond_broadcast(&sinks->closed);
+}
+
+/*
+ * Deliver the final snapshot to every sink and close them, in
+ * registration order, so the text report comes first. Unregistered sinks
+ * not closed yet are only closed. The sinks are removed afterwards.
+ */
+static void deliver_final(narwhalyzer_registry_t *reg, uint64_t elapsed_ns)
+{
+    narwhalyzer_sinks_t *sinks = reg->sinks;
+    pthread_mutex_lock(&sinks->sink_mutex);
+    int count = narwhalyzer_take_totals(reg, sinks->totals);
+    uint64_t now_ns = __narwhalyzer_get_timestamp_ns();
+    for (;;) {
+        sink_slot_t *slot = NULL;
+        for (int i = 0; i < NARWHALYZER_MAX_SINKS; i++) {
+            sink_slot_t *s = &sinks->slots[i];
+            if (s->used && (!slot || s->seq < slot->seq)) slot = s;
+        }
+        if (!slot) break;
+        if (!slot->closing) {
+            deliver_snapshot(sinks, slot, count, now_ns, elapsed_ns, 1);
+        }
+        close_slot(sinks, slot);
+    }
+    pthread_cond_broadcast(&sinks->closed);
+    pthread_mutex_unlock(&sinks->sink_mutex);
+}
+
+/* ============================================================================
+ * Collector Thread
+ * ============================================================================ */
+
+static void deliver_chunks(narwhalyzer_sinks_t *sinks, queued_chunk_t *list)
+{
+    while (list) {
+        queued_chunk_t *next = list->next;
+        for (int i = 0; i < NARWHALYZER_MAX_SINKS; i++) {
+            sink_slot_t *slot = &sinks->slots[i];
+            if (slot->used && !slot->closing && slot->sink.event_chunk) {
+                slot->sink.event_chunk(&list->chunk, slot->sink.user_data);
+            }
+        }
+        free(list);
+        list = next;
+    }
+}
+
+/*
+ * Send due periodic snapshots. Returns the time of the next one.
+ * Caller holds sink_mutex.
+ */
+static uint64_t deliver_due_snapshots(narwhalyzer_registry_t *reg)
+{
+    narwhalyzer_sinks_t *sinks = reg->sinks;
+    uint64_t now_ns = __narwhalyzer_get_timestamp_ns();
+    uint64_t next_due = UINT64_MAX;
+    int count = -1;
+
+    for (int i = 0; i < NARWHALYZER_MAX_SINKS; i++) {
+        sink_slot_t *slot = &sinks->slots[i];
+        if (!slot->used || slot->closing) continue;
+        if (slot->next_ns <= now_ns) {
+            if (count < 0) count = narwhalyzer_take_totals(reg, sinks->totals);
+            deliver_snapshot(sinks, slot, count, now_ns, now_ns - reg->program_start_time_ns, 0);
+        }
+        if (slot->next_ns < next_due) next_due = slot->next_ns;
+    }
+    return next_due;
+}
+
+/* Wait on the condition until the runtime clock reaches deadline_ns */
+static void wait_until(narwhalyzer_sinks_t *sinks, uint64_t deadline_ns)
+{
+    if (deadline_ns == UINT64_MAX) {
+        pthread_cond_wait(&sinks->wake, &sinks->queue_mutex);
+        return;
+    }
+
+    uint64_t now_ns = __narwhalyzer_get_timestamp_ns();
+    if (deadline_ns <= now_ns) return;
+    uint64_t wait_ns = deadline_ns - now_ns;
+
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    uint64_t ns = (uint64_t)ts.tv_nsec + wait_ns % 1000000000ULL;
+    ts.tv_sec += (time_t)(wait_ns / 1000000000ULL + ns / 1000000000ULL);
+    ts.tv_nsec = (long)(ns % 1000000000ULL);
+    pthread_cond_timedwait(&sinks->wake, &sinks->queue_mutex, &ts);
+}
+
+static void *collector_thread(void *arg)
+{
+    narwhalyzer_registry_t *reg = arg;
+    narwhalyzer_sinks_t *sinks = reg->sinks;
+
+    pthread_mutex_lock(&sinks->queue_mutex);
+    for (;;) {
+        queued_chunk_t *list = sinks->head;
+        sinks->head = sinks->tail = NULL;
+        sinks->queued_bytes = 0;
+        sinks->close_requested = 0;
+        int finishing = sinks->finishing;
+        pthread_mutex_unlock(&sinks->queue_mutex);
+
+        pthread_mutex_lock(&sinks->sink_mutex);
+        close_pending(sinks);
+        deliver_chunks(sinks, list);
+        uint64_t next_due = finishing ? UINT64_MAX : deliver_due_snapshots(reg);
+        pthread_mutex_unlock(&sinks->sink_mutex);
+
+        if (finishing) {
+            deliver_final(reg, sinks->final_elapsed_ns);
+            break;
+        }
+
+        pthread_mutex_lock(&sinks->queue_mutex);
+        sinks->next_due_ns = next_due;
+        if (!sinks->head && !sinks->finishing && !sinks->close_requested) {
+            wait_until(sinks, sinks->next_due_ns);
+        }
+    }
+    return NULL;
+}
+
+/* Caller holds queue_mutex */
+static int start_collector(narwhalyzer_registry_t *reg)
+{
+    narwhalyzer_sinks_t *sinks = reg->sinks;
+    if (sinks->running) return 0;
+
+    /* Signals meant for the application must not land on the collector */
+    sigset_t all, old;
+    sigfillset(&all);
+    pthread_sigmask(SIG_SETMASK, &all, &old);
+    int rc = pthread_create(&sinks->thread, NULL, collector_thread, reg);
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+    if (rc != 0) {
+        fprintf(stderr, "narwhalyzer: warning: cannot start sink collector thread\n");
+        return -1;
+    }
+
+    sinks->running = 1;
+    sinks->pid = getpid();
+    return 0;
+}
+
+/*
+ * The collector does not exist in a forked child and chunks queued for it
+ * belong to the parent. The child delivers its final snapshot from a new
+ * collector at exit.
+ */
+static void sinks_atfork_prepare(void)
+{
+    if (g_sinks) pthread_mutex_lock(&g_sinks->queue_mutex);
+}
+
+static void sinks_atfork_parent(void)
+{
+    if (g_sinks) pthread_mutex_unlock(&g_sinks->queue_mutex);
+}
+
+static void sinks_atfork_child(void)
+{
+    narwhalyzer_sinks_t *sinks = g_sinks;
+    if (!sinks) return;
+
+    pthread_mutex_init(&sinks->sink_mutex, NULL);
+    pthread_mutex_init(&sinks->queue_mutex, NULL);
+    pthread_cond_init(&sinks->closed, NULL);
+    sinks->close_requested = 0;
+    while (sinks->head) {
+        queued_chunk_t *next = sinks->head->next;
+        free(sinks->head);
+        sinks->head = next;
+    }
+    sinks->tail = NULL;
+    sinks->queued_bytes = 0;
+    sinks->running = 0;
+}
+
+/* ============================================================================
+ * Runtime Interface
+ * ============================================================================ */
+
+void narwhalyzer_sinks_init(narwhalyzer_registry_t *reg)
+{
+    narwhalyzer_sinks_t *sinks = calloc(1, sizeof(*sinks));
+    if (!sinks) return;
+    sinks->totals = calloc(NARWHALYZER_MAX_SECTIONS, sizeof(*sinks->totals));
+    sinks->deltas = calloc(NARWHALYZER_MAX_SECTIONS, sizeof(*sinks->deltas));
+    if (!sinks->totals || !sinks->deltas) {
+        free(sinks->totals);
+        free(sinks->deltas);
+        free(sinks);
+        return;
+    }
+
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&sinks->wake, &attr);
+    pthread_condattr_destroy(&attr);
+    pthread_cond_init(&sinks->closed, NULL);
+    pthread_mutex_init(&sinks->sink_mutex, NULL);
+    pthread_mutex_init(&sinks->queue_mutex, NULL);
+    sinks->next_due_ns = UINT64_MAX;
+
+    reg->sinks = sinks;
+    g_sinks = sinks;
+    pthread_atfork(sinks_atfork_prepare, sinks_atfork_parent, sinks_atfork_child);
+}
+
+int narwhalyzer_sinks_add(narwhalyzer_registry_t *reg, const narwhalyzer_sink_t *sink, int builtin)
+{
+    narwhalyzer_sinks_t *sinks = reg->sinks;
+    if (!sinks || !sink) return -1;
+
+    narwhalyzer_section_snapshot_t *prev = calloc(NARWHALYZER_MAX_SECTIONS, sizeof(*prev));
+    if (!prev) return -1;
+
+    pthread_mutex_lock(&sinks->sink_mutex);
+    int id = -1;
+    for (int i = 0; i < NARWHALYZER_MAX_SINKS; i++) {
+        if (!sinks->slots[i].used) {
+            id = i;
+            break;
+        }
+    }
+    if (id < 0) {
+        pthread_mutex_unlock(&sinks->sink_mutex);
+        fprintf(stderr, "narwhalyzer: warning: maximum sink count exceeded\n");
+        free(prev);
+        return -1;
+    }
+
+    sink_slot_t *slot = &sinks->slots[id];
+    memset(slot, 0, sizeof(*slot));
+    slot->used = 1;
+    slot->builtin = builtin;
+    slot->seq = sinks->next_seq++;
+    slot->sink = *sink;
+    slot->prev = prev;
+    slot->last_ns = reg->program_start_time_ns;
+    slot->next_ns = sink->interval_ms ? __narwhalyzer_get_timestamp_ns() +
+                                        sink->interval_ms * 1000000ULL : UINT64_MAX;
+    if (!builtin) sinks->user_sinks++;
+    if (sink->event_chunk) atomic_fetch_add(&sinks->chunk_sinks, 1);
+    pthread_mutex_unlock(&sinks->sink_mutex);
+
+    /* Wake the collector so it picks up the new period */
+    pthread_mutex_lock(&sinks->queue_mutex);
+    if (!builtin && !sinks->finishing) start_collector(reg);
+    if (slot->next_ns < sinks->next_due_ns) {
+        sinks->next_due_ns = slot->next_ns;
+        pthread_cond_signal(&sinks->wake);
+    }
+    pthread_mutex_unlock(&sinks->queue_mutex);
+
+    return id;
+}
+
+/*
+ * Queue a copy of a chunk just written by the trace writer. Called on the
+ * instrumented thread, so it only copies and never waits for a sink.
+ */
+void narwhalyzer_sinks_event_chunk(narwhalyzer_registry_t *reg,
+                                   const narwhalyzer_trace_chunk_header_t *header,
+                                   const narwhalyzer_trace_frame_t *frames,
+                                   const narwhalyzer_trace_event_t *events)
+{
+    narwhalyzer_sinks_t *sinks = reg->sinks;
+    if (!sinks || atomic_load_explicit(&sinks->chunk_sinks, memory_order_relaxed) == 0) {
+        return;
+    }
+
+    uint32_t count = header->open_count + header->event_count;
+    size_t bytes = sizeof(queued_chunk_t) + (size_t)count * sizeof(narwhalyzer_event_t);
+    queued_chunk_t *item = malloc(bytes);
+    if (!item) {
+        atomic_fetch_add(&sinks->dropped_chunks, 1);
+        return;
+    }
+
+    for (uint32_t i = 0; i < header->open_count; i++) {
+        item->data[i].timestamp_ns = frames[i].start_ns;
+        item->data[i].section = frames[i].section;
+        item->data[i].kind = NARWHALYZER_EVENT_ENTER;
+    }
+    memcpy(item->data + header->open_count, events,
+           (size_t)header->event_count * sizeof(narwhalyzer_event_t));
+    item->next = NULL;
+    item->bytes = bytes;
+    item->chunk.tid = header->tid;
+    item->chunk.sequence = header->sequence;
+    item->chunk.open_count = header->open_count;
+    item->chunk.open = item->data;
+    item->chunk.event_count = header->event_count;
+    item->chunk.events = item->data + header->open_count;
+
+    pthread_mutex_lock(&sinks->queue_mutex);
+    if (!sinks->running || sinks->finishing ||
+        sinks->queued_bytes + bytes > NARWHALYZER_SINK_QUEUE_BYTES) {
+        pthread_mutex_unlock(&sinks->queue_mutex);
+        atomic_fetch_add(&sinks->dropped_chunks, 1);
+        free(item);
+        return;
+    }
+    if (sinks->tail) sinks->tail->next = item;
+    else sinks->head = item;
+    sinks->tail = item;
+    sinks->queued_bytes += bytes;
+    pthread_cond_signal(&sinks->wake);
+    pthread_mutex_unlock(&sinks->queue_mutex);
+}
+
+/*
+ * Deliver the final snapshot and close all sinks. User sinks get it from
+ * the collector thread, started now if this process has none (e.g. in a
+ * forked child); with only built-in sinks it is delivered directly.
+ */
+void narwhalyzer_sinks_finish(narwhalyzer_registry_t *reg, uint64_t elapsed_ns)
+{
+    narwhalyzer_sinks_t *sinks = reg->sinks;
+    if (!sinks) return;
+
+    pthread_mutex_lock(&sinks->queue_mutex);
+    if (sinks->finishing) {
+        pthread_mutex_unlock(&sinks->queue_mutex);
+        return;
+    }
+    sinks->final_elapsed_ns = elapsed_ns;
+    if (sinks->user_sinks > 0 && start_collector(reg) == 0) {
+        sinks->finishing = 1;
+        pthread_cond_signal(&sinks->wake);
+        pthread_mutex_unlock(&sinks->queue_mutex);
+        pthread_join(sinks->thread, NULL);
+        return;
+    }
+    sinks->finishing = 1;
+    pthread_mutex_unlock(&sinks->queue_mutex);
+
+    deliver_final(reg, elapsed_ns);
+}
+
+/* ============================================================================
+ * Public API
+ * ============================================================================ */
+
+int narwhalyzer_register_sink(const narwhalyzer_sink_t *sink)
+{
+    if (!__narwhalyzer_is_initialized()) {
+        __narwhalyzer_init();
+    }
+    if (!g_registry || !sink || (!sink->snapshot && !sink->event_chunk)) {
+        return -1;
+    }
+    return narwhalyzer_sinks_add(g_registry, sink, 0);
+}
+
+/*
+ * Mark the sink closing and let the collector close it, so the close
+ * callback runs on the collector like every other callback. Without a
+ * collector (it could not be started) the sink is closed here.
+ */
+void narwhalyzer_unregister_sink(int id)
+{
+    narwhalyzer_sinks_t *sinks = g_registry ? g_registry->sinks : NULL;
+    if (!sinks || id < 0 || id >= NARWHALYZER_MAX_SINKS) {
+        return;
+    }
+
+    pthread_mutex_lock(&sinks->sink_mutex);
+    sink_slot_t *slot = &sinks->slots[id];
+    if (!slot->used || slot->builtin || slot->closing) {
+        pthread_mutex_unlock(&sinks->sink_mutex);
+        return;
+    }
+    slot->closing = 1;
+    uint64_t seq = slot->seq;
+    pthread_mutex_unlock(&sinks->sink_mutex);
+
+    pthread_mutex_lock(&sinks->queue_mutex);
+    int running = sinks->finishing ? sinks->running : start_collector(g_registry) == 0;
+    if (running) {
+        sinks->close_requested = 1;
+        pthread_cond_signal(&sinks->wake);
+    }
+    pthread_mutex_unlock(&sinks->queue_mutex);
+
+    pthread_mutex_lock(&sinks->sink_mutex);
+    if (!running) {
+        if (slot->used && slot->seq == seq) close_slot(sinks, slot);
+    } else {
+        while (slot->used && slot->seq == seq) {
+            pthread_cond_wait(&sinks->closed, &sinks->sink_mutex);
+        }
+    }
+    pthread_mutex_unlock(&sinks->sink_mutex);
+}
@@ -0,0 +1,36 @@
+/*
+ * narwhalyzer_startup.h
+ *
+ * Record format shared by the startup audit module (narwhalyzer_audit.c)
+ * and the runtime. The audit module runs inside the dynamic loader before
+ * any constructor, so it cannot call into the runtime; it appends fixed-size
+ * records to an anonymous memory file that the runtime reads at exit.
+ *
+ * Copyright (c) 2026
+ * Licensed under GPL-3.0 License
+ */
+
+#ifndef NARWHALYZER_STARTUP_H
+#define NARWHALYZER_STARTUP_H
+
+#include <stdint.h>
+
+/* Name of the memfd holding the records, as seen in /proc/self/fd */
+#define NARWHALYZER_STARTUP_MEMFD_NAME   "narwhalyzer-startup"
+
+#define NARWHALYZER_STARTUP_NAME_SIZE    240
+
+/* Record kinds */
+#define NARWHALYZER_STARTUP_AUDIT_BEGIN  1  /* Audit module loaded (la_version) */
+#define NARWHALYZER_STARTUP_OBJECT_OPEN  2  /* Object mapped (la_objopen), name set */
+#define NARWHALYZER_STARTUP_CONSISTENT   3  /* Link map consistent (la_activity) */
+#define NARWHALYZER_STARTUP_PREINIT      4  /* Constructors done, main next (la_preinit) */
+
+typedef struct narwhalyzer_startup_record {
+    uint64_t timestamp_ns;              /* CLOCK_MONOTONIC_RAW */
+    uint32_t kind;
+    uint32_t reserved;
+    char name[NARWHALYZER_STARTUP_NAME_SIZE];
+} narwhalyzer_startup_record_t;
+
+#endif /* NARWHALYZER_STARTUP_H */
@@ -0,0 +1,468 @@
+/*
+ * narwhalyzer_trace.c
+ *
+ * Event trace writer. With NARWHALYZER_TRACE=<path>, every section entry
+ * and exit is appended to a per-thread buffer. Full buffers are written as
+ * self-contained chunks; only the offset reservation is serialized, so
+ * threads never wait for each other's writes. At exit the section table,
+ * an index of all chunks and a footer are appended (see
+ * narwhalyzer_trace_format.h).
+ *
+ * Copyright (c) 2026
+ * Licensed under GPL-3.0 License
+ */
+
+#define _GNU_SOURCE
+#include "narwhalyzer_internal.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+
+/* Default buffer size per thread (NARWHALYZER_TRACE_BUFFER_KB) */
+#define NARWHALYZER_TRACE_DEFAULT_BUFFER_KB  1024
+
+struct narwhalyzer_trace {
+    int fd;
+    uint32_t event_capacity;            /* Events per chunk */
+    pthread_mutex_t mutex;              /* Protects everything below */
+    int closed;                         /* Footer written, no more chunks */
+    uint64_t offset;                    /* Next free byte in the file */
+    narwhalyzer_trace_index_entry_t *index;
+    uint64_t index_count;
+    uint64_t index_capacity;
+    uint32_t pid;                       /* Process writing this file */
+    char path[4096];
+    char pattern[4096];                 /* NARWHALYZER_TRACE, for forked children */
+};
+
+/* ============================================================================
+ * Internal Utilities
+ * ============================================================================ */
+
+/*
+ * Read both clocks back to back.
+ */
+static narwhalyzer_trace_clock_pair_t read_clock_pair(void)
+{
+    narwhalyzer_trace_clock_pair_t pair;
+    struct timespec real;
+
+    pair.monotonic_ns = __narwhalyzer_get_timestamp_ns();
+    clock_gettime(CLOCK_REALTIME, &real);
+    pair.realtime_ns = (uint64_t)real.tv_sec * 1000000000ULL + (uint64_t)real.tv_nsec;
+
+    return pair;
+}
+
+/*
+ * Append the process id at out + used. Returns the new length, or
+ * out_size if it does not fit. Async-signal-safe, unlike snprintf.
+ */
+static size_t append_pid(char *out, size_t used, size_t out_size)
+{
+    char digits[16];
+    size_t n = 0;
+
+    for (unsigned int pid = (unsigned int)getpid(); n == 0 || pid; pid /= 10) {
+        digits[n++] = (char)('0' + pid % 10);
+    }
+    if (used + n >= out_size) return out_size;
+    while (n > 0) {
+        out[used++] = digits[--n];
+    }
+    return used;
+}
+
+/*
+ * Expand %p in an output path to the process id. A forked child must not
+ * reuse its parent's file, so it gets a .<pid> suffix if there is no %p.
+ * Async-signal-safe, so the trace writer can use it in a forked child.
+ */
+void narwhalyzer_expand_path(const char *pattern, char *out, size_t out_size, int forked)
+{
+    size_t used = 0;
+    int has_pid = 0;
+
+    for (const char *p = pattern; *p && used + 1 < out_size; p++) {
+        if (p[0] == '%' && p[1] == 'p') {
+            size_t n = append_pid(out, used, out_size);
+            if (n == out_size) break;
+            used = n;
+            has_pid = 1;
+            p++;
+        } else {
+            out[used++] = *p;
+        }
+    }
+
+    out[used] = '\0';
+
+    if (forked && !has_pid && used + 2 < out_size) {
+        out[used] = '.';
+        size_t n = append_pid(out, used + 1, out_size);
+        if (n != out_size) out[n] = '\0';
+        else out[used] = '\0';
+    }
+}
+
+/*
+ * Write a whole buffer at a given offset.
+ */
+static int write_at(int fd, const void *data, size_t size, uint64_t offset)
+{
+    const char *p = data;
+
+    while (size > 0) {
+        ssize_t n = pwrite(fd, p, size, (off_t)offset);
+        if (n <= 0) return -1;
+        p += n;
+        size -= (size_t)n;
+        offset += (uint64_t)n;
+    }
+
+    return 0;
+}
+
+/*
+ * Record the sections open on the thread as the start state of a chunk.
+ * Only the outermost frames are kept if they do not fit; open_depth still
+ * tells readers how deep the stack was.
+ */
+static void start_chunk(narwhalyzer_thread_state_t *ts)
+{
+    narwhalyzer_trace_buffer_t *buf = ts->trace_buffer;
+    uint32_t depth = (uint32_t)(ts->context_stack_top + 1);
+    uint32_t stored = depth < buf->frame_capacity ? depth : buf->frame_capacity;
+
+    for (uint32_t i = 0; i < stored; i++) {
+        narwhalyzer_context_t *ctx = context_at(ts, (int)i);
+        buf->frames[i].section = (uint32_t)ctx->section_index;
+        buf->frames[i].reserved = 0;
+        buf->frames[i].start_ns = ctx->start_time_ns;
+    }
+
+    buf->header.open_depth = depth;
+    buf->header.open_count = stored;
+    buf->event_count = 0;
+}
+
+/*
+ * Create the trace file at trace->path and write its header. Prints
+ * nothing, as it also runs in a forked child.
+ * Returns 0 on success, -1 if the file cannot be opened, -2 if the
+ * header cannot be written.
+ */
+static int create_trace_file(narwhalyzer_trace_t *trace, uint32_t parent_pid)
+{
+    trace->fd = open(trace->path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (trace->fd < 0) {
+        return -1;
+    }
+
+    narwhalyzer_trace_file_header_t header;
+    memset(&header, 0, sizeof(header));
+    header.magic = NARWHALYZER_TRACE_MAGIC;
+    header.version = NARWHALYZER_TRACE_VERSION;
+    header.header_size = sizeof(header);
+    header.pid = trace->pid;
+    header.parent_pid = parent_pid;
+    header.start_clock = read_clock_pair();
+
+    if (write_at(trace->fd, &header, sizeof(header), 0) != 0) {
+        close(trace->fd);
+        trace->fd = -1;
+        return -2;
+    }
+
+    trace->offset = sizeof(header);
+    return 0;
+}
+
+/* ============================================================================
+ * Fork Handling
+ * ============================================================================ */
+
+/*
+ * No chunk reservation may be in progress while the process forks, or the
+ * child would inherit a locked mutex.
+ */
+static void trace_atfork_prepare(void)
+{
+    narwhalyzer_trace_t *trace = g_registry ? g_registry->trace : NULL;
+    if (trace) pthread_mutex_lock(&trace->mutex);
+}
+
+static void trace_atfork_parent(void)
+{
+    narwhalyzer_trace_t *trace = g_registry ? g_registry->trace : NULL;
+    if (trace) pthread_mutex_unlock(&trace->mutex);
+}
+
+/*
+ * Give the child its own trace file. The events buffered at fork time
+ * belong to the parent, which still writes them; the child starts a new
+ * chunk from its current stack, so sections open across fork() close in
+ * the child's trace as well. The parent may have had other threads, so
+ * only async-signal-safe calls are made here.
+ */
+static void trace_atfork_child(void)
+{
+    narwhalyzer_registry_t *reg = g_registry;
+    narwhalyzer_trace_t *trace = reg ? reg->trace : NULL;
+    if (!trace) return;
+
+    pthread_mutex_init(&trace->mutex, NULL);
+    if (trace->closed || trace->fd < 0) return;
+
+    close(trace->fd);
+    trace->index_count = 0;
+
+    uint32_t parent_pid = trace->pid;
+    trace->pid = (uint32_t)getpid();
+    narwhalyzer_expand_path(trace->pattern, trace->path, sizeof(trace->path), 1);
+    if (create_trace_file(trace, parent_pid) != 0) {
+        static const char msg[] = "narwhalyzer: warning: cannot create trace file in forked child\n";
+        ssize_t n = write(STDERR_FILENO, msg, sizeof(msg) - 1);
+        (void)n;
+        trace->closed = 1;
+        return;
+    }
+
+    narwhalyzer_thread_state_t *ts = pthread_getspecific(reg->thread_key);
+    if (ts && ts->trace_buffer) {
+        ts->trace_buffer->header.tid = (uint32_t)syscall(SYS_gettid);
+        ts->trace_buffer->header.sequence = 0;
+        start_chunk(ts);
+    }
+}
+
+/* ============================================================================
+ * Trace Writer
+ * ============================================================================ */
+
+/*
+ * Open the trace file named by NARWHALYZER_TRACE.
+ */
+void narwhalyzer_trace_open(narwhalyzer_registry_t *reg)
+{
+    const char *pattern = getenv("NARWHALYZER_TRACE");
+    if (!pattern || !*pattern) {
+        return;
+    }
+
+    narwhalyzer_trace_t *trace = calloc(1, sizeof(narwhalyzer_trace_t));
+    if (!trace) return;
+
+    snprintf(trace->pattern, sizeof(trace->pattern), "%s", pattern);
+    narwhalyzer_expand_path(trace->pattern, trace->path, sizeof(trace->path), 0);
+    trace->pid = (uint32_t)getpid();
+    int rc = create_trace_file(trace, 0);
+    if (rc != 0) {
+        fprintf(stderr, "narwhalyzer: warning: cannot %s trace file %s\n",
+                rc == -1 ? "open" : "write", trace->path);
+        free(trace);
+        return;
+    }
+
+    uint64_t buffer_kb = NARWHALYZER_TRACE_DEFAULT_BUFFER_KB;
+    const char *env = getenv("NARWHALYZER_TRACE_BUFFER_KB");
+    if (env && atoi(env) > 0) {
+        buffer_kb = (uint64_t)atoi(env);
+    }
+    trace->event_capacity = (uint32_t)(buffer_kb * 1024 / sizeof(narwhalyzer_trace_event_t));
+    if (trace->event_capacity < 64) {
+        trace->event_capacity = 64;
+    }
+    pthread_mutex_init(&trace->mutex, NULL);
+
+    reg->trace = trace;
+    pthread_atfork(trace_atfork_prepare, trace_atfork_parent, trace_atfork_child);
+}
+
+/*
+ * Attach a trace buffer to a new thread.
+ */
+void narwhalyzer_trace_thread_start(narwhalyzer_registry_t *reg, narwhalyzer_thread_state_t *ts)
+{
+    narwhalyzer_trace_t *trace = reg->trace;
+    if (!trace || trace->closed) return;
+
+    narwhalyzer_trace_buffer_t *buf = calloc(1, sizeof(narwhalyzer_trace_buffer_t));
+    if (!buf) return;
+
+    /* Open frames may use up to a quarter of the chunk */
+    buf->event_capacity = trace->event_capacity;
+    buf->frame_capacity = trace->event_capacity / 4;
+    buf->events = malloc((size_t)buf->event_capacity * sizeof(narwhalyzer_trace_event_t));
+    buf->frames = malloc((size_t)buf->frame_capacity * sizeof(narwhalyzer_trace_frame_t));
+    if (!buf->events || !buf->frames) {
+        free(buf->events);
+        free(buf->frames);
+        free(buf);
+        return;
+    }
+
+    buf->header.magic = NARWHALYZER_TRACE_CHUNK_MAGIC;
+    buf->header.tid = (uint32_t)syscall(SYS_gettid);
+
+    ts->trace_buffer = buf;
+    start_chunk(ts);
+}
+
+/*
+ * Write the buffered events as one chunk and start the next chunk.
+ */
+void narwhalyzer_trace_flush(narwhalyzer_registry_t *reg, narwhalyzer_thread_state_t *ts)
+{
+    narwhalyzer_trace_t *trace = reg->trace;
+    narwhalyzer_trace_buffer_t *buf = ts->trace_buffer;
+    if (!trace || !buf || buf->event_count == 0) return;
+
+    narwhalyzer_trace_chunk_header_t *header = &buf->header;
+    header->event_count = buf->event_count;
+    header->t_min = buf->events[0].timestamp_ns;
+    header->t_max = buf->events[buf->event_count - 1].timestamp_ns;
+    header->clock = read_clock_pair();
+
+    size_t frames_size = (size_t)header->open_count * sizeof(narwhalyzer_trace_frame_t);
+    size_t events_size = (size_t)buf->event_count * sizeof(narwhalyzer_trace_event_t);
+    header->size = sizeof(*header) + frames_size + events_size;
+
+    /* Reserve space and index the chunk; the write itself is unlocked */
+    pthread_mutex_lock(&trace->mutex);
+    if (trace->closed) {
+        /* The footer is already written: late events are dropped */
+        pthread_mutex_unlock(&trace->mutex);
+        buf->event_count = 0;
+        return;
+    }
+    uint64_t offset = trace->offset;
+    trace->offset += header->size;
+    if (trace->index_count == trace->index_capacity) {
+        uint64_t capacity = trace->index_capacity ? 2 * trace->index_capacity : 256;
+        narwhalyzer_trace_index_entry_t *index =
+            realloc(trace->index, capacity * sizeof(narwhalyzer_trace_index_entry_t));
+        if (index) {
+            trace->index = index;
+            trace->index_capacity = capacity;
+        }
+    }
+    if (trace->index_count < trace->index_capacity) {
+        narwhalyzer_trace_index_entry_t *entry = &trace->index[trace->index_count++];
+        entry->offset = offset;
+        entry->size = header->size;
+        entry->t_min = header->t_min;
+        entry->t_max = header->t_max;
+        entry->tid = header->tid;
+        entry->event_count = header->event_count;
+    }
+    pthread_mutex_unlock(&trace->mutex);
+
+    struct iovec iov[3] = {
+        { header, sizeof(*header) },
+        { buf->frames, frames_size },
+        { buf->events, events_size },
+    };
+    ssize_t written = pwritev(trace->fd, iov, 3, (off_t)offset);
+    if (written != (ssize_t)header->size) {
+        fprintf(stderr, "narwhalyzer: warning: short write to trace file %s\n", trace->path);
+    }
+    narwhalyzer_sinks_event_chunk(reg, header, buf->frames, buf->events);
+
+    header->sequence++;
+    start_chunk(ts);
+}
+
+/*
+ * Flush and release the thread's trace buffer.
+ */
+void narwhalyzer_trace_thread_end(narwhalyzer_registry_t *reg, narwhalyzer_thread_state_t *ts)
+{
+    narwhalyzer_trace_buffer_t *buf = ts->trace_buffer;
+    if (!buf) return;
+
+    narwhalyzer_trace_flush(reg, ts);
+
+    ts->trace_buffer = NULL;
+    free(buf->events);
+    free(buf->frames);
+    free(buf);
+}
+
+/*
+ * Flush the calling thread and append the section table, index and footer.
+ * Threads still running keep their buffers; their later events are dropped.
+ */
+void narwhalyzer_trace_close(narwhalyzer_registry_t *reg, narwhalyzer_thread_state_t *ts)
+{
+    narwhalyzer_trace_t *trace = reg->trace;
+    if (!trace) return;
+
+    if (ts) {
+        narwhalyzer_trace_flush(reg, ts);
+    }
+
+    /* Section table: entries followed by the string blob */
+    int section_count = atomic_load(&reg->section_count);
+    size_t entries_size = (size_t)section_count * sizeof(narwhalyzer_trace_section_entry_t);
+    size_t blob_size = 0;
+    for (int i = 0; i < section_count; i++) {
+        const char *file = reg->sections[i].file ? reg->sections[i].file : "";
+        blob_size += strlen(reg->sections[i].name) + 1 + strlen(file) + 1;
+    }
+
+    char *table = calloc(1, entries_size + blob_size);
+    if (!table) {
+        fprintf(stderr, "narwhalyzer: warning: cannot write trace index to %s\n", trace->path);
+        return;
+    }
+    narwhalyzer_trace_section_entry_t *entries = (narwhalyzer_trace_section_entry_t *)table;
+    char *blob = table + entries_size;
+    size_t used = 0;
+    for (int i = 0; i < section_count; i++) {
+        narwhalyzer_section_stats_t *s = &reg->sections[i];
+        const char *file = s->file ? s->file : "";
+
+        entries[i].name_offset = (uint32_t)used;
+        strcpy(blob + used, s->name);
+        used += strlen(s->name) + 1;
+        entries[i].file_offset = (uint32_t)used;
+        strcpy(blob + used, file);
+        used += strlen(file) + 1;
+        entries[i].line = s->line;
+        entries[i].parent_index = s->parent_index;
+    }
+
+    narwhalyzer_trace_footer_t footer;
+    memset(&footer, 0, sizeof(footer));
+    footer.section_table_size = entries_size + blob_size;
+    footer.section_count = (uint32_t)section_count;
+
+    /* No chunk can be reserved past the footer once closed is set */
+    pthread_mutex_lock(&trace->mutex);
+    trace->closed = 1;
+    footer.index_count = trace->index_count;
+    size_t index_size = trace->index_count * sizeof(narwhalyzer_trace_index_entry_t);
+    uint64_t offset = trace->offset;
+    trace->offset += footer.section_table_size + index_size + sizeof(footer);
+    pthread_mutex_unlock(&trace->mutex);
+
+    footer.section_table_offset = offset;
+    footer.index_offset = offset + footer.section_table_size;
+    footer.end_clock = read_clock_pair();
+    footer.magic = NARWHALYZER_TRACE_FOOTER_MAGIC;
+
+    if (write_at(trace->fd, table, footer.section_table_size, footer.section_table_offset) != 0 ||
+        write_at(trace->fd, trace->index, index_size, footer.index_offset) != 0 ||
+        write_at(trace->fd, &footer, sizeof(footer), footer.index_offset + index_size) != 0) {
+        fprintf(stderr, "narwhalyzer: warning: cannot write trace index to %s\n", trace->path);
+    }
+
+    free(table);
+}
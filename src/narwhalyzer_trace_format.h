@@ -0,0 +1,120 @@
+/*
+ * narwhalyzer_trace_format.h
+ *
+ * On-disk format of Narwhalyzer trace files, shared by the runtime writer
+ * (narwhalyzer_trace.c) and the trace tools. All integers are stored in
+ * the byte order of the machine that wrote the trace.
+ *
+ * Layout:
+ *
+ *   file header
+ *   chunk 0 .. chunk N-1        written by any thread, in any order
+ *   section table               names and locations of the sections
+ *   chunk index                 one entry per chunk
+ *   footer                      fixed size, at the very end of the file
+ *
+ * Each chunk holds the events of one thread over a time range and starts
+ * with a snapshot of that thread's open sections, so a chunk can be decoded
+ * on its own. The footer locates the index; a trace whose process died
+ * before writing it can still be read by walking the chunk headers.
+ *
+ * Copyright (c) 2026
+ * Licensed under GPL-3.0 License
+ */
+
+#ifndef NARWHALYZER_TRACE_FORMAT_H
+#define NARWHALYZER_TRACE_FORMAT_H
+
+#include <stdint.h>
+
+#define NARWHALYZER_TRACE_MAGIC          0x314352544c48574eULL  /* "NWHLTRC1" */
+#define NARWHALYZER_TRACE_FOOTER_MAGIC   0x315844494c48574eULL  /* "NWHLIDX1" */
+#define NARWHALYZER_TRACE_CHUNK_MAGIC    0x4b43574eu            /* "NWCK" */
+#define NARWHALYZER_TRACE_VERSION        1
+
+/* Event kinds */
+#define NARWHALYZER_TRACE_ENTER          1
+#define NARWHALYZER_TRACE_EXIT           2
+
+/*
+ * A pair of clock readings taken back to back. Event timestamps use the
+ * runtime's monotonic clock; pairs let tools map them to wall-clock time
+ * and align traces written by different processes.
+ */
+typedef struct narwhalyzer_trace_clock_pair {
+    uint64_t monotonic_ns;
+    uint64_t realtime_ns;
+} narwhalyzer_trace_clock_pair_t;
+
+typedef struct narwhalyzer_trace_file_header {
+    uint64_t magic;                     /* NARWHALYZER_TRACE_MAGIC */
+    uint32_t version;                   /* NARWHALYZER_TRACE_VERSION */
+    uint32_t header_size;               /* sizeof(narwhalyzer_trace_file_header_t) */
+    uint32_t pid;
+    uint32_t parent_pid;                /* Writer of the parent trace after fork(), else 0 */
+    narwhalyzer_trace_clock_pair_t start_clock;
+} narwhalyzer_trace_file_header_t;
+
+/* Section open when a chunk starts */
+typedef struct narwhalyzer_trace_frame {
+    uint32_t section;
+    uint32_t reserved;
+    uint64_t start_ns;
+} narwhalyzer_trace_frame_t;
+
+typedef struct narwhalyzer_trace_event {
+    uint64_t timestamp_ns;
+    uint32_t section;                   /* Index into the section table */
+    uint32_t kind;                      /* NARWHALYZER_TRACE_ENTER or _EXIT */
+} narwhalyzer_trace_event_t;
+
+/*
+ * Chunk header, followed by open_count frames and event_count events.
+ * Events are in timestamp order within a chunk.
+ */
+typedef struct narwhalyzer_trace_chunk_header {
+    uint32_t magic;                     /* NARWHALYZER_TRACE_CHUNK_MAGIC */
+    uint32_t tid;
+    uint64_t size;                      /* Whole chunk in bytes, header included */
+    uint64_t t_min;                     /* First event timestamp */
+    uint64_t t_max;                     /* Last event timestamp */
+    uint32_t event_count;
+    uint32_t open_count;                /* Frames stored after the header */
+    uint32_t open_depth;                /* Open sections at chunk start (> open_count if truncated) */
+    uint32_t sequence;                  /* Chunk number within the thread */
+    narwhalyzer_trace_clock_pair_t clock; /* Taken when the chunk was written */
+} narwhalyzer_trace_chunk_header_t;
+
+/* Index entry, one per chunk */
+typedef struct narwhalyzer_trace_index_entry {
+    uint64_t offset;                    /* Chunk header offset in the file */
+    uint64_t size;
+    uint64_t t_min;
+    uint64_t t_max;
+    uint32_t tid;
+    uint32_t event_count;
+} narwhalyzer_trace_index_entry_t;
+
+/*
+ * Section table entry. Names are stored in a string blob that follows the
+ * entries; offsets are relative to the start of the blob.
+ */
+typedef struct narwhalyzer_trace_section_entry {
+    uint32_t name_offset;
+    uint32_t file_offset;
+    int32_t line;
+    int32_t parent_index;
+} narwhalyzer_trace_section_entry_t;
+
+typedef struct narwhalyzer_trace_footer {
+    uint64_t section_table_offset;
+    uint64_t section_table_size;        /* Entries and string blob */
+    uint32_t section_count;
+    uint32_t reserved;
+    uint64_t index_offset;
+    uint64_t index_count;
+    narwhalyzer_trace_clock_pair_t end_clock;
+    uint64_t magic;                     /* NARWHALYZER_TRACE_FOOTER_MAGIC, last */
+} narwhalyzer_trace_footer_t;
+
+#endif /* NARWHALYZER_TRACE_FORMAT_H */
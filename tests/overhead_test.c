@@ -0,0 +1,326 @@
+/*
+ * overhead_test.c
+ *
+ * Overhead regression test. Measures the runtime's per-call cost and the
+ * slowdown of reference kernels under instrumentation, and fails when a
+ * measurement exceeds its limit in overhead_thresholds.txt.
+ *
+ * Noise only ever makes a loop slower, so each measurement is the minimum
+ * over several repetitions, and a measurement above its limit is retried:
+ * the test fails only if every attempt exceeds the limit. A genuine
+ * regression fails all attempts; a noisy neighbour rarely does.
+ *
+ * Usage:
+ *   narwhalyzer_overhead_test <thresholds-file>
+ *
+ * Copyright (c) 2026
+ * Licensed under GPL-3.0 License
+ */
+
+#define _GNU_SOURCE
+#include "narwhalyzer.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+#define OVERHEAD_REPEAT          7       /* Repetitions per attempt, minimum kept */
+#define OVERHEAD_ATTEMPTS        3       /* Attempts before a limit counts as exceeded */
+#define OVERHEAD_PAIRS           200000  /* Enter/exit pairs per repetition */
+#define OVERHEAD_KERNEL_CALLS    5000    /* Kernel calls per repetition */
+#define OVERHEAD_KERNEL_WORK     400     /* Inner iterations, about 1 us per call */
+#define OVERHEAD_THREADS         4
+#define OVERHEAD_NESTING         8
+#define OVERHEAD_MAX_CHECKS      32
+
+typedef struct threshold {
+    char name[64];
+    double limit;
+} threshold_t;
+
+static int g_section;
+static int g_nested[OVERHEAD_NESTING];
+static volatile double g_sink;
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+/* ============================================================================
+ * Measurements
+ * ============================================================================ */
+
+static void loop_empty(void)
+{
+    for (int i = 0; i < OVERHEAD_PAIRS; i++) {
+        __asm__ volatile("" : : : "memory");
+    }
+}
+
+static void loop_pairs(void)
+{
+    for (int i = 0; i < OVERHEAD_PAIRS; i++) {
+        __narwhalyzer_section_exit(__narwhalyzer_section_enter(g_section));
+    }
+}
+
+static void loop_dynamic(void)
+{
+    for (int i = 0; i < OVERHEAD_PAIRS; i++) {
+        __narwhalyzer_section_exit(narwhalyzer_enter_name("overhead:dynamic"));
+    }
+}
+
+static void loop_nested(void)
+{
+    int ctx[OVERHEAD_NESTING];
+    for (int i = 0; i < OVERHEAD_PAIRS / OVERHEAD_NESTING; i++) {
+        for (int k = 0; k < OVERHEAD_NESTING; k++) {
+            ctx[k] = __narwhalyzer_section_enter(g_nested[k]);
+        }
+        for (int k = OVERHEAD_NESTING - 1; k >= 0; k--) {
+            __narwhalyzer_section_exit(ctx[k]);
+        }
+    }
+}
+
+static void loop_clock(void)
+{
+    uint64_t sum = 0;
+    for (int i = 0; i < OVERHEAD_PAIRS; i++) {
+        sum += __narwhalyzer_get_timestamp_ns();
+    }
+    g_sink = (double)sum;
+}
+
+/* Reference kernel: a short dot product, the size of a typical leaf function */
+__attribute__((noinline)) static double kernel(int seed)
+{
+    double a = seed, b = 1.0, sum = 0.0;
+    for (int i = 0; i < OVERHEAD_KERNEL_WORK; i++) {
+        sum += a * b;
+        a = a * 0.999 + 1.0;
+        b = b * 1.001 - 0.5;
+    }
+    return sum;
+}
+
+static void loop_kernel(void)
+{
+    double sum = 0.0;
+    for (int i = 0; i < OVERHEAD_KERNEL_CALLS; i++) {
+        sum += kernel(i);
+    }
+    g_sink = sum;
+}
+
+static void loop_kernel_instrumented(void)
+{
+    double sum = 0.0;
+    for (int i = 0; i < OVERHEAD_KERNEL_CALLS; i++) {
+        int ctx = __narwhalyzer_section_enter(g_section);
+        sum += kernel(i);
+        __narwhalyzer_section_exit(ctx);
+    }
+    g_sink = sum;
+}
+
+static void *thread_main(void *arg)
+{
+    ((void (*)(void))arg)();
+    return NULL;
+}
+
+/* Wall time of fn on OVERHEAD_THREADS concurrent threads */
+static uint64_t time_threads(void (*fn)(void))
+{
+    pthread_t threads[OVERHEAD_THREADS];
+    uint64_t start = now_ns();
+    for (int t = 0; t < OVERHEAD_THREADS; t++) {
+        if (pthread_create(&threads[t], NULL, thread_main, (void *)fn) != 0) {
+            fprintf(stderr, "overhead_test: cannot create thread\n");
+            exit(2);
+        }
+    }
+    for (int t = 0; t < OVERHEAD_THREADS; t++) {
+        pthread_join(threads[t], NULL);
+    }
+    return now_ns() - start;
+}
+
+/* Minimum time of fn over the repetitions, on this thread or on several */
+static double min_time(void (*fn)(void), int threaded)
+{
+    double best = 0.0;
+    for (int r = 0; r < OVERHEAD_REPEAT; r++) {
+        uint64_t elapsed;
+        if (threaded) {
+            elapsed = time_threads(fn);
+        } else {
+            uint64_t start = now_ns();
+            fn();
+            elapsed = now_ns() - start;
+        }
+        if (r == 0 || (double)elapsed < best) best = (double)elapsed;
+    }
+    return best;
+}
+
+/* Nanoseconds per pair, with the empty loop subtracted */
+static double per_pair(void (*fn)(void))
+{
+    return (min_time(fn, 0) - min_time(loop_empty, 0)) / OVERHEAD_PAIRS;
+}
+
+static double slowdown_pct(void (*instrumented)(void), void (*plain)(void), int threaded)
+{
+    double base = min_time(plain, threaded);
+    return base > 0.0 ? 100.0 * (min_time(instrumented, threaded) - base) / base : 0.0;
+}
+
+static double check_pair(void)
+{
+    return per_pair(loop_pairs);
+}
+
+static double check_dynamic_pair(void)
+{
+    return per_pair(loop_dynamic);
+}
+
+static double check_nested_pair(void)
+{
+    return per_pair(loop_nested);
+}
+
+/* Machine-independent: the pair's cost in units of one clock read */
+static double check_pair_clock_reads(void)
+{
+    double clock_ns = per_pair(loop_clock);
+    return clock_ns > 0.0 ? per_pair(loop_pairs) / clock_ns : 0.0;
+}
+
+static double check_kernel_slowdown(void)
+{
+    return slowdown_pct(loop_kernel_instrumented, loop_kernel, 0);
+}
+
+static double check_threaded_kernel_slowdown(void)
+{
+    return slowdown_pct(loop_kernel_instrumented, loop_kernel, 1);
+}
+
+static const struct {
+    const char *name;
+    double (*measure)(void);
+} g_checks[] = {
+    { "pair_ns", check_pair },
+    { "dynamic_pair_ns", check_dynamic_pair },
+    { "nested_pair_ns", check_nested_pair },
+    { "pair_clock_reads", check_pair_clock_reads },
+    { "kernel_slowdown_pct", check_kernel_slowdown },
+    { "threaded_kernel_slowdown_pct", check_threaded_kernel_slowdown },
+};
+
+/* ============================================================================
+ * Thresholds
+ * ============================================================================ */
+
+/*
+ * Read "name limit" lines; '#' starts a comment.
+ * Returns the number of thresholds, -1 on error.
+ */
+static int read_thresholds(const char *path, threshold_t *thresholds, int max)
+{
+    FILE *f = fopen(path, "r");
+    if (!f) {
+        fprintf(stderr, "overhead_test: cannot open '%s'\n", path);
+        return -1;
+    }
+
+    int count = 0, line_no = 0;
+    char line[256];
+    while (fgets(line, sizeof(line), f)) {
+        line_no++;
+        char *comment = strchr(line, '#');
+        if (comment) *comment = '\0';
+
+        char name[64];
+        double limit;
+        char extra;
+        int fields = sscanf(line, "%63s %lf %c", name, &limit, &extra);
+        if (fields <= 0) continue;
+        if (fields != 2 || count == max) {
+            fprintf(stderr, "overhead_test: %s:%d: expected 'name limit'\n", path, line_no);
+            fclose(f);
+            return -1;
+        }
+        strcpy(thresholds[count].name, name);
+        thresholds[count].limit = limit;
+        count++;
+    }
+    fclose(f);
+    return count;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc != 2) {
+        fprintf(stderr, "Usage: %s <thresholds-file>\n", argv[0]);
+        return 2;
+    }
+
+    threshold_t thresholds[OVERHEAD_MAX_CHECKS];
+    int count = read_thresholds(argv[1], thresholds, OVERHEAD_MAX_CHECKS);
+    if (count < 0) {
+        return 2;
+    }
+
+    g_section = __narwhalyzer_register_section("overhead:pair", __FILE__, __LINE__);
+    for (int k = 0; k < OVERHEAD_NESTING; k++) {
+        char name[32];
+        snprintf(name, sizeof(name), "overhead:nested%d", k);
+        g_nested[k] = __narwhalyzer_register_section(name, __FILE__, k);
+    }
+
+    /* Unmeasured round: thread state, name cache, page faults */
+    loop_pairs();
+    loop_dynamic();
+    loop_nested();
+
+    int failed = 0;
+    fprintf(stderr, "%-30s %12s %12s  %s\n", "check", "measured", "limit", "result");
+    for (int i = 0; i < count; i++) {
+        double (*fn)(void) = NULL;
+        for (size_t c = 0; c < sizeof(g_checks) / sizeof(g_checks[0]); c++) {
+            if (strcmp(thresholds[i].name, g_checks[c].name) == 0) fn = g_checks[c].measure;
+        }
+        if (!fn) {
+            fprintf(stderr, "overhead_test: unknown check '%s'\n", thresholds[i].name);
+            return 2;
+        }
+
+        double value = 0.0;
+        int attempt = 0;
+        while (attempt < OVERHEAD_ATTEMPTS) {
+            value = fn();
+            attempt++;
+            if (value <= thresholds[i].limit) break;
+        }
+
+        int ok = value <= thresholds[i].limit;
+        fprintf(stderr, "%-30s %12.2f %12.2f  %s", thresholds[i].name, value,
+                thresholds[i].limit, ok ? "ok" : "FAILED");
+        if (attempt > 1) {
+            fprintf(stderr, " (%d attempts)", attempt);
+        }
+        fprintf(stderr, "\n");
+        if (!ok) failed = 1;
+    }
+    return failed;
+}
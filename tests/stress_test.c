@@ -0,0 +1,389 @@
+/*
+ * stress_test.c
+ *
+ * Multi-threaded stress and correctness test of the statistics engine.
+ * Waves of short-lived threads enter and exit sections in random nesting
+ * orders, recursion included, while a sink takes snapshots every few
+ * milliseconds. Every thread keeps its own count of what it did; at the
+ * end the runtime's totals must match that ground truth:
+ *
+ * - entries and recursive entries exactly;
+ * - outermost time between the time the thread measured inside the
+ *   enter/exit calls and the time it measured around them;
+ * - one duration histogram sample per outermost activation;
+ * - one section per name, although every thread of the first wave
+ *   registers all static sections and first-touches all dynamic names at
+ *   the same time.
+ *
+ * Mid-run snapshots must be monotonic and their deltas must add up.
+ *
+ * Usage:
+ *   narwhalyzer_stress_test
+ *
+ * Copyright (c) 2026
+ * Licensed under GPL-3.0 License
+ */
+
+#define _GNU_SOURCE
+#include "narwhalyzer.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <stdatomic.h>
+
+#define STRESS_WAVES             6
+#define STRESS_THREADS           8       /* Per wave */
+#define STRESS_STEPS             100000  /* Enter or exit steps per thread, at most */
+#define STRESS_STATIC            48      /* Sections registered by file and line */
+#define STRESS_DYNAMIC           48      /* Sections entered by name */
+#define STRESS_SECTIONS          (STRESS_STATIC + STRESS_DYNAMIC)
+#define STRESS_MAX_DEPTH         12
+#define STRESS_SNAPSHOT_MS       5
+#define STRESS_WAIT_MS           5000    /* For the snapshot after the last wave */
+#define STRESS_FILE              "stress_test.c"
+#define STRESS_DYNAMIC_FILE      "<dynamic>"
+
+/* What the threads did, merged when each thread exits */
+typedef struct truth {
+    uint64_t entries[STRESS_SECTIONS];
+    uint64_t recursive[STRESS_SECTIONS];
+    uint64_t time_lo[STRESS_SECTIONS];  /* Inside the enter and exit calls */
+    uint64_t time_hi[STRESS_SECTIONS];  /* Around the enter and exit calls */
+} truth_t;
+
+typedef struct frame {
+    int section;
+    int ctx;
+    uint64_t before_enter;
+    uint64_t after_enter;
+} frame_t;
+
+typedef struct worker {
+    int wave;
+    int thread;
+    int index[STRESS_STATIC];           /* Indices this thread registered */
+} worker_t;
+
+static char g_names[STRESS_SECTIONS][32];
+static truth_t g_truth;
+static pthread_mutex_t g_truth_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_barrier_t g_barrier;
+static atomic_int g_failures;
+
+/* Snapshot state, owned by the sink callback under g_snap_mutex */
+static pthread_mutex_t g_snap_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t g_snap_cond = PTHREAD_COND_INITIALIZER;
+static int g_prev_count;
+static uint64_t g_prev_entries[NARWHALYZER_MAX_SECTIONS];
+static uint64_t g_prev_recursive[NARWHALYZER_MAX_SECTIONS];
+static uint64_t g_prev_time[NARWHALYZER_MAX_SECTIONS];
+static narwhalyzer_section_snapshot_t g_last[NARWHALYZER_MAX_SECTIONS];
+static int g_last_count;
+static uint64_t g_last_timestamp;
+static int g_snapshots;
+
+#define FAIL(...) \
+    do { \
+        if (atomic_fetch_add(&g_failures, 1) < 20) { \
+            fprintf(stderr, "stress_test: " __VA_ARGS__); \
+            fprintf(stderr, "\n"); \
+        } \
+    } while (0)
+
+static uint64_t xorshift(uint64_t *state)
+{
+    uint64_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    return *state = x;
+}
+
+static void shuffle(int *order, int count, uint64_t *rng)
+{
+    for (int i = 0; i < count; i++) order[i] = i;
+    for (int i = count - 1; i > 0; i--) {
+        int j = (int)(xorshift(rng) % (uint64_t)(i + 1));
+        int tmp = order[i];
+        order[i] = order[j];
+        order[j] = tmp;
+    }
+}
+
+/* ============================================================================
+ * Workers
+ * ============================================================================ */
+
+static void enter(worker_t *w, truth_t *t, int *active, frame_t *f, int section)
+{
+    f->section = section;
+    f->before_enter = __narwhalyzer_get_timestamp_ns();
+    f->ctx = section < STRESS_STATIC ? __narwhalyzer_section_enter(w->index[section])
+                                     : narwhalyzer_enter_name(g_names[section]);
+    f->after_enter = __narwhalyzer_get_timestamp_ns();
+    if (f->ctx < 0) {
+        FAIL("enter of %s failed", g_names[section]);
+    }
+
+    t->entries[section]++;
+    if (active[section]++ > 0) {
+        t->recursive[section]++;
+    }
+}
+
+static void leave(truth_t *t, int *active, const frame_t *f)
+{
+    uint64_t before_exit = __narwhalyzer_get_timestamp_ns();
+    __narwhalyzer_section_exit(f->ctx);
+    uint64_t after_exit = __narwhalyzer_get_timestamp_ns();
+
+    /* Only outermost activations count towards time */
+    if (--active[f->section] == 0) {
+        t->time_lo[f->section] += before_exit - f->after_enter;
+        t->time_hi[f->section] += after_exit - f->before_enter;
+    }
+}
+
+static void *worker_main(void *arg)
+{
+    worker_t *w = arg;
+    truth_t *t = calloc(1, sizeof(truth_t));
+    if (!t) {
+        /* The rest of the wave waits at the barrier */
+        fprintf(stderr, "stress_test: out of memory\n");
+        exit(2);
+    }
+    uint64_t rng = 0x9e3779b97f4a7c15ULL * (uint64_t)(w->wave * STRESS_THREADS + w->thread + 1);
+    int order[STRESS_SECTIONS];
+    int active[STRESS_SECTIONS] = { 0 };
+    frame_t stack[STRESS_MAX_DEPTH];
+
+    /* Registration and first touch race against the rest of the wave */
+    shuffle(order, STRESS_SECTIONS, &rng);
+    pthread_barrier_wait(&g_barrier);
+    for (int i = 0; i < STRESS_SECTIONS; i++) {
+        int s = order[i];
+        if (s < STRESS_STATIC) {
+            w->index[s] = __narwhalyzer_register_section(g_names[s], STRESS_FILE, s + 1);
+        }
+    }
+    for (int i = 0; i < STRESS_SECTIONS; i++) {
+        if (order[i] >= STRESS_STATIC) {
+            enter(w, t, active, &stack[0], order[i]);
+            leave(t, active, &stack[0]);
+        }
+    }
+
+    /* Random walk over nesting; some threads stop early (churn) */
+    int steps = STRESS_STEPS / 2 + (int)(xorshift(&rng) % (STRESS_STEPS / 2));
+    int top = 0;
+    for (int i = 0; i < steps; i++) {
+        uint64_t r = xorshift(&rng);
+        if (top == 0 || (top < STRESS_MAX_DEPTH && r % 5 < 3)) {
+            /* One push in eight re-enters a section already open */
+            int section = top > 0 && (r >> 8) % 8 == 0
+                ? stack[(r >> 16) % (uint64_t)top].section
+                : (int)((r >> 16) % STRESS_SECTIONS);
+            enter(w, t, active, &stack[top++], section);
+        } else {
+            leave(t, active, &stack[--top]);
+        }
+    }
+    while (top > 0) {
+        leave(t, active, &stack[--top]);
+    }
+
+    pthread_mutex_lock(&g_truth_mutex);
+    for (int s = 0; s < STRESS_SECTIONS; s++) {
+        g_truth.entries[s] += t->entries[s];
+        g_truth.recursive[s] += t->recursive[s];
+        g_truth.time_lo[s] += t->time_lo[s];
+        g_truth.time_hi[s] += t->time_hi[s];
+    }
+    pthread_mutex_unlock(&g_truth_mutex);
+    free(t);
+    return NULL;
+}
+
+/* ============================================================================
+ * Snapshots
+ * ============================================================================ */
+
+static void on_snapshot(const narwhalyzer_snapshot_t *snap, void *user_data)
+{
+    (void)user_data;
+    if (snap->final) return;
+
+    pthread_mutex_lock(&g_snap_mutex);
+    if (snap->section_count < g_prev_count) {
+        FAIL("section count went from %d to %d", g_prev_count, snap->section_count);
+    }
+    for (int i = 0; i < snap->section_count; i++) {
+        const narwhalyzer_section_snapshot_t *t = &snap->totals[i];
+        const narwhalyzer_section_snapshot_t *d = &snap->deltas[i];
+        uint64_t prev_entries = i < g_prev_count ? g_prev_entries[i] : 0;
+        uint64_t prev_recursive = i < g_prev_count ? g_prev_recursive[i] : 0;
+        uint64_t prev_time = i < g_prev_count ? g_prev_time[i] : 0;
+
+        if (t->entries < prev_entries || t->recursive_entries < prev_recursive ||
+            t->time_ns < prev_time) {
+            FAIL("totals of %s went backwards", t->name);
+        }
+        if (d->entries != t->entries - prev_entries ||
+            d->recursive_entries != t->recursive_entries - prev_recursive ||
+            d->time_ns != t->time_ns - prev_time) {
+            FAIL("deltas of %s do not match the totals", t->name);
+        }
+        g_prev_entries[i] = t->entries;
+        g_prev_recursive[i] = t->recursive_entries;
+        g_prev_time[i] = t->time_ns;
+    }
+    g_prev_count = snap->section_count;
+
+    memcpy(g_last, snap->totals, (size_t)snap->section_count * sizeof(g_last[0]));
+    g_last_count = snap->section_count;
+    g_last_timestamp = snap->timestamp_ns;
+    g_snapshots++;
+    pthread_cond_broadcast(&g_snap_cond);
+    pthread_mutex_unlock(&g_snap_mutex);
+}
+
+/* Wait for a snapshot taken after `after_ns`; returns 0 if one arrived */
+static int wait_snapshot(uint64_t after_ns)
+{
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += STRESS_WAIT_MS / 1000;
+
+    int status = 0;
+    pthread_mutex_lock(&g_snap_mutex);
+    while (g_last_timestamp <= after_ns && status == 0) {
+        status = pthread_cond_timedwait(&g_snap_cond, &g_snap_mutex, &deadline);
+    }
+    pthread_mutex_unlock(&g_snap_mutex);
+    return g_last_timestamp > after_ns ? 0 : -1;
+}
+
+/* ============================================================================
+ * Verification
+ * ============================================================================ */
+
+static uint64_t histogram_total(const narwhalyzer_histogram_t *hist)
+{
+    uint64_t total = 0;
+    for (int b = 0; b < NARWHALYZER_HIST_BUCKETS; b++) {
+        total += hist->buckets[b];
+    }
+    return total;
+}
+
+static void verify(void)
+{
+    for (int s = 0; s < STRESS_SECTIONS; s++) {
+        const char *file = s < STRESS_STATIC ? STRESS_FILE : STRESS_DYNAMIC_FILE;
+        const narwhalyzer_section_snapshot_t *found = NULL;
+        int matches = 0;
+        for (int i = 0; i < g_last_count; i++) {
+            if (strcmp(g_last[i].name, g_names[s]) == 0 && g_last[i].file &&
+                strcmp(g_last[i].file, file) == 0) {
+                found = &g_last[i];
+                matches++;
+            }
+        }
+        if (matches != 1) {
+            FAIL("%s registered %d times", g_names[s], matches);
+            continue;
+        }
+
+        uint64_t outermost = g_truth.entries[s] - g_truth.recursive[s];
+        if (found->entries != g_truth.entries[s]) {
+            FAIL("%s: %lu entries, expected %lu", g_names[s],
+                 (unsigned long)found->entries, (unsigned long)g_truth.entries[s]);
+        }
+        if (found->recursive_entries != g_truth.recursive[s]) {
+            FAIL("%s: %lu recursive entries, expected %lu", g_names[s],
+                 (unsigned long)found->recursive_entries, (unsigned long)g_truth.recursive[s]);
+        }
+        if (found->time_ns < g_truth.time_lo[s] || found->time_ns > g_truth.time_hi[s]) {
+            FAIL("%s: time %lu ns outside [%lu, %lu]", g_names[s],
+                 (unsigned long)found->time_ns, (unsigned long)g_truth.time_lo[s],
+                 (unsigned long)g_truth.time_hi[s]);
+        }
+        if (histogram_total(&found->duration) != outermost) {
+            FAIL("%s: %lu duration samples, expected %lu", g_names[s],
+                 (unsigned long)histogram_total(&found->duration), (unsigned long)outermost);
+        }
+        if (outermost > 0 && found->min_ns > found->max_ns) {
+            FAIL("%s: min %lu ns above max %lu ns", g_names[s],
+                 (unsigned long)found->min_ns, (unsigned long)found->max_ns);
+        }
+    }
+}
+
+int main(void)
+{
+    for (int s = 0; s < STRESS_SECTIONS; s++) {
+        snprintf(g_names[s], sizeof(g_names[s]), "stress:%s%d",
+                 s < STRESS_STATIC ? "static" : "dynamic", s);
+    }
+
+    narwhalyzer_sink_t sink = {
+        .name = "stress",
+        .interval_ms = STRESS_SNAPSHOT_MS,
+        .snapshot = on_snapshot,
+    };
+    if (narwhalyzer_register_sink(&sink) < 0) {
+        fprintf(stderr, "stress_test: cannot register sink\n");
+        return 2;
+    }
+
+    static worker_t workers[STRESS_WAVES][STRESS_THREADS];
+    pthread_barrier_init(&g_barrier, NULL, STRESS_THREADS);
+    for (int wave = 0; wave < STRESS_WAVES; wave++) {
+        pthread_t threads[STRESS_THREADS];
+        for (int t = 0; t < STRESS_THREADS; t++) {
+            workers[wave][t].wave = wave;
+            workers[wave][t].thread = t;
+            if (pthread_create(&threads[t], NULL, worker_main, &workers[wave][t]) != 0) {
+                fprintf(stderr, "stress_test: cannot create thread\n");
+                return 2;
+            }
+        }
+        for (int t = 0; t < STRESS_THREADS; t++) {
+            pthread_join(threads[t], NULL);
+        }
+
+        /* Every thread must have been given the same sections */
+        for (int t = 0; t < STRESS_THREADS; t++) {
+            for (int s = 0; s < STRESS_STATIC; s++) {
+                if (workers[wave][t].index[s] != workers[0][0].index[s]) {
+                    FAIL("%s: thread %d of wave %d got index %d, thread 0 of wave 0 got %d",
+                         g_names[s], t, wave, workers[wave][t].index[s],
+                         workers[0][0].index[s]);
+                }
+            }
+        }
+    }
+    pthread_barrier_destroy(&g_barrier);
+
+    if (wait_snapshot(__narwhalyzer_get_timestamp_ns()) != 0) {
+        fprintf(stderr, "stress_test: no snapshot after the last wave\n");
+        return 1;
+    }
+    pthread_mutex_lock(&g_snap_mutex);
+    verify();
+    int snapshots = g_snapshots;
+    pthread_mutex_unlock(&g_snap_mutex);
+
+    uint64_t entries = 0;
+    for (int s = 0; s < STRESS_SECTIONS; s++) {
+        entries += g_truth.entries[s];
+    }
+    int failures = atomic_load(&g_failures);
+    fprintf(stderr, "stress_test: %d threads, %lu entries, %d snapshots, %d failures\n",
+            STRESS_WAVES * STRESS_THREADS, (unsigned long)entries, snapshots, failures);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,537 @@
+/*
+ * narwhalyzer_diff.cc
+ *
+ * Compare calling-context profiles (NARWHALYZER_PROFILE) of a baseline and
+ * a candidate build and flag statistically significant regressions.
+ *
+ *   narwhalyzer-diff [options] <base> <candidate>
+ *   narwhalyzer-diff [options] <base>... -- <candidate>...
+ *
+ * Sections are matched by name, file and line; a section whose line moved
+ * is matched by name when that is unambiguous. For each section the tool
+ * reports the change in entries per run, mean duration and the p50, p90
+ * and p99 of the per-activation duration histogram.
+ *
+ * A difference only counts when it is significant. With at least two runs
+ * on each side, Welch's t-test compares the per-run mean durations, which
+ * captures run-to-run noise (frequency scaling, placement, other tenants).
+ * With a single run on either side, the Mann-Whitney U test compares the
+ * duration histograms of all activations. A section regresses when the
+ * test is significant at --alpha and the mean (or, with --p99-threshold,
+ * the p99) grew by more than the threshold. Entry count changes beyond
+ * --count-threshold also count as regressions: they are deterministic.
+ *
+ * Exit status: 0 without regressions, 1 with regressions, 2 on usage or
+ * read errors.
+ *
+ * Copyright (c) 2026
+ * Licensed under GPL-3.0 License
+ */
+
+#include "profile_reader.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+using namespace narwhalyzer;
+
+/* ============================================================================
+ * Aggregation
+ * ============================================================================ */
+
+/* Statistics of one section in one run */
+struct run_section {
+    uint64_t entries = 0;
+    uint64_t activations = 0;           /* Outermost activations */
+    uint64_t time_ns = 0;
+};
+
+/* One section across all runs of one side */
+struct side_section {
+    std::string name;
+    std::string file;
+    int line = 0;
+    std::vector<run_section> runs;
+    std::map<uint64_t, uint64_t> hist;  /* Pooled duration histogram */
+
+    uint64_t activations() const
+    {
+        uint64_t n = 0;
+        for (const auto &r : runs) n += r.activations;
+        return n;
+    }
+
+    double mean_ns() const
+    {
+        uint64_t n = 0, t = 0;
+        for (const auto &r : runs) {
+            n += r.activations;
+            t += r.time_ns;
+        }
+        return n ? (double)t / (double)n : 0.0;
+    }
+
+    /* Mean durations of the runs that entered the section */
+    std::vector<double> run_means() const
+    {
+        std::vector<double> means;
+        for (const auto &r : runs) {
+            if (r.activations) means.push_back((double)r.time_ns / (double)r.activations);
+        }
+        return means;
+    }
+};
+
+struct side {
+    std::vector<std::string> paths;
+    uint64_t total_ns = 0;
+    std::map<std::string, side_section> sections;   /* Keyed by name, file and line */
+};
+
+static std::string section_key(const std::string &name, const std::string &file, int line)
+{
+    return name + '\t' + file + '\t' + std::to_string(line);
+}
+
+static int load_side(side &s, const std::vector<const char *> &paths)
+{
+    for (size_t run = 0; run < paths.size(); run++) {
+        profile prof;
+        if (!prof.load(paths[run])) {
+            fprintf(stderr, "narwhalyzer-diff: %s\n", prof.error().c_str());
+            return -1;
+        }
+        s.paths.push_back(paths[run]);
+        s.total_ns += prof.total_ns;
+
+        for (const profile_section &ps : prof.sections) {
+            if (ps.entries == 0) continue;
+            side_section &sec = s.sections[section_key(ps.name, ps.file, ps.line)];
+            sec.name = ps.name;
+            sec.file = ps.file;
+            sec.line = ps.line;
+            sec.runs.resize(paths.size());
+
+            run_section &r = sec.runs[run];
+            r.entries = ps.entries;
+            r.time_ns = ps.cumulative_ns;
+            r.activations = ps.activations();
+            auto it = ps.histograms.find("duration");
+            if (it != ps.histograms.end()) {
+                for (const auto &b : it->second) sec.hist[b.first] += b.second;
+            }
+        }
+    }
+    return 0;
+}
+
+/* ============================================================================
+ * Statistics
+ * ============================================================================ */
+
+/*
+ * Mann-Whitney U test on two histograms with the same bucket boundaries.
+ * Values in one bucket are ties. Returns the two-sided p-value from the
+ * normal approximation with tie correction, which is accurate for the
+ * sample sizes profiles have.
+ */
+static double mann_whitney(const std::map<uint64_t, uint64_t> &a,
+                           const std::map<uint64_t, uint64_t> &b)
+{
+    std::map<uint64_t, std::pair<double, double>> both;
+    for (const auto &x : a) both[x.first].first = (double)x.second;
+    for (const auto &x : b) both[x.first].second = (double)x.second;
+
+    double na = 0.0, nb = 0.0, u = 0.0, ties = 0.0;
+    for (const auto &x : both) {
+        double ca = x.second.first, cb = x.second.second;
+        u += cb * (na + ca / 2.0);
+        na += ca;
+        nb += cb;
+        double t = ca + cb;
+        ties += t * t * t - t;
+    }
+    double n = na + nb;
+    if (na < 1.0 || nb < 1.0 || n < 2.0) return NAN;
+
+    double variance = na * nb / 12.0 * ((n + 1.0) - ties / (n * (n - 1.0)));
+    if (variance <= 0.0) return 1.0;
+    double z = (u - na * nb / 2.0) / sqrt(variance);
+    return erfc(fabs(z) / sqrt(2.0));
+}
+
+/* Continued fraction of the incomplete beta function (modified Lentz) */
+static double beta_fraction(double a, double b, double x)
+{
+    const double tiny = 1e-300;
+    double c = 1.0;
+    double d = 1.0 - (a + b) * x / (a + 1.0);
+    if (fabs(d) < tiny) d = tiny;
+    d = 1.0 / d;
+    double h = d;
+    for (int m = 1; m <= 300; m++) {
+        double m2 = 2.0 * m;
+        double aa = m * (b - m) * x / ((a + m2 - 1.0) * (a + m2));
+        d = 1.0 + aa * d;
+        if (fabs(d) < tiny) d = tiny;
+        c = 1.0 + aa / c;
+        if (fabs(c) < tiny) c = tiny;
+        d = 1.0 / d;
+        h *= d * c;
+        aa = -(a + m) * (a + b + m) * x / ((a + m2) * (a + m2 + 1.0));
+        d = 1.0 + aa * d;
+        if (fabs(d) < tiny) d = tiny;
+        c = 1.0 + aa / c;
+        if (fabs(c) < tiny) c = tiny;
+        d = 1.0 / d;
+        double delta = d * c;
+        h *= delta;
+        if (fabs(delta - 1.0) < 1e-12) break;
+    }
+    return h;
+}
+
+/* Regularized incomplete beta function I_x(a, b) */
+static double incomplete_beta(double a, double b, double x)
+{
+    if (x <= 0.0) return 0.0;
+    if (x >= 1.0) return 1.0;
+    double front = exp(lgamma(a + b) - lgamma(a) - lgamma(b) + a * log(x) + b * log1p(-x));
+    if (x < (a + 1.0) / (a + b + 2.0)) return front * beta_fraction(a, b, x) / a;
+    return 1.0 - front * beta_fraction(b, a, 1.0 - x) / b;
+}
+
+/*
+ * Welch's t-test on two samples with unequal variances. Returns the
+ * two-sided p-value, or NaN with fewer than two values on either side.
+ */
+static double welch(const std::vector<double> &a, const std::vector<double> &b)
+{
+    if (a.size() < 2 || b.size() < 2) return NAN;
+
+    auto moments = [](const std::vector<double> &v, double &mean, double &var) {
+        mean = 0.0;
+        for (double x : v) mean += x;
+        mean /= (double)v.size();
+        var = 0.0;
+        for (double x : v) var += (x - mean) * (x - mean);
+        var /= (double)(v.size() - 1);
+    };
+    double ma, va, mb, vb;
+    moments(a, ma, va);
+    moments(b, mb, vb);
+
+    double sa = va / (double)a.size(), sb = vb / (double)b.size();
+    if (sa + sb <= 0.0) return ma == mb ? 1.0 : 0.0;
+    double t = (ma - mb) / sqrt(sa + sb);
+    double df = (sa + sb) * (sa + sb) /
+                (sa * sa / (double)(a.size() - 1) + sb * sb / (double)(b.size() - 1));
+    return incomplete_beta(df / 2.0, 0.5, df / (df + t * t));
+}
+
+/* ============================================================================
+ * Comparison
+ * ============================================================================ */
+
+struct options {
+    double threshold = 5.0;             /* Mean increase, percent */
+    double p99_threshold = -1.0;        /* p99 increase, percent, < 0 if off */
+    double count_threshold = -1.0;      /* Entry count change, percent, < 0 if off */
+    double alpha = 0.01;
+    uint64_t min_entries = 30;
+    std::set<std::string> only;         /* Section names to compare, all if empty */
+};
+
+enum verdict { SAME, REGRESSED, IMPROVED, FEW, ADDED, REMOVED };
+
+struct comparison {
+    const side_section *base = nullptr;
+    const side_section *cand = nullptr;
+    double entries_base = 0.0;          /* Entries per run */
+    double entries_cand = 0.0;
+    double mean_base = 0.0, mean_cand = 0.0;
+    double q_base[3] = { NAN, NAN, NAN };  /* p50, p90, p99 */
+    double q_cand[3] = { NAN, NAN, NAN };
+    double p_value = NAN;
+    verdict result = SAME;
+    double sort_key = 0.0;
+};
+
+static double change_percent(double base, double cand)
+{
+    if (!(base > 0.0)) return NAN;
+    return 100.0 * (cand - base) / base;
+}
+
+static double entries_per_run(const side_section *s, size_t runs)
+{
+    if (!s) return 0.0;
+    uint64_t n = 0;
+    for (const auto &r : s->runs) n += r.entries;
+    return (double)n / (double)runs;
+}
+
+static void compare(comparison &c, const side &base, const side &cand, const options &opt)
+{
+    static const double quantiles[3] = { 0.5, 0.9, 0.99 };
+
+    c.entries_base = entries_per_run(c.base, base.paths.size());
+    c.entries_cand = entries_per_run(c.cand, cand.paths.size());
+    if (!c.base || !c.cand) {
+        c.result = c.base ? REMOVED : ADDED;
+        c.sort_key = -HUGE_VAL;
+        return;
+    }
+
+    c.mean_base = c.base->mean_ns();
+    c.mean_cand = c.cand->mean_ns();
+    for (int i = 0; i < 3; i++) {
+        c.q_base[i] = histogram_quantile(c.base->hist, quantiles[i]);
+        c.q_cand[i] = histogram_quantile(c.cand->hist, quantiles[i]);
+    }
+    double mean_change = change_percent(c.mean_base, c.mean_cand);
+    double p99_change = change_percent(c.q_base[2], c.q_cand[2]);
+    double count_change = change_percent(c.entries_base, c.entries_cand);
+    c.sort_key = std::isnan(mean_change) ? -HUGE_VAL : mean_change;
+
+    if (c.base->activations() < opt.min_entries || c.cand->activations() < opt.min_entries) {
+        c.result = FEW;
+        return;
+    }
+
+    /* Repeated runs capture run-to-run noise; one run only the spread within it */
+    std::vector<double> means_base = c.base->run_means();
+    std::vector<double> means_cand = c.cand->run_means();
+    if (means_base.size() >= 2 && means_cand.size() >= 2) {
+        c.p_value = welch(means_base, means_cand);
+    } else if (!c.base->hist.empty() && !c.cand->hist.empty()) {
+        c.p_value = mann_whitney(c.base->hist, c.cand->hist);
+    }
+
+    /* Without a test (no histograms) the thresholds alone decide */
+    bool significant = std::isnan(c.p_value) || c.p_value < opt.alpha;
+    bool slower = mean_change > opt.threshold ||
+                  (opt.p99_threshold >= 0.0 && p99_change > opt.p99_threshold);
+    if (opt.count_threshold >= 0.0 && fabs(count_change) > opt.count_threshold) {
+        c.result = REGRESSED;
+    } else if (significant && slower) {
+        c.result = REGRESSED;
+    } else if (significant && mean_change < -opt.threshold) {
+        c.result = IMPROVED;
+    }
+}
+
+/* ============================================================================
+ * Output
+ * ============================================================================ */
+
+static std::string format_change(double base, double cand)
+{
+    char buf[32];
+    double change = change_percent(base, cand);
+    if (std::isnan(change) || std::isnan(cand)) return "-";
+    snprintf(buf, sizeof(buf), "%+.1f%%", change);
+    return buf;
+}
+
+static std::string format_count(double count)
+{
+    char buf[32];
+    if (count == floor(count)) snprintf(buf, sizeof(buf), "%.0f", count);
+    else snprintf(buf, sizeof(buf), "%.1f", count);
+    return buf;
+}
+
+static const char *verdict_name(verdict v)
+{
+    switch (v) {
+    case REGRESSED: return "REGRESSED";
+    case IMPROVED: return "improved";
+    case FEW: return "too few";
+    case ADDED: return "new";
+    case REMOVED: return "removed";
+    default: return "~";
+    }
+}
+
+static void print_side(const char *label, const side &s)
+{
+    printf("%s %s", label, s.paths[0].c_str());
+    if (s.paths.size() > 1) printf(" and %zu more", s.paths.size() - 1);
+    printf(" (%zu run%s, %s per run)\n", s.paths.size(), s.paths.size() == 1 ? "" : "s",
+           format_time((double)s.total_ns / (double)s.paths.size()).c_str());
+}
+
+static void print_comparisons(const std::vector<comparison> &rows)
+{
+    printf("%-28s %10s %10s %12s %12s %8s %8s %8s %8s %9s  %s\n", "Section", "Entries", "",
+           "Mean", "", "Mean", "p50", "p90", "p99", "", "");
+    printf("%-28s %10s %10s %12s %12s %8s %8s %8s %8s %9s  %s\n", "", "base", "cand", "base",
+           "cand", "change", "change", "change", "change", "p-value", "Verdict");
+
+    for (const comparison &c : rows) {
+        const side_section *s = c.base ? c.base : c.cand;
+        char p_buf[32] = "-";
+        if (!std::isnan(c.p_value)) snprintf(p_buf, sizeof(p_buf), "%.2g", c.p_value);
+        printf("%-28.28s %10s %10s %12s %12s %8s %8s %8s %8s %9s  %s\n", s->name.c_str(),
+               format_count(c.entries_base).c_str(), format_count(c.entries_cand).c_str(),
+               format_time(c.base ? c.mean_base : NAN).c_str(),
+               format_time(c.cand ? c.mean_cand : NAN).c_str(),
+               format_change(c.mean_base, c.mean_cand).c_str(),
+               format_change(c.q_base[0], c.q_cand[0]).c_str(),
+               format_change(c.q_base[1], c.q_cand[1]).c_str(),
+               format_change(c.q_base[2], c.q_cand[2]).c_str(), p_buf, verdict_name(c.result));
+    }
+}
+
+/* ============================================================================
+ * Main
+ * ============================================================================ */
+
+static void usage(void)
+{
+    fprintf(stderr,
+            "Usage: narwhalyzer-diff [options] <base> <candidate>\n"
+            "       narwhalyzer-diff [options] <base>... -- <candidate>...\n"
+            "\n"
+            "Options:\n"
+            "  --threshold PCT        Mean increase that counts as a regression (default 5)\n"
+            "  --p99-threshold PCT    Also flag p99 increases above PCT\n"
+            "  --count-threshold PCT  Also flag entry count changes above PCT\n"
+            "  --alpha A              Significance level (default 0.01)\n"
+            "  --min-entries N        Skip sections with fewer activations (default 30)\n"
+            "  --section NAME         Only compare this section (repeatable)\n"
+            "\n"
+            "Exits with 1 if any section regressed, 2 on errors.\n");
+}
+
+int main(int argc, char **argv)
+{
+    options opt;
+    std::vector<const char *> base_paths, cand_paths;
+    bool separator = false;
+
+    for (int i = 1; i < argc; i++) {
+        const char *arg = argv[i];
+        const char *value = i + 1 < argc ? argv[i + 1] : nullptr;
+
+        if (strcmp(arg, "--") == 0 && !separator) {
+            separator = true;
+        } else if (strcmp(arg, "--threshold") == 0 && value) {
+            opt.threshold = atof(value);
+            i++;
+        } else if (strcmp(arg, "--p99-threshold") == 0 && value) {
+            opt.p99_threshold = atof(value);
+            i++;
+        } else if (strcmp(arg, "--count-threshold") == 0 && value) {
+            opt.count_threshold = atof(value);
+            i++;
+        } else if (strcmp(arg, "--alpha") == 0 && value) {
+            opt.alpha = atof(value);
+            i++;
+        } else if (strcmp(arg, "--min-entries") == 0 && value) {
+            opt.min_entries = strtoull(value, nullptr, 10);
+            i++;
+        } else if (strcmp(arg, "--section") == 0 && value) {
+            opt.only.insert(value);
+            i++;
+        } else if (arg[0] != '-') {
+            (separator ? cand_paths : base_paths).push_back(arg);
+        } else {
+            usage();
+            return 2;
+        }
+    }
+    if (!separator && base_paths.size() == 2) {
+        cand_paths.push_back(base_paths.back());
+        base_paths.pop_back();
+    }
+    if (base_paths.empty() || cand_paths.empty() || (!separator && base_paths.size() != 1)) {
+        usage();
+        return 2;
+    }
+
+    side base, cand;
+    if (load_side(base, base_paths) != 0 || load_side(cand, cand_paths) != 0) return 2;
+
+    /* Match by name, file and line, then moved sections by unique name */
+    std::vector<comparison> rows;
+    std::set<std::string> matched_cand;
+    std::vector<const side_section *> unmatched_base;
+    for (const auto &b : base.sections) {
+        auto it = cand.sections.find(b.first);
+        if (it != cand.sections.end()) {
+            comparison c;
+            c.base = &b.second;
+            c.cand = &it->second;
+            rows.push_back(c);
+            matched_cand.insert(it->first);
+        } else {
+            unmatched_base.push_back(&b.second);
+        }
+    }
+    std::map<std::string, std::vector<const side_section *>> cand_by_name, base_by_name;
+    for (const auto &s : cand.sections) {
+        if (!matched_cand.count(s.first)) cand_by_name[s.second.name].push_back(&s.second);
+    }
+    for (const side_section *s : unmatched_base) base_by_name[s->name].push_back(s);
+    for (const auto &b : base_by_name) {
+        auto it = cand_by_name.find(b.first);
+        comparison c;
+        if (b.second.size() == 1 && it != cand_by_name.end() && it->second.size() == 1) {
+            c.base = b.second[0];
+            c.cand = it->second[0];
+            rows.push_back(c);
+            cand_by_name.erase(it);
+            continue;
+        }
+        for (const side_section *s : b.second) {
+            c.base = s;
+            rows.push_back(c);
+        }
+    }
+    for (const auto &n : cand_by_name) {
+        for (const side_section *s : n.second) {
+            comparison c;
+            c.cand = s;
+            rows.push_back(c);
+        }
+    }
+
+    if (!opt.only.empty()) {
+        rows.erase(std::remove_if(rows.begin(), rows.end(), [&](const comparison &c) {
+            return !opt.only.count((c.base ? c.base : c.cand)->name);
+        }), rows.end());
+    }
+
+    int regressions = 0;
+    for (comparison &c : rows) {
+        compare(c, base, cand, opt);
+        if (c.result == REGRESSED) regressions++;
+    }
+    std::stable_sort(rows.begin(), rows.end(), [](const comparison &a, const comparison &b) {
+        return a.sort_key > b.sort_key;
+    });
+
+    print_side("Baseline: ", base);
+    print_side("Candidate:", cand);
+    bool welch_used = base.paths.size() >= 2 && cand.paths.size() >= 2;
+    printf("Test: %s, alpha %g, threshold %+.1f%% mean", welch_used
+           ? "Welch's t-test on per-run means" : "Mann-Whitney U on duration histograms",
+           opt.alpha, opt.threshold);
+    if (opt.p99_threshold >= 0.0) printf(", %+.1f%% p99", opt.p99_threshold);
+    if (opt.count_threshold >= 0.0) printf(", %.1f%% entries", opt.count_threshold);
+    printf("\n\n");
+
+    print_comparisons(rows);
+
+    printf("\n%d section%s regressed\n", regressions, regressions == 1 ? "" : "s");
+    return regressions ? 1 : 0;
+}
@@ -0,0 +1,821 @@
+/*
+ * narwhalyzer_history.cc
+ *
+ * Append-only history of calling-context profiles (NARWHALYZER_PROFILE)
+ * for tracking section performance across builds.
+ *
+ *   narwhalyzer-history add <store> [--commit C] [--date D] [--machine M] <profile>...
+ *   narwhalyzer-history list <store> [--machine M] [--last N]
+ *   narwhalyzer-history trend <store> [--section NAME] [--machine M]
+ *                             [--metric mean|p50|p90|p99|entries] [--last N]
+ *                             [--min-change PCT]
+ *
+ * One store file per project keeps, for each ingested profile, a run
+ * record tagged with commit, date and machine, and a summary line per
+ * section. Section names are interned once in the same file, so a run
+ * costs a few dozen bytes per section and hundreds of nightly runs stay
+ * small enough to scan in full. Store format (fields separated by tabs,
+ * strings escaped with \t, \n and \\, like the profile format):
+ *
+ *   narwhalyzer-history  1
+ *   section  <id> <line> <name> <file>
+ *   run      <id> <unix time> <stats> <total_ns> <commit> <machine> <source>
+ *   stat     <run> <section> <entries> <activations> <time_ns> <p50_ns> <p90_ns> <p99_ns>
+ *
+ * A run's stat lines follow it, and a section line precedes its first
+ * use. Each ingest appends its records with one write under an exclusive
+ * lock; a run with fewer stat lines than announced (an interrupted write)
+ * is ignored and its tail is cut off by the next ingest.
+ *
+ * "trend" explains each section's series (per machine: timings from
+ * different machines are not comparable) by the model with the lowest
+ * Bayesian information criterion among: constant, linear drift over
+ * time, and piecewise constant with change points found by binary
+ * segmentation. Drift catches slow regressions of a percent per week that
+ * a diff of two profiles cannot see.
+ *
+ * Copyright (c) 2026
+ * Licensed under GPL-3.0 License
+ */
+
+#include "profile_reader.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <iterator>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace narwhalyzer;
+
+/* ============================================================================
+ * Store
+ * ============================================================================ */
+
+struct history_section {
+    std::string name;
+    std::string file;
+    int line = 0;
+};
+
+struct history_stat {
+    int section = 0;
+    uint64_t entries = 0;
+    uint64_t activations = 0;
+    uint64_t time_ns = 0;
+    double p50_ns = NAN;
+    double p90_ns = NAN;
+    double p99_ns = NAN;
+};
+
+struct history_run {
+    int id = 0;
+    int64_t date = 0;                   /* Unix time */
+    uint64_t total_ns = 0;
+    size_t expected = 0;                /* Stat lines announced by the run line */
+    std::string commit;
+    std::string machine;
+    std::string source;
+    std::vector<history_stat> stats;
+};
+
+class history {
+public:
+    /*
+     * Parse store contents. Returns false if it is not a history store.
+     * complete_size is set to the end of the last complete line.
+     */
+    bool parse(const std::string &data)
+    {
+        sections.clear();
+        runs.clear();
+        complete_size = 0;
+        if (data.empty()) return true;
+
+        bool header = false;
+        size_t pos = 0;
+        while (pos < data.size()) {
+            size_t end = data.find('\n', pos);
+            if (end == std::string::npos) break;   /* Interrupted write */
+            std::vector<std::string> f = split(data.substr(pos, end - pos));
+            pos = end + 1;
+            complete_size = pos;
+
+            const std::string &kind = f[0];
+            if (!header) {
+                if (kind != "narwhalyzer-history" || f.size() < 2 || f[1] != "1") return false;
+                header = true;
+            } else if (kind == "section" && f.size() >= 5) {
+                size_t id = strtoul(f[1].c_str(), nullptr, 10);
+                if (id != sections.size()) continue;
+                history_section s;
+                s.line = atoi(f[2].c_str());
+                s.name = f[3];
+                s.file = f[4];
+                sections.push_back(s);
+            } else if (kind == "run" && f.size() >= 8) {
+                history_run r;
+                r.id = atoi(f[1].c_str());
+                r.date = strtoll(f[2].c_str(), nullptr, 10);
+                r.expected = strtoul(f[3].c_str(), nullptr, 10);
+                r.total_ns = strtoull(f[4].c_str(), nullptr, 10);
+                r.commit = f[5];
+                r.machine = f[6];
+                r.source = f[7];
+                runs.push_back(r);
+            } else if (kind == "stat" && f.size() >= 9 && !runs.empty()) {
+                history_run &r = runs.back();
+                if (atoi(f[1].c_str()) != r.id) continue;
+                history_stat s;
+                s.section = atoi(f[2].c_str());
+                if (s.section < 0 || (size_t)s.section >= sections.size()) continue;
+                s.entries = strtoull(f[3].c_str(), nullptr, 10);
+                s.activations = strtoull(f[4].c_str(), nullptr, 10);
+                s.time_ns = strtoull(f[5].c_str(), nullptr, 10);
+                s.p50_ns = parse_optional(f[6]);
+                s.p90_ns = parse_optional(f[7]);
+                s.p99_ns = parse_optional(f[8]);
+                r.stats.push_back(s);
+            }
+        }
+        if (!header && complete_size > 0) return false;
+
+        /* Drop runs cut short by an interrupted write */
+        runs.erase(std::remove_if(runs.begin(), runs.end(), [](const history_run &r) {
+            return r.stats.size() != r.expected;
+        }), runs.end());
+        return true;
+    }
+
+    int find_section(const std::string &name, const std::string &file, int line) const
+    {
+        for (size_t i = 0; i < sections.size(); i++) {
+            const history_section &s = sections[i];
+            if (s.line == line && s.name == name && s.file == file) return (int)i;
+        }
+        return -1;
+    }
+
+    std::vector<history_section> sections;
+    std::vector<history_run> runs;
+    size_t complete_size = 0;
+
+private:
+    static double parse_optional(const std::string &text)
+    {
+        return text == "-" ? NAN : strtod(text.c_str(), nullptr);
+    }
+
+    static std::vector<std::string> split(const std::string &line)
+    {
+        std::vector<std::string> fields(1);
+        for (size_t i = 0; i < line.size(); i++) {
+            char ch = line[i];
+            if (ch == '\t') {
+                fields.emplace_back();
+            } else if (ch == '\\' && i + 1 < line.size()) {
+                char next = line[++i];
+                fields.back().push_back(next == 't' ? '\t' : next == 'n' ? '\n' : next);
+            } else {
+                fields.back().push_back(ch);
+            }
+        }
+        return fields;
+    }
+};
+
+static std::string escaped(const std::string &text)
+{
+    std::string out;
+    for (char ch : text) {
+        switch (ch) {
+        case '\t': out += "\\t"; break;
+        case '\n': out += "\\n"; break;
+        case '\\': out += "\\\\"; break;
+        default:   out += ch; break;
+        }
+    }
+    return out;
+}
+
+static std::string format_optional(double value)
+{
+    if (std::isnan(value)) return "-";
+    char buf[32];
+    snprintf(buf, sizeof(buf), "%.0f", value);
+    return buf;
+}
+
+static bool read_fd(int fd, std::string &data)
+{
+    data.clear();
+    char buf[65536];
+    ssize_t n;
+    if (lseek(fd, 0, SEEK_SET) < 0) return false;
+    while ((n = read(fd, buf, sizeof(buf))) != 0) {
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        data.append(buf, (size_t)n);
+    }
+    return true;
+}
+
+static bool load_store(const char *path, history &store)
+{
+    std::string data;
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        fprintf(stderr, "narwhalyzer-history: cannot open %s\n", path);
+        return false;
+    }
+    flock(fd, LOCK_SH);
+    bool ok = read_fd(fd, data);
+    close(fd);
+    if (!ok || !store.parse(data)) {
+        fprintf(stderr, "narwhalyzer-history: %s: not a history store\n", path);
+        return false;
+    }
+    return true;
+}
+
+/* ============================================================================
+ * Dates
+ * ============================================================================ */
+
+/* Unix seconds, YYYY-MM-DD or YYYY-MM-DDTHH:MM:SS[Z] (UTC) */
+static bool parse_date(const char *text, int64_t &date)
+{
+    char *end;
+    long long seconds = strtoll(text, &end, 10);
+    if (*text && *end == '\0') {
+        date = seconds;
+        return true;
+    }
+
+    struct tm tm;
+    memset(&tm, 0, sizeof(tm));
+    end = strptime(text, "%Y-%m-%dT%H:%M:%S", &tm);
+    if (!end) {
+        memset(&tm, 0, sizeof(tm));
+        end = strptime(text, "%Y-%m-%d", &tm);
+    }
+    if (!end || (*end && strcmp(end, "Z") != 0)) return false;
+    date = (int64_t)timegm(&tm);
+    return true;
+}
+
+static std::string format_date(int64_t date)
+{
+    char buf[32];
+    time_t t = (time_t)date;
+    struct tm tm;
+    gmtime_r(&t, &tm);
+    strftime(buf, sizeof(buf), "%Y-%m-%d %H:%M", &tm);
+    return buf;
+}
+
+/* ============================================================================
+ * Ingest
+ * ============================================================================ */
+
+struct run_tags {
+    std::string commit = "unknown";
+    std::string machine;
+    int64_t date = 0;
+};
+
+/*
+ * Append one run per profile. The store is locked for the whole ingest so
+ * that run and section ids stay unique.
+ */
+static int add_profiles(const char *path, const run_tags &tags,
+                        const std::vector<const char *> &profiles)
+{
+    std::vector<profile> loaded(profiles.size());
+    for (size_t i = 0; i < profiles.size(); i++) {
+        if (!loaded[i].load(profiles[i])) {
+            fprintf(stderr, "narwhalyzer-history: %s\n", loaded[i].error().c_str());
+            return 2;
+        }
+    }
+
+    int fd = open(path, O_RDWR | O_CREAT | O_APPEND, 0644);
+    if (fd < 0) {
+        fprintf(stderr, "narwhalyzer-history: cannot open %s\n", path);
+        return 2;
+    }
+    flock(fd, LOCK_EX);
+
+    std::string data;
+    history store;
+    if (!read_fd(fd, data) || !store.parse(data)) {
+        fprintf(stderr, "narwhalyzer-history: %s: not a history store\n", path);
+        close(fd);
+        return 2;
+    }
+    if (store.complete_size < data.size() && ftruncate(fd, (off_t)store.complete_size) != 0) {
+        fprintf(stderr, "narwhalyzer-history: cannot repair %s\n", path);
+        close(fd);
+        return 2;
+    }
+
+    std::string out;
+    if (store.complete_size == 0) out += "narwhalyzer-history\t1\n";
+    int run_id = store.runs.empty() ? 0 : store.runs.back().id + 1;
+
+    for (size_t i = 0; i < loaded.size(); i++) {
+        const profile &prof = loaded[i];
+        std::string stats;
+        size_t count = 0;
+        for (const profile_section &ps : prof.sections) {
+            if (ps.entries == 0) continue;
+            int sid = store.find_section(ps.name, ps.file, ps.line);
+            if (sid < 0) {
+                sid = (int)store.sections.size();
+                store.sections.push_back(history_section{ ps.name, ps.file, ps.line });
+                out += "section\t" + std::to_string(sid) + "\t" + std::to_string(ps.line) +
+                       "\t" + escaped(ps.name) + "\t" + escaped(ps.file) + "\n";
+            }
+
+            double q[3] = { NAN, NAN, NAN };
+            auto it = ps.histograms.find("duration");
+            if (it != ps.histograms.end()) {
+                q[0] = histogram_quantile(it->second, 0.5);
+                q[1] = histogram_quantile(it->second, 0.9);
+                q[2] = histogram_quantile(it->second, 0.99);
+            }
+            stats += "stat\t" + std::to_string(run_id) + "\t" + std::to_string(sid) + "\t" +
+                     std::to_string(ps.entries) + "\t" + std::to_string(ps.activations()) + "\t" +
+                     std::to_string(ps.cumulative_ns) + "\t" + format_optional(q[0]) + "\t" +
+                     format_optional(q[1]) + "\t" + format_optional(q[2]) + "\n";
+            count++;
+        }
+        out += "run\t" + std::to_string(run_id) + "\t" + std::to_string(tags.date) + "\t" +
+               std::to_string(count) + "\t" + std::to_string(prof.total_ns) + "\t" +
+               escaped(tags.commit) + "\t" + escaped(tags.machine) + "\t" +
+               escaped(profiles[i]) + "\n" + stats;
+        printf("run %d: %s (%zu sections)\n", run_id, profiles[i], count);
+        run_id++;
+    }
+
+    /* One write, so readers never see a run without its sections */
+    size_t done = 0;
+    while (done < out.size()) {
+        ssize_t n = write(fd, out.data() + done, out.size() - done);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) {
+            fprintf(stderr, "narwhalyzer-history: error writing %s\n", path);
+            close(fd);
+            return 2;
+        }
+        done += (size_t)n;
+    }
+    if (fsync(fd) != 0 || close(fd) != 0) {
+        fprintf(stderr, "narwhalyzer-history: error writing %s\n", path);
+        return 2;
+    }
+    return 0;
+}
+
+/* ============================================================================
+ * Trend Analysis
+ * ============================================================================ */
+
+struct segment_fit {
+    std::vector<int> changes;           /* First index of each new segment */
+    double sse = 0.0;
+};
+
+/* Sum of squared errors of values[a, b) around their mean */
+static double segment_sse(const std::vector<double> &sum, const std::vector<double> &sum_sq,
+                          int a, int b)
+{
+    double n = b - a;
+    double s = sum[b] - sum[a];
+    double sse = (sum_sq[b] - sum_sq[a]) - s * s / n;
+    return sse > 0.0 ? sse : 0.0;
+}
+
+/*
+ * Binary segmentation: split a segment where one mean before and one after
+ * fit best (as in the runtime's step shift detection), and keep splitting
+ * while the split reduces the squared error by more than the penalty.
+ */
+static void segment(const std::vector<double> &values, const std::vector<double> &sum,
+                    const std::vector<double> &sum_sq, int a, int b, double penalty,
+                    double min_change, int min_length, std::vector<int> &changes)
+{
+    if (b - a < 2 * min_length || changes.size() >= 16) return;
+
+    double whole = segment_sse(sum, sum_sq, a, b);
+    int best = -1;
+    double best_cost = 0.0;
+    for (int k = a + min_length; k <= b - min_length; k++) {
+        double cost = segment_sse(sum, sum_sq, a, k) + segment_sse(sum, sum_sq, k, b);
+        if (best < 0 || cost < best_cost) {
+            best = k;
+            best_cost = cost;
+        }
+    }
+    if (best < 0 || whole - best_cost <= penalty) return;
+
+    double before = (sum[best] - sum[a]) / (best - a);
+    double after = (sum[b] - sum[best]) / (b - best);
+    if (before <= 0.0 || fabs(after - before) < min_change * before) return;
+
+    changes.push_back(best);
+    segment(values, sum, sum_sq, a, best, penalty, min_change, min_length, changes);
+    segment(values, sum, sum_sq, best, b, penalty, min_change, min_length, changes);
+}
+
+/* Noise level from successive differences, robust to shifts and drift */
+static double noise_variance(const std::vector<double> &values)
+{
+    std::vector<double> diffs;
+    for (size_t i = 1; i < values.size(); i++) diffs.push_back(fabs(values[i] - values[i - 1]));
+    if (diffs.empty()) return 0.0;
+    std::nth_element(diffs.begin(), diffs.begin() + diffs.size() / 2, diffs.end());
+    double sigma = diffs[diffs.size() / 2] / (0.6745 * sqrt(2.0));
+    return sigma * sigma;
+}
+
+struct linear_fit {
+    double slope = 0.0;                 /* Per day */
+    double intercept = 0.0;
+    double sse = 0.0;
+    double t = 0.0;                     /* Slope over its standard error */
+};
+
+static linear_fit fit_line(const std::vector<double> &x, const std::vector<double> &y)
+{
+    linear_fit fit;
+    double n = (double)x.size();
+    double mx = 0.0, my = 0.0;
+    for (size_t i = 0; i < x.size(); i++) {
+        mx += x[i];
+        my += y[i];
+    }
+    mx /= n;
+    my /= n;
+    double sxx = 0.0, sxy = 0.0;
+    for (size_t i = 0; i < x.size(); i++) {
+        sxx += (x[i] - mx) * (x[i] - mx);
+        sxy += (x[i] - mx) * (y[i] - my);
+    }
+    fit.slope = sxx > 0.0 ? sxy / sxx : 0.0;
+    fit.intercept = my - fit.slope * mx;
+    for (size_t i = 0; i < x.size(); i++) {
+        double r = y[i] - (fit.intercept + fit.slope * x[i]);
+        fit.sse += r * r;
+    }
+    if (sxx > 0.0 && n > 2.0) {
+        double se = sqrt(fit.sse / (n - 2.0) / sxx);
+        fit.t = se > 0.0 ? fit.slope / se : HUGE_VAL;
+    }
+    return fit;
+}
+
+enum trend_model { STABLE, DRIFT, SHIFTS };
+
+struct trend {
+    trend_model model = STABLE;
+    std::vector<int> changes;
+    linear_fit line;
+};
+
+/* Bayesian information criterion of a Gaussian model with params parameters */
+static double bic(double sse, double n, double floor, int params)
+{
+    return n * log(std::max(sse, floor) / n) + params * log(n);
+}
+
+static trend analyze(const std::vector<double> &days, const std::vector<double> &values,
+                     double min_change)
+{
+    trend result;
+    int n = (int)values.size();
+    if (n < 6) return result;
+
+    std::vector<double> sum(n + 1, 0.0), sum_sq(n + 1, 0.0);
+    for (int i = 0; i < n; i++) {
+        sum[i + 1] = sum[i] + values[i];
+        sum_sq[i + 1] = sum_sq[i] + values[i] * values[i];
+    }
+    double mean = sum[n] / n;
+
+    /* Guard against a perfect fit, which would make every model look best */
+    double floor = n * (1e-4 * mean) * (1e-4 * mean) + 1e-30;
+
+    double variance = noise_variance(values);
+    double penalty = 2.0 * std::max(variance, floor / n) * log((double)n);
+    std::vector<int> changes;
+    segment(values, sum, sum_sq, 0, n, penalty, min_change, 3, changes);
+    std::sort(changes.begin(), changes.end());
+
+    double sse_const = segment_sse(sum, sum_sq, 0, n);
+    double sse_steps = 0.0;
+    int prev = 0;
+    for (int c : changes) {
+        sse_steps += segment_sse(sum, sum_sq, prev, c);
+        prev = c;
+    }
+    sse_steps += segment_sse(sum, sum_sq, prev, n);
+
+    bool dated = days.front() != days.back();
+    linear_fit line;
+    if (dated) line = fit_line(days, values);
+
+    double best = bic(sse_const, n, floor, 1);
+    if (!changes.empty()) {
+        double b = bic(sse_steps, n, floor, 2 * (int)changes.size() + 1);
+        if (b < best) {
+            best = b;
+            result.model = SHIFTS;
+            result.changes = changes;
+        }
+    }
+    if (dated && fabs(line.t) >= 3.0) {
+        double span = days.back() - days.front();
+        double b = bic(line.sse, n, floor, 2);
+        if (b < best && fabs(line.slope * span) >= min_change * mean) {
+            result.model = DRIFT;
+            result.changes.clear();
+        }
+    }
+    result.line = line;
+    return result;
+}
+
+/* ============================================================================
+ * Output
+ * ============================================================================ */
+
+static std::string format_value(double value, bool is_time)
+{
+    if (is_time) return format_time(value);
+    char buf[32];
+    snprintf(buf, sizeof(buf), "%.0f", value);
+    return buf;
+}
+
+static void print_sparkline(const std::vector<double> &values)
+{
+    static const char *levels[] = { "▁", "▂", "▃", "▄", "▅", "▆", "▇", "█" };
+
+    /* At most 64 characters: average runs into buckets */
+    size_t width = std::min<size_t>(values.size(), 64);
+    std::vector<double> cells(width, 0.0);
+    std::vector<int> counts(width, 0);
+    for (size_t i = 0; i < values.size(); i++) {
+        size_t cell = i * width / values.size();
+        cells[cell] += values[i];
+        counts[cell]++;
+    }
+    for (size_t c = 0; c < width; c++) cells[c] /= counts[c];
+
+    double lo = *std::min_element(cells.begin(), cells.end());
+    double hi = *std::max_element(cells.begin(), cells.end());
+    for (double v : cells) {
+        int level = hi > lo ? (int)((v - lo) / (hi - lo) * 7.0 + 0.5) : 0;
+        printf("%s", levels[level]);
+    }
+}
+
+static void print_runs(const history &store, const std::string &machine, size_t last)
+{
+    std::vector<const history_run *> runs;
+    for (const history_run &r : store.runs) {
+        if (machine.empty() || r.machine == machine) runs.push_back(&r);
+    }
+    size_t first = runs.size() > last ? runs.size() - last : 0;
+
+    printf("%6s  %-16s  %-12s  %-16s  %12s  %8s  %s\n", "Run", "Date (UTC)", "Commit", "Machine",
+           "Total", "Sections", "Profile");
+    for (size_t i = first; i < runs.size(); i++) {
+        const history_run &r = *runs[i];
+        printf("%6d  %-16s  %-12.12s  %-16.16s  %12s  %8zu  %s\n", r.id,
+               format_date(r.date).c_str(), r.commit.c_str(), r.machine.c_str(),
+               format_time((double)r.total_ns).c_str(), r.stats.size(), r.source.c_str());
+    }
+}
+
+struct trend_options {
+    std::string section;
+    std::string machine;
+    std::string metric = "mean";
+    size_t last = 0;
+    double min_change = 0.02;
+};
+
+/* NaN if the run has no value, e.g. percentiles from profiles without histograms */
+static double metric_value(const history_stat &s, const std::string &metric)
+{
+    if (metric == "mean") return s.activations ? (double)s.time_ns / (double)s.activations : NAN;
+    if (metric == "p50") return s.p50_ns;
+    if (metric == "p90") return s.p90_ns;
+    if (metric == "p99") return s.p99_ns;
+    return (double)s.entries;
+}
+
+/* One series per section and machine */
+struct series_point {
+    const history_run *run;
+    double value;
+};
+
+static void print_trends(const history &store, const trend_options &opt)
+{
+    std::map<std::pair<std::string, int>, std::vector<series_point>> series;
+    std::map<std::string, size_t> machines;
+    for (const history_run &r : store.runs) {
+        if (!opt.machine.empty() && r.machine != opt.machine) continue;
+        machines[r.machine]++;
+        for (const history_stat &s : r.stats) {
+            if (!opt.section.empty() && store.sections[s.section].name != opt.section) continue;
+            double value = metric_value(s, opt.metric);
+            if (std::isnan(value)) continue;
+            series[{ r.machine, s.section }].push_back(series_point{ &r, value });
+        }
+    }
+    bool is_time = opt.metric != "entries";
+
+    for (auto &entry : series) {
+        std::vector<series_point> &points = entry.second;
+        if (opt.last && points.size() > opt.last) {
+            points.erase(points.begin(), points.end() - (ptrdiff_t)opt.last);
+        }
+        const history_section &sec = store.sections[entry.first.second];
+
+        std::vector<double> days, values;
+        for (const series_point &p : points) {
+            days.push_back((double)(p.run->date - points.front().run->date) / 86400.0);
+            values.push_back(p.value);
+        }
+        trend t = analyze(days, values, opt.min_change);
+
+        printf("%s (%s:%d)", sec.name.c_str(), sec.file.c_str(), sec.line);
+        if (machines.size() > 1) printf(" on %s", entry.first.first.c_str());
+        printf(", %zu run%s, %s\n", points.size(), points.size() == 1 ? "" : "s",
+               opt.metric.c_str());
+        printf("  %s -> %s  ", format_value(values.front(), is_time).c_str(),
+               format_value(values.back(), is_time).c_str());
+        print_sparkline(values);
+        printf("\n");
+
+        if (t.model == SHIFTS) {
+            int prev = 0;
+            for (size_t i = 0; i < t.changes.size(); i++) {
+                int c = t.changes[i];
+                int next = i + 1 < t.changes.size() ? t.changes[i + 1] : (int)values.size();
+                double before = 0.0, after = 0.0;
+                for (int k = prev; k < c; k++) before += values[k];
+                for (int k = c; k < next; k++) after += values[k];
+                before /= c - prev;
+                after /= next - c;
+                const history_run *r = points[c].run;
+                printf("  Change at run %d (%s, %s): %s -> %s (%+.1f%%)\n", r->id,
+                       format_date(r->date).c_str(), r->commit.c_str(),
+                       format_value(before, is_time).c_str(), format_value(after, is_time).c_str(),
+                       100.0 * (after - before) / before);
+                prev = c;
+            }
+        } else if (t.model == DRIFT) {
+            /* Relative to the fitted value at the first run */
+            printf("  Drift: %+.2f%% per week since %s\n",
+                   100.0 * 7.0 * t.line.slope / t.line.intercept,
+                   format_date(points.front().run->date).c_str());
+        } else if (values.size() < 6) {
+            printf("  Too few runs to detect changes\n");
+        } else {
+            printf("  Stable\n");
+        }
+
+        if (!opt.section.empty()) {
+            printf("\n  %6s  %-16s  %-12s  %12s\n", "Run", "Date (UTC)", "Commit", opt.metric.c_str());
+            for (const series_point &p : points) {
+                printf("  %6d  %-16s  %-12.12s  %12s\n", p.run->id,
+                       format_date(p.run->date).c_str(), p.run->commit.c_str(),
+                       format_value(p.value, is_time).c_str());
+            }
+        }
+        printf("\n");
+    }
+}
+
+/* ============================================================================
+ * Main
+ * ============================================================================ */
+
+static void usage(void)
+{
+    fprintf(stderr,
+            "Usage: narwhalyzer-history add <store> [options] <profile>...\n"
+            "       narwhalyzer-history list <store> [--machine M] [--last N]\n"
+            "       narwhalyzer-history trend <store> [options]\n"
+            "\n"
+            "Options for add:\n"
+            "  --commit C        Commit the profiles were built from\n"
+            "  --date D          Unix time or YYYY-MM-DD[THH:MM:SS] in UTC (default now)\n"
+            "  --machine M       Machine name (default host name)\n"
+            "\n"
+            "Options for trend:\n"
+            "  --section NAME    Only this section, with its full series\n"
+            "  --machine M       Only runs from this machine\n"
+            "  --metric M        mean, p50, p90, p99 or entries (default mean)\n"
+            "  --last N          Only the last N runs of each series\n"
+            "  --min-change PCT  Smallest change or total drift to report (default 2)\n");
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 3) {
+        usage();
+        return 2;
+    }
+    const char *command = argv[1];
+    const char *path = argv[2];
+
+    run_tags tags;
+    trend_options opt;
+    std::vector<const char *> profiles;
+    tags.date = (int64_t)time(nullptr);
+    char host[256] = "";
+    gethostname(host, sizeof(host) - 1);
+    tags.machine = host;
+
+    for (int i = 3; i < argc; i++) {
+        const char *arg = argv[i];
+        const char *value = i + 1 < argc ? argv[i + 1] : nullptr;
+
+        if (strcmp(arg, "--commit") == 0 && value) {
+            tags.commit = value;
+            i++;
+        } else if (strcmp(arg, "--date") == 0 && value) {
+            if (!parse_date(value, tags.date)) {
+                fprintf(stderr, "narwhalyzer-history: invalid date %s\n", value);
+                return 2;
+            }
+            i++;
+        } else if (strcmp(arg, "--machine") == 0 && value) {
+            tags.machine = value;
+            opt.machine = value;
+            i++;
+        } else if (strcmp(arg, "--section") == 0 && value) {
+            opt.section = value;
+            i++;
+        } else if (strcmp(arg, "--metric") == 0 && value) {
+            opt.metric = value;
+            i++;
+        } else if (strcmp(arg, "--last") == 0 && value) {
+            opt.last = strtoul(value, nullptr, 10);
+            i++;
+        } else if (strcmp(arg, "--min-change") == 0 && value) {
+            opt.min_change = atof(value) / 100.0;
+            i++;
+        } else if (arg[0] != '-') {
+            profiles.push_back(arg);
+        } else {
+            usage();
+            return 2;
+        }
+    }
+
+    if (strcmp(command, "add") == 0 && !profiles.empty()) {
+        return add_profiles(path, tags, profiles);
+    }
+    if (!profiles.empty()) {
+        usage();
+        return 2;
+    }
+
+    history store;
+    if (strcmp(command, "list") == 0) {
+        if (!load_store(path, store)) return 2;
+        print_runs(store, opt.machine, opt.last ? opt.last : (size_t)-1);
+    } else if (strcmp(command, "trend") == 0) {
+        static const char *const metrics[] = { "mean", "p50", "p90", "p99", "entries" };
+        if (std::find(std::begin(metrics), std::end(metrics), opt.metric) == std::end(metrics)) {
+            fprintf(stderr, "narwhalyzer-history: unknown metric %s\n", opt.metric.c_str());
+            return 2;
+        }
+        if (!load_store(path, store)) return 2;
+        print_trends(store, opt);
+    } else {
+        usage();
+        return 2;
+    }
+    return 0;
+}
@@ -0,0 +1,264 @@
+/*
+ * narwhalyzer_report.cc
+ *
+ * Report and export tool for calling-context profiles (NARWHALYZER_PROFILE).
+ *
+ *   narwhalyzer-report <profile>
+ *   narwhalyzer-report --folded [--thread TID | --per-thread] <profile>
+ *   narwhalyzer-report --folded --diff <base profile> <profile>
+ *   narwhalyzer-report --pprof --output <file.pb.gz> <profile>
+ *   narwhalyzer-report --callgrind [--thread TID | --per-thread] <profile>
+ *   narwhalyzer-report --html --output <file.html> <profile>
+ *
+ * Without options the sections and the merged calling-context tree are
+ * printed as text. --folded writes one line per calling context,
+ * "a;b;c <self_ns>", which flamegraph.pl, speedscope and most flame graph
+ * viewers accept. With --diff each line carries the self time of both
+ * profiles, "a;b;c <base_ns> <new_ns>", the input of differential flame
+ * graphs (difffolded.pl, flamegraph.pl). --pprof writes a gzipped
+ * profile.proto for pprof (see report_pprof.cc), --callgrind a profile for
+ * KCachegrind (see report_callgrind.cc) and --html a self-contained page
+ * for offline viewing (see report_html.cc).
+ *
+ * Copyright (c) 2026
+ * Licensed under GPL-3.0 License
+ */
+
+#include "profile_reader.h"
+#include "report_formats.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <string>
+#include <vector>
+
+using namespace narwhalyzer;
+
+/* ============================================================================
+ * Text Report
+ * ============================================================================ */
+
+static void print_text(const profile &prof, FILE *out)
+{
+    fprintf(out, "Profile: %s (pid %u, %s)\n", prof.path().c_str(), prof.pid, prof.command.c_str());
+    fprintf(out, "Total program time: %s, %zu threads\n\n", format_time(prof.total_ns).c_str(),
+            prof.threads.size());
+
+    std::vector<int> order;
+    for (size_t i = 0; i < prof.sections.size(); i++) {
+        if (prof.sections[i].entries > 0) order.push_back((int)i);
+    }
+    std::sort(order.begin(), order.end(), [&](int a, int b) {
+        return prof.sections[a].cumulative_ns > prof.sections[b].cumulative_ns;
+    });
+
+    fprintf(out, "%-32s %10s %14s %14s %14s\n", "Section", "Entries", "Cumulative", "Min", "Max");
+    for (int i : order) {
+        const profile_section &s = prof.sections[i];
+        fprintf(out, "%-32.32s %10lu %14s %14s %14s\n", s.name.c_str(), (unsigned long)s.entries,
+                format_time(s.cumulative_ns).c_str(), format_time(s.min_ns).c_str(),
+                format_time(s.max_ns).c_str());
+    }
+
+    profile_tree tree = prof.merged();
+    if (tree.nodes.size() <= 1) return;
+
+    fprintf(out, "\nCalling-context tree (inclusive / self / count):\n\n");
+    struct item { int node; int depth; };
+    std::vector<item> todo{ { 0, -1 } };
+    while (!todo.empty()) {
+        item cur = todo.back();
+        todo.pop_back();
+        const profile_node &n = tree.nodes[cur.node];
+        if (cur.node != 0) {
+            fprintf(out, "%*s%s  %s / %s / %lu\n", 2 * cur.depth, "",
+                    prof.section_name(n.section).c_str(), format_time(n.inclusive_ns).c_str(),
+                    format_time(n.self_ns).c_str(), (unsigned long)n.count);
+        }
+        std::vector<int> kids = n.children;
+        std::sort(kids.begin(), kids.end(), [&](int a, int b) {
+            return tree.nodes[a].inclusive_ns < tree.nodes[b].inclusive_ns;
+        });
+        for (int k : kids) todo.push_back(item{ k, cur.depth + 1 });
+    }
+    if (tree.dropped) {
+        fprintf(out, "\n%lu activations beyond the per-thread node limit are counted in their "
+                "deepest recorded ancestor\n", (unsigned long)tree.dropped);
+    }
+}
+
+/* ============================================================================
+ * Folded Stacks
+ * ============================================================================ */
+
+/* Frame names must not contain the frame separator */
+static std::string folded_name(const std::string &name)
+{
+    std::string out = name;
+    std::replace(out.begin(), out.end(), ';', ':');
+    std::replace(out.begin(), out.end(), '\n', ' ');
+    return out;
+}
+
+/*
+ * Add the self time of every context of a tree, keyed by its folded path.
+ */
+static void fold_tree(const profile &prof, const profile_tree &tree, const std::string &prefix,
+                      std::map<std::string, uint64_t> &stacks)
+{
+    std::vector<std::string> paths(tree.nodes.size());
+    paths[0] = prefix;
+    for (size_t i = 1; i < tree.nodes.size(); i++) {
+        const profile_node &n = tree.nodes[i];
+        const std::string &parent = paths[n.parent];
+        paths[i] = (parent.empty() ? "" : parent + ";") + folded_name(prof.section_name(n.section));
+        if (n.self_ns > 0) stacks[paths[i]] += n.self_ns;
+    }
+}
+
+static std::map<std::string, uint64_t> folded_stacks(const profile &prof, uint32_t tid,
+                                                     bool per_thread)
+{
+    std::map<std::string, uint64_t> stacks;
+    if (tid == 0 && !per_thread) {
+        fold_tree(prof, prof.merged(), "", stacks);
+        return stacks;
+    }
+    for (const auto &t : prof.threads) {
+        if (tid != 0 && t.tid != tid) continue;
+        fold_tree(prof, t, per_thread ? "thread " + std::to_string(t.tid) : "", stacks);
+    }
+    return stacks;
+}
+
+static void write_folded(const std::map<std::string, uint64_t> &stacks, FILE *out)
+{
+    for (const auto &s : stacks) {
+        fprintf(out, "%s %llu\n", s.first.c_str(), (unsigned long long)s.second);
+    }
+}
+
+static void write_folded_diff(const std::map<std::string, uint64_t> &base,
+                              const std::map<std::string, uint64_t> &current, FILE *out)
+{
+    std::map<std::string, std::pair<uint64_t, uint64_t>> both;
+    for (const auto &s : base) both[s.first].first = s.second;
+    for (const auto &s : current) both[s.first].second = s.second;
+    for (const auto &s : both) {
+        fprintf(out, "%s %llu %llu\n", s.first.c_str(), (unsigned long long)s.second.first,
+                (unsigned long long)s.second.second);
+    }
+}
+
+/* ============================================================================
+ * Main
+ * ============================================================================ */
+
+static void usage(void)
+{
+    fprintf(stderr,
+            "Usage: narwhalyzer-report [options] <profile>\n"
+            "\n"
+            "Options:\n"
+            "  --folded          Write folded stacks (a;b;c self_ns)\n"
+            "  --diff BASE       With --folded: differential stacks against BASE\n"
+            "  --thread TID      Only this thread\n"
+            "  --per-thread      One root frame per thread instead of merging\n"
+            "  --pprof           Write a gzipped pprof profile\n"
+            "  --callgrind       Write a callgrind profile for KCachegrind\n"
+            "  --html            Write a self-contained HTML report\n"
+            "  --output FILE     Write to FILE instead of standard output\n");
+}
+
+static int load_profile(profile &prof, const char *path)
+{
+    if (!prof.load(path)) {
+        fprintf(stderr, "narwhalyzer-report: %s\n", prof.error().c_str());
+        return 1;
+    }
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    bool folded = false, per_thread = false, pprof = false, callgrind = false;
+    bool html = false;
+    const char *diff_base = nullptr;
+    const char *output = nullptr;
+    const char *path = nullptr;
+    uint32_t tid = 0;
+
+    for (int i = 1; i < argc; i++) {
+        const char *arg = argv[i];
+        const char *value = i + 1 < argc ? argv[i + 1] : nullptr;
+
+        if (strcmp(arg, "--folded") == 0) {
+            folded = true;
+        } else if (strcmp(arg, "--per-thread") == 0) {
+            per_thread = true;
+        } else if (strcmp(arg, "--pprof") == 0) {
+            pprof = true;
+        } else if (strcmp(arg, "--callgrind") == 0) {
+            callgrind = true;
+        } else if (strcmp(arg, "--html") == 0) {
+            html = true;
+        } else if (strcmp(arg, "--diff") == 0 && value) {
+            diff_base = value;
+            i++;
+        } else if (strcmp(arg, "--thread") == 0 && value) {
+            tid = (uint32_t)strtoul(value, nullptr, 10);
+            i++;
+        } else if (strcmp(arg, "--output") == 0 && value) {
+            output = value;
+            i++;
+        } else if (arg[0] != '-' && !path) {
+            path = arg;
+        } else {
+            usage();
+            return 2;
+        }
+    }
+    if (!path || (diff_base && !folded) || folded + pprof + callgrind + html > 1) {
+        usage();
+        return 2;
+    }
+
+    profile prof;
+    if (load_profile(prof, path) != 0) return 1;
+
+    FILE *out = stdout;
+    if (output) {
+        out = fopen(output, "wb");
+        if (!out) {
+            fprintf(stderr, "narwhalyzer-report: cannot create %s\n", output);
+            return 1;
+        }
+    }
+
+    int status = 0;
+    if (pprof) {
+        status = write_pprof(prof, out);
+    } else if (callgrind) {
+        status = write_callgrind(prof, tid, per_thread, out);
+    } else if (html) {
+        status = write_html(prof, out);
+    } else if (!folded) {
+        print_text(prof, out);
+    } else if (diff_base) {
+        profile base;
+        if (load_profile(base, diff_base) != 0) return 1;
+        write_folded_diff(folded_stacks(base, tid, per_thread),
+                          folded_stacks(prof, tid, per_thread), out);
+    } else {
+        write_folded(folded_stacks(prof, tid, per_thread), out);
+    }
+
+    if ((out != stdout && fclose(out) != 0) || status != 0) {
+        fprintf(stderr, "narwhalyzer-report: error writing %s\n", output ? output : "output");
+        return 1;
+    }
+    return 0;
+}
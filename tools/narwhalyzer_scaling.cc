@@ -0,0 +1,361 @@
+/*
+ * narwhalyzer_scaling.cc
+ *
+ * Thread-scaling analysis of calling-context profiles (NARWHALYZER_PROFILE)
+ * of one workload run at different thread counts.
+ *
+ *   narwhalyzer-scaling [--efficiency E] [--min-percent P] [--csv]
+ *                       [N:]<profile>...
+ *
+ * The thread count of each profile is the most threads that were inside
+ * one section at once (exact for 1-7 and for 2^k, 1.25 * 2^k, 1.5 * 2^k
+ * and 1.75 * 2^k, the runtime's concurrency histogram buckets), or N when
+ * given as N:profile. For several profiles at the same thread count the
+ * fastest is used, as benchmarks usually do.
+ *
+ * A section's time at p threads is its occupied wall time: how long at
+ * least one thread was inside it, from its concurrency histogram, which
+ * the runtime records with NARWHALYZER_OCCUPANCY=1. It is
+ * compared with the smallest thread count p0 (ideally 1), assuming the
+ * same total work (strong scaling):
+ *
+ *   speedup     S(p) = T(p0) / T(p) * p0
+ *   efficiency  E(p) = S(p) / p
+ *   Karp-Flatt  e(p) = (1/S - 1/p) / (1 - 1/p)
+ *
+ * The Karp-Flatt metric is the experimentally determined serial fraction.
+ * If it stays flat as p grows, the section is limited by serial work
+ * (Amdahl's law). If it rises, the cost is parallel overhead such as lock
+ * contention, false sharing or memory bandwidth, which more cores make
+ * worse. A section "breaks" at the first thread count where its
+ * efficiency falls below --efficiency or its time grows; sections are
+ * listed by that thread count, earliest first.
+ *
+ * Copyright (c) 2026
+ * Licensed under GPL-3.0 License
+ */
+
+#include "profile_reader.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <string>
+#include <vector>
+
+using namespace narwhalyzer;
+
+/* ============================================================================
+ * Measurements
+ * ============================================================================ */
+
+/* Wall time during which at least one thread was inside the section */
+static uint64_t occupied_ns(const profile_section &s)
+{
+    auto it = s.histograms.find("concurrency");
+    if (it == s.histograms.end()) return 0;
+    uint64_t ns = 0;
+    for (const auto &b : it->second) {
+        if (b.first >= 1) ns += b.second;
+    }
+    return ns;
+}
+
+/* Most threads inside one section at once, 0 without concurrency data */
+static int peak_threads(const profile &prof)
+{
+    uint64_t peak = 0;
+    for (const profile_section &s : prof.sections) {
+        auto it = s.histograms.find("concurrency");
+        if (it == s.histograms.end()) continue;
+        for (const auto &b : it->second) {
+            if (b.second) peak = std::max(peak, b.first);
+        }
+    }
+    return (int)peak;
+}
+
+struct scaling_point {
+    int threads = 0;
+    double wall_ns = 0.0;
+    double speedup = NAN;
+    double efficiency = NAN;
+    double karp_flatt = NAN;
+};
+
+struct scaling_series {
+    std::string name;
+    std::string location;
+    std::vector<scaling_point> points;  /* By thread count */
+    int breaks_at = 0;                  /* 0 if it never breaks */
+    bool overhead = false;              /* Karp-Flatt rises with p */
+    double base_percent = 0.0;          /* Share of the program time at p0 */
+};
+
+/*
+ * Fill in speedup, efficiency and Karp-Flatt relative to the first point,
+ * and find where scaling breaks.
+ */
+static void evaluate(scaling_series &s, double min_efficiency)
+{
+    const scaling_point &base = s.points[0];
+    for (size_t i = 0; i < s.points.size(); i++) {
+        scaling_point &pt = s.points[i];
+        if (!(pt.wall_ns > 0.0) || !(base.wall_ns > 0.0)) continue;
+        pt.speedup = base.wall_ns / pt.wall_ns * base.threads;
+        pt.efficiency = pt.speedup / pt.threads;
+        /* The base point's speedup is assumed, not measured: skip it */
+        if (i > 0 && pt.threads > 1) {
+            double p = pt.threads;
+            pt.karp_flatt = (1.0 / pt.speedup - 1.0 / p) / (1.0 - 1.0 / p);
+        }
+
+        if (i > 0 && !s.breaks_at &&
+            (pt.efficiency < min_efficiency || pt.wall_ns > s.points[i - 1].wall_ns)) {
+            s.breaks_at = pt.threads;
+        }
+    }
+
+    /* Compare the serial fraction at the first and last measured points */
+    const scaling_point *first = nullptr, *last = nullptr;
+    for (const scaling_point &pt : s.points) {
+        if (std::isnan(pt.karp_flatt)) continue;
+        if (!first) first = &pt;
+        last = &pt;
+    }
+    if (first && last != first) {
+        s.overhead = last->karp_flatt > 0.01 &&
+                     last->karp_flatt > 1.5 * std::max(first->karp_flatt, 0.0);
+    }
+}
+
+/* ============================================================================
+ * Output
+ * ============================================================================ */
+
+static std::string format_number(double value, const char *format)
+{
+    if (std::isnan(value)) return "-";
+    char buf[32];
+    snprintf(buf, sizeof(buf), format, value);
+    return buf;
+}
+
+static void print_series(const scaling_series &s)
+{
+    printf("%s", s.name.c_str());
+    if (!s.location.empty()) printf(" (%s, %.1f%% of the program)", s.location.c_str(),
+                                    s.base_percent);
+    printf("\n");
+    if (s.breaks_at) {
+        printf("  Scaling breaks at %d threads", s.breaks_at);
+    } else {
+        printf("  Scales to %d threads", s.points.back().threads);
+    }
+    if (s.points.size() > 2) {
+        printf(s.overhead ? "; Karp-Flatt rises: parallel overhead\n"
+                          : "; Karp-Flatt flat: serial fraction\n");
+    } else {
+        printf("\n");
+    }
+
+    printf("  %-12s", "threads");
+    for (const auto &pt : s.points) printf(" %10d", pt.threads);
+    printf("\n  %-12s", "wall time");
+    for (const auto &pt : s.points) {
+        printf(" %10s", format_time(pt.wall_ns > 0.0 ? pt.wall_ns : NAN).c_str());
+    }
+    printf("\n  %-12s", "speedup");
+    for (const auto &pt : s.points) printf(" %10s", format_number(pt.speedup, "%.2f").c_str());
+    printf("\n  %-12s", "efficiency");
+    for (const auto &pt : s.points) {
+        printf(" %10s", format_number(100.0 * pt.efficiency, "%.0f%%").c_str());
+    }
+    printf("\n  %-12s", "Karp-Flatt");
+    for (const auto &pt : s.points) printf(" %10s", format_number(pt.karp_flatt, "%.3f").c_str());
+    printf("\n\n");
+}
+
+static std::string csv_quoted(const std::string &text)
+{
+    std::string out = "\"";
+    for (char ch : text) {
+        if (ch == '"') out += '"';
+        out += ch;
+    }
+    return out + "\"";
+}
+
+static void print_csv(const std::vector<scaling_series> &all)
+{
+    printf("section,location,threads,wall_ns,speedup,efficiency,karp_flatt,breaks_at\n");
+    for (const scaling_series &s : all) {
+        for (const auto &pt : s.points) {
+            printf("%s,%s,%d,%.0f,%s,%s,%s,%d\n", csv_quoted(s.name).c_str(),
+                   csv_quoted(s.location).c_str(),
+                   pt.threads, pt.wall_ns, format_number(pt.speedup, "%.4f").c_str(),
+                   format_number(pt.efficiency, "%.4f").c_str(),
+                   format_number(pt.karp_flatt, "%.4f").c_str(), s.breaks_at);
+        }
+    }
+}
+
+/* ============================================================================
+ * Main
+ * ============================================================================ */
+
+static void usage(void)
+{
+    fprintf(stderr,
+            "Usage: narwhalyzer-scaling [options] [N:]<profile>...\n"
+            "\n"
+            "N is the thread count of the profile (default: the most threads inside\n"
+            "one section at once). Give at least two different thread counts.\n"
+            "\n"
+            "Options:\n"
+            "  --efficiency E    Efficiency below which scaling breaks (default 0.7)\n"
+            "  --min-percent P   Skip sections below P%% of the program time (default 1)\n"
+            "  --csv             Write one CSV row per section and thread count\n");
+}
+
+struct loaded_run {
+    int threads = 0;
+    profile prof;
+    std::map<std::string, const profile_section *> by_key;   /* Keyed by name, file and line */
+};
+
+static std::string section_key(const std::string &name, const std::string &file, int line)
+{
+    return name + '\t' + file + '\t' + std::to_string(line);
+}
+
+int main(int argc, char **argv)
+{
+    double min_efficiency = 0.7;
+    double min_percent = 1.0;
+    bool csv = false;
+    std::vector<std::pair<int, const char *>> inputs;
+
+    for (int i = 1; i < argc; i++) {
+        const char *arg = argv[i];
+        const char *value = i + 1 < argc ? argv[i + 1] : nullptr;
+
+        if (strcmp(arg, "--efficiency") == 0 && value) {
+            min_efficiency = atof(value);
+            i++;
+        } else if (strcmp(arg, "--min-percent") == 0 && value) {
+            min_percent = atof(value);
+            i++;
+        } else if (strcmp(arg, "--csv") == 0) {
+            csv = true;
+        } else if (arg[0] != '-') {
+            /* N:path, unless the prefix is not a number (paths may contain ':') */
+            char *end;
+            long threads = strtol(arg, &end, 10);
+            if (end != arg && *end == ':' && threads > 0) {
+                inputs.emplace_back((int)threads, end + 1);
+            } else {
+                inputs.emplace_back(0, arg);
+            }
+        } else {
+            usage();
+            return 2;
+        }
+    }
+    if (inputs.empty()) {
+        usage();
+        return 2;
+    }
+
+    /* Keep the fastest profile at each thread count */
+    std::map<int, loaded_run> runs;
+    for (const auto &input : inputs) {
+        loaded_run run;
+        if (!run.prof.load(input.second)) {
+            fprintf(stderr, "narwhalyzer-scaling: %s\n", run.prof.error().c_str());
+            return 1;
+        }
+        int peak = peak_threads(run.prof);
+        if (peak < 1) {
+            fprintf(stderr, "narwhalyzer-scaling: %s: no concurrency data, record it with "
+                    "NARWHALYZER_OCCUPANCY=1\n", input.second);
+            return 1;
+        }
+        run.threads = input.first ? input.first : peak;
+        auto it = runs.find(run.threads);
+        if (it == runs.end() || run.prof.total_ns < it->second.prof.total_ns) {
+            runs[run.threads] = std::move(run);
+        }
+    }
+    if (runs.size() < 2) {
+        fprintf(stderr, "narwhalyzer-scaling: need profiles at two or more thread counts\n");
+        return 2;
+    }
+
+    for (auto &r : runs) {
+        for (const profile_section &ps : r.second.prof.sections) {
+            r.second.by_key.emplace(section_key(ps.name, ps.file, ps.line), &ps);
+        }
+    }
+
+    /* The program, then every section present at the smallest thread count */
+    const profile &base = runs.begin()->second.prof;
+    std::vector<scaling_series> all;
+
+    scaling_series program;
+    program.name = "(program)";
+    for (const auto &r : runs) {
+        scaling_point pt;
+        pt.threads = r.first;
+        pt.wall_ns = (double)r.second.prof.total_ns;
+        program.points.push_back(pt);
+    }
+    evaluate(program, min_efficiency);
+
+    for (const profile_section &bs : base.sections) {
+        if (bs.entries == 0) continue;
+        scaling_series s;
+        s.name = bs.name;
+        s.location = bs.file + ":" + std::to_string(bs.line);
+        s.base_percent = base.total_ns ? 100.0 * (double)occupied_ns(bs) / (double)base.total_ns
+                                       : 0.0;
+        if (s.base_percent < min_percent) continue;
+
+        std::string key = section_key(bs.name, bs.file, bs.line);
+        for (const auto &r : runs) {
+            scaling_point pt;
+            pt.threads = r.first;
+            auto it = r.second.by_key.find(key);
+            if (it != r.second.by_key.end()) {
+                pt.wall_ns = (double)occupied_ns(*it->second);
+            }
+            s.points.push_back(pt);
+        }
+        evaluate(s, min_efficiency);
+        all.push_back(s);
+    }
+
+    /* Earliest break first; among equals, the lowest final efficiency */
+    std::stable_sort(all.begin(), all.end(), [](const scaling_series &a, const scaling_series &b) {
+        int ba = a.breaks_at ? a.breaks_at : 1 << 30;
+        int bb = b.breaks_at ? b.breaks_at : 1 << 30;
+        if (ba != bb) return ba < bb;
+        double ea = a.points.back().efficiency, eb = b.points.back().efficiency;
+        return (std::isnan(ea) ? 0.0 : ea) < (std::isnan(eb) ? 0.0 : eb);
+    });
+    all.insert(all.begin(), program);
+
+    if (csv) {
+        print_csv(all);
+        return 0;
+    }
+
+    printf("Thread counts:");
+    for (const auto &r : runs) printf(" %d", r.first);
+    printf(" (relative to %d, strong scaling)\n\n", runs.begin()->first);
+    for (const scaling_series &s : all) print_series(s);
+    return 0;
+}
@@ -0,0 +1,465 @@
+/*
+ * narwhalyzer_timeline.cc
+ *
+ * Merge the traces of several processes (fork children, ranks on one host)
+ * into one timeline.
+ *
+ *   narwhalyzer-timeline [--output FILE] [--section NAME] <trace>...
+ *
+ * Each trace records monotonic/realtime clock pairs at start, with every
+ * chunk and at exit. A least-squares line through those pairs maps the
+ * process's monotonic timestamps to wall-clock time, which is common to all
+ * processes, so the traces line up even if their clocks drift apart.
+ *
+ * With --output the merged timeline is written in the Chrome trace event
+ * format (chrome://tracing, Perfetto), one track per process and thread.
+ * The tool also lines up the sections of each process's main thread,
+ * occurrence by occurrence, and reports how long each process
+ * finished before the slowest one, i.e. how long it would wait at a
+ * barrier following the section.
+ *
+ * Copyright (c) 2026
+ * Licensed under GPL-3.0 License
+ */
+
+#include "trace_reader.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <set>
+#include <string>
+#include <vector>
+
+using namespace narwhalyzer;
+
+/* ============================================================================
+ * Clock Alignment
+ * ============================================================================ */
+
+/*
+ * realtime = base_real + (mono - base_mono) * (1 + slope) + intercept,
+ * fitted relative to the first pair to keep the doubles small.
+ */
+struct clock_fit {
+    uint64_t base_mono = 0;
+    uint64_t base_real = 0;
+    double slope = 0.0;
+    double intercept = 0.0;
+    size_t pairs = 0;
+    double residual_ns = 0.0;           /* Largest deviation from the line */
+
+    int64_t to_realtime(uint64_t mono) const
+    {
+        double dx = (double)(int64_t)(mono - base_mono);
+        return (int64_t)base_real + (int64_t)(mono - base_mono) +
+               (int64_t)llround(dx * slope + intercept);
+    }
+};
+
+static clock_fit fit_clock(const trace_file &trace)
+{
+    std::vector<narwhalyzer_trace_clock_pair_t> pairs;
+    pairs.push_back(trace.header().start_clock);
+    for (const auto &entry : trace.index()) {
+        pairs.push_back(trace.chunk(entry).header->clock);
+    }
+    if (trace.footer()) {
+        pairs.push_back(trace.footer()->end_clock);
+    }
+
+    clock_fit fit;
+    fit.base_mono = pairs[0].monotonic_ns;
+    fit.base_real = pairs[0].realtime_ns;
+    fit.pairs = pairs.size();
+
+    /* Fit the offset drift y = realtime - monotonic against x = monotonic */
+    double sx = 0, sy = 0, sxx = 0, sxy = 0, n = (double)pairs.size();
+    std::vector<std::pair<double, double>> points;
+    for (const auto &p : pairs) {
+        double x = (double)(int64_t)(p.monotonic_ns - fit.base_mono);
+        double y = (double)((int64_t)(p.realtime_ns - fit.base_real) -
+                            (int64_t)(p.monotonic_ns - fit.base_mono));
+        points.push_back({ x, y });
+        sx += x;
+        sy += y;
+        sxx += x * x;
+        sxy += x * y;
+    }
+
+    /* Below a millisecond of span the slope is noise: keep the offset only */
+    double span = 0.0;
+    for (const auto &p : points) span = std::max(span, p.first);
+    double det = n * sxx - sx * sx;
+    if (span >= 1e6 && det > 0.0) {
+        fit.slope = (n * sxy - sx * sy) / det;
+    }
+    fit.intercept = (sy - fit.slope * sx) / n;
+
+    for (const auto &p : points) {
+        double r = std::fabs(p.second - (p.first * fit.slope + fit.intercept));
+        fit.residual_ns = std::max(fit.residual_ns, r);
+    }
+    return fit;
+}
+
+/* ============================================================================
+ * Per-Process Data
+ * ============================================================================ */
+
+struct activation {
+    int64_t start_ns;                   /* Aligned, relative to the timeline start */
+    int64_t end_ns;
+};
+
+struct process {
+    std::unique_ptr<trace_file> trace;
+    clock_fit clock;
+    uint32_t pid;
+    /* Activations on the main thread, by section name */
+    std::map<std::string, std::vector<activation>> activations;
+};
+
+/*
+ * Chunks of one thread in order, which is also t_min order.
+ */
+static std::map<uint32_t, std::vector<narwhalyzer_trace_index_entry_t>>
+chunks_by_thread(const trace_file &trace)
+{
+    std::map<uint32_t, std::vector<narwhalyzer_trace_index_entry_t>> threads;
+    for (const auto &entry : trace.index()) {
+        threads[entry.tid].push_back(entry);
+    }
+    return threads;
+}
+
+/*
+ * Collect the activations of each section on the main thread (tid == pid),
+ * which is where ranks and fork children do their synchronized work.
+ * Recursive activations are folded into the outermost one.
+ */
+static void collect_activations(process &p, int64_t zero)
+{
+    auto threads = chunks_by_thread(*p.trace);
+    auto it = threads.find(p.pid);
+    if (it == threads.end()) return;
+
+    struct frame { uint32_t section; uint64_t start_ns; };
+    std::vector<frame> stack;
+    std::map<uint32_t, int> depth;
+
+    for (const auto &entry : it->second) {
+        trace_chunk c = p.trace->chunk(entry);
+        if (c.header->open_count == c.header->open_depth) {
+            /* A complete snapshot replaces the stack carried over */
+            stack.clear();
+            depth.clear();
+            for (uint32_t i = 0; i < c.header->open_count; i++) {
+                stack.push_back(frame{ c.frames[i].section, c.frames[i].start_ns });
+                depth[c.frames[i].section]++;
+            }
+        }
+
+        for (const auto *ev = c.begin(); ev != c.end(); ev++) {
+            if (ev->kind == NARWHALYZER_TRACE_ENTER) {
+                stack.push_back(frame{ ev->section, ev->timestamp_ns });
+                depth[ev->section]++;
+                continue;
+            }
+            if (stack.empty() || stack.back().section != ev->section) continue;
+            frame f = stack.back();
+            stack.pop_back();
+            if (--depth[f.section] > 0) continue;
+
+            p.activations[p.trace->section_name(f.section)].push_back(activation{
+                p.clock.to_realtime(f.start_ns) - zero,
+                p.clock.to_realtime(ev->timestamp_ns) - zero });
+        }
+    }
+}
+
+/* ============================================================================
+ * Chrome Trace Output
+ * ============================================================================ */
+
+static std::string json_escape(const std::string &text)
+{
+    std::string out;
+    for (char ch : text) {
+        if (ch == '"' || ch == '\\') {
+            out.push_back('\\');
+            out.push_back(ch);
+        } else if ((unsigned char)ch < 0x20) {
+            char buf[8];
+            snprintf(buf, sizeof(buf), "\\u%04x", (unsigned char)ch);
+            out += buf;
+        } else {
+            out.push_back(ch);
+        }
+    }
+    return out;
+}
+
+/*
+ * Write the events of all processes. Timestamps are microseconds since the
+ * earliest trace start; B/E pairs nest per thread, which is all the format
+ * requires, so each thread's chunks are written in order without sorting.
+ */
+static int write_chrome_trace(const std::vector<process> &processes, int64_t zero,
+                              const char *path)
+{
+    FILE *out = fopen(path, "w");
+    if (!out) {
+        fprintf(stderr, "narwhalyzer-timeline: cannot create %s\n", path);
+        return 1;
+    }
+
+    fprintf(out, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+    bool first_event = true;
+    auto separator = [&]() {
+        if (!first_event) fputs(",\n", out);
+        first_event = false;
+    };
+
+    for (const auto &p : processes) {
+        const trace_file &trace = *p.trace;
+        std::vector<std::string> names;
+        for (size_t i = 0; i < trace.sections().size(); i++) {
+            names.push_back(json_escape(trace.section_name((uint32_t)i)));
+        }
+        auto name_of = [&](uint32_t section) {
+            return section < names.size() ? names[section] : trace.section_name(section);
+        };
+
+        separator();
+        fprintf(out, "{\"ph\":\"M\",\"name\":\"process_name\",\"pid\":%u,"
+                     "\"args\":{\"name\":\"pid %u%s\"}}",
+                p.pid, p.pid,
+                trace.header().parent_pid
+                    ? (" (child of " + std::to_string(trace.header().parent_pid) + ")").c_str()
+                    : "");
+
+        for (const auto &thread : chunks_by_thread(trace)) {
+            separator();
+            fprintf(out, "{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":%u,\"tid\":%u,"
+                         "\"args\":{\"name\":\"%s %u\"}}",
+                    p.pid, thread.first, thread.first == p.pid ? "main" : "thread",
+                    thread.first);
+
+            bool first_chunk = true;
+            for (const auto &entry : thread.second) {
+                trace_chunk c = trace.chunk(entry);
+                if (first_chunk) {
+                    /* Sections already open when the thread's trace starts */
+                    for (uint32_t i = 0; i < c.header->open_count; i++) {
+                        separator();
+                        fprintf(out, "{\"ph\":\"B\",\"pid\":%u,\"tid\":%u,\"ts\":%.3f,\"name\":\"%s\"}",
+                                p.pid, thread.first,
+                                (double)(p.clock.to_realtime(c.frames[i].start_ns) - zero) / 1e3,
+                                name_of(c.frames[i].section).c_str());
+                    }
+                    first_chunk = false;
+                }
+                for (const auto *ev = c.begin(); ev != c.end(); ev++) {
+                    separator();
+                    fprintf(out, "{\"ph\":\"%c\",\"pid\":%u,\"tid\":%u,\"ts\":%.3f,\"name\":\"%s\"}",
+                            ev->kind == NARWHALYZER_TRACE_ENTER ? 'B' : 'E', p.pid, thread.first,
+                            (double)(p.clock.to_realtime(ev->timestamp_ns) - zero) / 1e3,
+                            name_of(ev->section).c_str());
+                }
+            }
+        }
+    }
+
+    fprintf(out, "\n]}\n");
+    if (fclose(out) != 0) {
+        fprintf(stderr, "narwhalyzer-timeline: error writing %s\n", path);
+        return 1;
+    }
+    return 0;
+}
+
+/* ============================================================================
+ * Cross-Process Analysis
+ * ============================================================================ */
+
+static std::string format_time(double ns)
+{
+    char buf[32];
+    double a = std::fabs(ns);
+    if (a < 1e3) snprintf(buf, sizeof(buf), "%.0f ns", ns);
+    else if (a < 1e6) snprintf(buf, sizeof(buf), "%.3f us", ns / 1e3);
+    else if (a < 1e9) snprintf(buf, sizeof(buf), "%.3f ms", ns / 1e6);
+    else snprintf(buf, sizeof(buf), "%.3f s", ns / 1e9);
+    return buf;
+}
+
+/*
+ * For every section present in several processes, match the k-th
+ * occurrence across processes and measure how far apart they end.
+ */
+static void print_wait_analysis(const std::vector<process> &processes, const char *only)
+{
+    std::set<std::string> names;
+    for (const auto &p : processes) {
+        for (const auto &s : p.activations) names.insert(s.first);
+    }
+
+    std::map<uint32_t, double> total_wait;
+    bool header = false;
+
+    for (const auto &name : names) {
+        if (only && name != only) continue;
+
+        std::vector<const process *> members;
+        size_t occurrences = SIZE_MAX;
+        for (const auto &p : processes) {
+            auto it = p.activations.find(name);
+            if (it == p.activations.end()) continue;
+            members.push_back(&p);
+            occurrences = std::min(occurrences, it->second.size());
+        }
+        if (members.size() < 2 || occurrences == 0) continue;
+
+        double start_skew = 0.0, end_skew = 0.0, max_end_skew = 0.0;
+        std::map<uint32_t, size_t> last_count;
+        for (size_t k = 0; k < occurrences; k++) {
+            int64_t min_start = INT64_MAX, max_start = INT64_MIN;
+            int64_t min_end = INT64_MAX, max_end = INT64_MIN;
+            const process *slowest = nullptr;
+            for (const process *p : members) {
+                const activation &a = p->activations.at(name)[k];
+                min_start = std::min(min_start, a.start_ns);
+                max_start = std::max(max_start, a.start_ns);
+                min_end = std::min(min_end, a.end_ns);
+                if (a.end_ns > max_end) {
+                    max_end = a.end_ns;
+                    slowest = p;
+                }
+            }
+            for (const process *p : members) {
+                total_wait[p->pid] += (double)(max_end - p->activations.at(name)[k].end_ns);
+            }
+            start_skew += (double)(max_start - min_start);
+            end_skew += (double)(max_end - min_end);
+            max_end_skew = std::max(max_end_skew, (double)(max_end - min_end));
+            last_count[slowest->pid]++;
+        }
+
+        auto straggler = std::max_element(last_count.begin(), last_count.end(),
+            [](const std::pair<const uint32_t, size_t> &a, const std::pair<const uint32_t, size_t> &b) {
+                return a.second < b.second;
+            });
+
+        if (!header) {
+            printf("\nSections matched across processes (main threads):\n\n");
+            printf("%-28s %6s %8s %14s %14s %14s   %s\n", "Section", "Procs", "Matched",
+                   "Start skew", "End skew", "Max end skew", "Last to finish");
+            header = true;
+        }
+        char last[64];
+        snprintf(last, sizeof(last), "pid %u (%zu/%zu)", straggler->first, straggler->second,
+                 occurrences);
+        printf("%-28.28s %6zu %8zu %14s %14s %14s   %s\n", name.c_str(), members.size(),
+               occurrences, format_time(start_skew / (double)occurrences).c_str(),
+               format_time(end_skew / (double)occurrences).c_str(),
+               format_time(max_end_skew).c_str(), last);
+    }
+
+    if (!header) {
+        printf("\nNo section occurs in more than one process.\n");
+        return;
+    }
+
+    printf("\nTime each process finished before the slowest (waiting at a barrier):\n\n");
+    for (const auto &w : total_wait) {
+        printf("  pid %-10u %14s\n", w.first, format_time(w.second).c_str());
+    }
+}
+
+/* ============================================================================
+ * Main
+ * ============================================================================ */
+
+static void usage(void)
+{
+    fprintf(stderr,
+            "Usage: narwhalyzer-timeline [options] <trace>...\n"
+            "\n"
+            "Options:\n"
+            "  --output FILE     Write the merged timeline as a Chrome trace (JSON)\n"
+            "  --section NAME    Only analyze this section\n");
+}
+
+int main(int argc, char **argv)
+{
+    const char *output = nullptr;
+    const char *section = nullptr;
+    std::vector<const char *> paths;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--output") == 0 && i + 1 < argc) {
+            output = argv[++i];
+        } else if (strcmp(argv[i], "--section") == 0 && i + 1 < argc) {
+            section = argv[++i];
+        } else if (argv[i][0] == '-') {
+            usage();
+            return 2;
+        } else {
+            paths.push_back(argv[i]);
+        }
+    }
+    if (paths.empty()) {
+        usage();
+        return 2;
+    }
+
+    std::vector<process> processes;
+    for (const char *path : paths) {
+        process p;
+        p.trace.reset(new trace_file);
+        if (!p.trace->open(path)) {
+            fprintf(stderr, "narwhalyzer-timeline: %s\n", p.trace->error().c_str());
+            return 1;
+        }
+        if (!p.trace->warning().empty()) {
+            fprintf(stderr, "narwhalyzer-timeline: warning: %s\n", p.trace->warning().c_str());
+        }
+        p.pid = p.trace->header().pid;
+        p.clock = fit_clock(*p.trace);
+        processes.push_back(std::move(p));
+    }
+
+    /* The timeline starts at the earliest trace start */
+    int64_t zero = INT64_MAX;
+    for (const auto &p : processes) {
+        zero = std::min(zero, p.clock.to_realtime(p.trace->header().start_clock.monotonic_ns));
+    }
+
+    printf("%-10s %-10s %12s %8s %12s %14s  %s\n", "Process", "Parent", "Start", "Pairs",
+           "Drift", "Fit residual", "Trace");
+    for (const auto &p : processes) {
+        int64_t start = p.clock.to_realtime(p.trace->header().start_clock.monotonic_ns) - zero;
+        char drift[32];
+        snprintf(drift, sizeof(drift), "%.3f ppm", p.clock.slope * 1e6);
+        printf("%-10u %-10s %12s %8zu %12s %14s  %s\n", p.pid,
+               p.trace->header().parent_pid ? std::to_string(p.trace->header().parent_pid).c_str() : "-",
+               format_time((double)start).c_str(), p.clock.pairs, drift,
+               format_time(p.clock.residual_ns).c_str(), p.trace->path().c_str());
+    }
+
+    for (auto &p : processes) {
+        collect_activations(p, zero);
+    }
+    print_wait_analysis(processes, section);
+
+    if (output) {
+        if (write_chrome_trace(processes, zero, output) != 0) return 1;
+        fprintf(stderr, "narwhalyzer-timeline: wrote %s\n", output);
+    }
+
+    return 0;
+}
@@ -0,0 +1,286 @@
+/*
+ * narwhalyzer_trace.cc
+ *
+ * Query tool for Narwhalyzer trace files (NARWHALYZER_TRACE).
+ *
+ *   narwhalyzer-trace info <trace>
+ *   narwhalyzer-trace extract <trace> [--from S] [--to S]
+ *                                     [--around S [--window S]]
+ *                                     [--thread TID] [--output FILE]
+ *
+ * Times are seconds since the start of the trace. Only the chunks whose
+ * index entry overlaps the requested window and thread are read, so a
+ * slice of a very large trace costs about as much as the slice itself.
+ * With --output the selected chunks are copied into a new, smaller trace
+ * file that the other tools accept; otherwise events are printed as text.
+ *
+ * Copyright (c) 2026
+ * Licensed under GPL-3.0 License
+ */
+
+#include "trace_reader.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <string>
+#include <vector>
+
+using namespace narwhalyzer;
+
+static void usage(void)
+{
+    fprintf(stderr,
+            "Usage:\n"
+            "  narwhalyzer-trace info <trace>\n"
+            "  narwhalyzer-trace extract <trace> [options]\n"
+            "\n"
+            "Extract options (times in seconds since trace start):\n"
+            "  --from S          Start of the window\n"
+            "  --to S            End of the window\n"
+            "  --around S        Center of the window\n"
+            "  --window S        Width of the window with --around (default 3)\n"
+            "  --thread TID      Only events of this thread\n"
+            "  --output FILE     Write the selected chunks as a new trace file\n");
+}
+
+/*
+ * Parse a duration in seconds. Returns false if malformed.
+ */
+static bool parse_seconds(const char *text, double *out)
+{
+    char *end;
+    *out = strtod(text, &end);
+    return end != text && *end == '\0' && *out >= 0.0;
+}
+
+static uint64_t seconds_to_ns(double seconds)
+{
+    return (uint64_t)(seconds * 1e9 + 0.5);
+}
+
+/* ============================================================================
+ * info
+ * ============================================================================ */
+
+static int command_info(const trace_file &trace)
+{
+    const auto &header = trace.header();
+    uint64_t base = header.start_clock.monotonic_ns;
+
+    std::map<uint32_t, std::pair<uint64_t, uint64_t>> threads; /* tid -> chunks, events */
+    uint64_t events = 0;
+    for (const auto &e : trace.index()) {
+        threads[e.tid].first++;
+        threads[e.tid].second += e.event_count;
+        events += e.event_count;
+    }
+
+    printf("Trace:     %s\n", trace.path().c_str());
+    printf("Process:   %u\n", header.pid);
+    printf("Complete:  %s\n", trace.complete() ? "yes" : "no (index rebuilt from chunks)");
+    printf("Sections:  %zu\n", trace.sections().size());
+    printf("Chunks:    %zu\n", trace.index().size());
+    printf("Events:    %llu\n", (unsigned long long)events);
+    if (!trace.index().empty()) {
+        printf("Time span: %.6f s - %.6f s\n",
+               (double)(trace.t_min() - base) / 1e9, (double)(trace.t_max() - base) / 1e9);
+    }
+    printf("\nThreads:\n");
+    for (const auto &t : threads) {
+        printf("  %-10u %8llu chunks %12llu events\n", t.first,
+               (unsigned long long)t.second.first, (unsigned long long)t.second.second);
+    }
+
+    return 0;
+}
+
+/* ============================================================================
+ * extract
+ * ============================================================================ */
+
+/*
+ * Print the selected events as text, one per line, merged across threads.
+ */
+static void print_events(const trace_file &trace,
+                         const std::vector<narwhalyzer_trace_index_entry_t> &chunks,
+                         uint64_t from, uint64_t to)
+{
+    uint64_t base = trace.header().start_clock.monotonic_ns;
+
+    struct selected_event {
+        const narwhalyzer_trace_event_t *event;
+        uint32_t tid;
+    };
+    std::vector<selected_event> events;
+
+    for (const auto &entry : chunks) {
+        trace_chunk c = trace.chunk(entry);
+        for (const auto *ev = c.lower_bound(from); ev != c.end() && ev->timestamp_ns <= to; ev++) {
+            events.push_back({ ev, entry.tid });
+        }
+    }
+
+    std::stable_sort(events.begin(), events.end(),
+                     [](const selected_event &a, const selected_event &b) {
+                         return a.event->timestamp_ns < b.event->timestamp_ns;
+                     });
+
+    for (const auto &e : events) {
+        printf("%.9f %u %s %s\n", (double)(e.event->timestamp_ns - base) / 1e9, e.tid,
+               e.event->kind == NARWHALYZER_TRACE_ENTER ? "enter" : "exit ",
+               trace.section_name(e.event->section).c_str());
+    }
+}
+
+/*
+ * Copy the selected chunks into a new trace file with its own index.
+ * Chunks are copied whole so that each keeps its open-section snapshot.
+ */
+static int write_subset(const trace_file &trace,
+                        const std::vector<narwhalyzer_trace_index_entry_t> &chunks,
+                        const char *path)
+{
+    FILE *out = fopen(path, "wb");
+    if (!out) {
+        fprintf(stderr, "narwhalyzer-trace: cannot create %s\n", path);
+        return 1;
+    }
+
+    narwhalyzer_trace_file_header_t header = trace.header();
+    header.header_size = sizeof(header);
+    fwrite(&header, sizeof(header), 1, out);
+
+    std::vector<narwhalyzer_trace_index_entry_t> index;
+    uint64_t offset = sizeof(header);
+    for (const auto &entry : chunks) {
+        trace_chunk c = trace.chunk(entry);
+        fwrite(c.header, entry.size, 1, out);
+        narwhalyzer_trace_index_entry_t copy = entry;
+        copy.offset = offset;
+        index.push_back(copy);
+        offset += entry.size;
+    }
+
+    /* Section table: entries followed by the string blob */
+    const auto &sections = trace.sections();
+    std::vector<narwhalyzer_trace_section_entry_t> entries;
+    std::string blob;
+    for (const auto &s : sections) {
+        narwhalyzer_trace_section_entry_t e;
+        e.name_offset = (uint32_t)blob.size();
+        blob.append(s.name).push_back('\0');
+        e.file_offset = (uint32_t)blob.size();
+        blob.append(s.file).push_back('\0');
+        e.line = s.line;
+        e.parent_index = s.parent_index;
+        entries.push_back(e);
+    }
+
+    narwhalyzer_trace_footer_t footer;
+    memset(&footer, 0, sizeof(footer));
+    footer.section_table_offset = offset;
+    footer.section_table_size = entries.size() * sizeof(entries[0]) + blob.size();
+    footer.section_count = (uint32_t)entries.size();
+    footer.index_offset = offset + footer.section_table_size;
+    footer.index_count = index.size();
+    if (trace.footer()) {
+        footer.end_clock = trace.footer()->end_clock;
+    }
+    footer.magic = NARWHALYZER_TRACE_FOOTER_MAGIC;
+
+    fwrite(entries.data(), sizeof(narwhalyzer_trace_section_entry_t), entries.size(), out);
+    fwrite(blob.data(), 1, blob.size(), out);
+    fwrite(index.data(), sizeof(narwhalyzer_trace_index_entry_t), index.size(), out);
+    fwrite(&footer, sizeof(footer), 1, out);
+
+    if (fclose(out) != 0) {
+        fprintf(stderr, "narwhalyzer-trace: error writing %s\n", path);
+        return 1;
+    }
+
+    fprintf(stderr, "narwhalyzer-trace: wrote %zu chunks to %s\n", index.size(), path);
+    return 0;
+}
+
+static int command_extract(const trace_file &trace, int argc, char **argv)
+{
+    double from_s = 0.0, to_s = -1.0, around_s = -1.0, window_s = 3.0;
+    uint32_t tid = 0;
+    const char *output = nullptr;
+
+    for (int i = 0; i < argc; i++) {
+        const char *arg = argv[i];
+        const char *value = i + 1 < argc ? argv[i + 1] : nullptr;
+        bool ok = value != nullptr;
+
+        if (strcmp(arg, "--from") == 0 && ok) {
+            ok = parse_seconds(value, &from_s);
+        } else if (strcmp(arg, "--to") == 0 && ok) {
+            ok = parse_seconds(value, &to_s);
+        } else if (strcmp(arg, "--around") == 0 && ok) {
+            ok = parse_seconds(value, &around_s);
+        } else if (strcmp(arg, "--window") == 0 && ok) {
+            ok = parse_seconds(value, &window_s);
+        } else if (strcmp(arg, "--thread") == 0 && ok) {
+            tid = (uint32_t)strtoul(value, nullptr, 10);
+        } else if (strcmp(arg, "--output") == 0 && ok) {
+            output = value;
+        } else {
+            ok = false;
+        }
+
+        if (!ok) {
+            fprintf(stderr, "narwhalyzer-trace: invalid argument %s\n", arg);
+            usage();
+            return 2;
+        }
+        i++;
+    }
+
+    if (around_s >= 0.0) {
+        from_s = around_s > window_s / 2 ? around_s - window_s / 2 : 0.0;
+        to_s = around_s + window_s / 2;
+    }
+
+    uint64_t base = trace.header().start_clock.monotonic_ns;
+    uint64_t from = base + seconds_to_ns(from_s);
+    uint64_t to = to_s >= 0.0 ? base + seconds_to_ns(to_s) : UINT64_MAX;
+
+    std::vector<narwhalyzer_trace_index_entry_t> chunks = trace.select(from, to, tid);
+
+    if (output) {
+        return write_subset(trace, chunks, output);
+    }
+
+    print_events(trace, chunks, from, to);
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 3) {
+        usage();
+        return 2;
+    }
+
+    trace_file trace;
+    if (!trace.open(argv[2])) {
+        fprintf(stderr, "narwhalyzer-trace: %s\n", trace.error().c_str());
+        return 1;
+    }
+    if (!trace.warning().empty()) {
+        fprintf(stderr, "narwhalyzer-trace: warning: %s\n", trace.warning().c_str());
+    }
+
+    if (strcmp(argv[1], "info") == 0) {
+        return command_info(trace);
+    }
+    if (strcmp(argv[1], "extract") == 0) {
+        return command_extract(trace, argc - 3, argv + 3);
+    }
+
+    usage();
+    return 2;
+}
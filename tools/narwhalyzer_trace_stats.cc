@@ -0,0 +1,527 @@
+/*
+ * narwhalyzer_trace_stats.cc
+ *
+ * Exact per-section statistics from a Narwhalyzer trace file.
+ *
+ *   narwhalyzer-trace-stats <trace> [--from S] [--to S]
+ *                                   [--around S [--window S]]
+ *                                   [--thread TID] [--jobs N]
+ *                                   [--cct] [--min-percent P]
+ *
+ * Chunks are independent: each starts with a snapshot of the sections
+ * open on its thread, and the index gives the end of the previous chunk of
+ * the same thread. Worker threads therefore process chunks in any order
+ * with private accumulators that are merged at the end, and throughput
+ * scales with the number of cores.
+ *
+ * Inclusive time is the time a section is on the stack (recursive
+ * activations counted once), self time is the time it is on top of the
+ * stack. Both are exact and clipped to the selected window. Percentiles of
+ * activation durations come from log-linear histograms with 1/128 relative
+ * bucket width.
+ *
+ * Copyright (c) 2026
+ * Licensed under GPL-3.0 License
+ */
+
+#include "trace_reader.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+using namespace narwhalyzer;
+
+/* ============================================================================
+ * Duration Histogram
+ * ============================================================================ */
+
+/* Values below 2^SUB_BITS get their own bucket, then 2^SUB_BITS per octave */
+static const int HIST_SUB_BITS = 7;
+static const int HIST_BUCKETS = (64 - HIST_SUB_BITS + 1) << HIST_SUB_BITS;
+
+static int hist_bucket(uint64_t value)
+{
+    if (value < (1u << HIST_SUB_BITS)) return (int)value;
+    int exp = 63 - __builtin_clzll(value);
+    int sub = (int)(value >> (exp - HIST_SUB_BITS)) & ((1 << HIST_SUB_BITS) - 1);
+    return ((exp - HIST_SUB_BITS + 1) << HIST_SUB_BITS) + sub;
+}
+
+static uint64_t hist_lower(int bucket)
+{
+    if (bucket < (1 << HIST_SUB_BITS)) return (uint64_t)bucket;
+    int exp = (bucket >> HIST_SUB_BITS) + HIST_SUB_BITS - 1;
+    uint64_t sub = (uint64_t)(bucket & ((1 << HIST_SUB_BITS) - 1));
+    return ((1ULL << HIST_SUB_BITS) + sub) << (exp - HIST_SUB_BITS);
+}
+
+/* Sparse histogram: most sections only touch a few hundred buckets */
+typedef std::unordered_map<int, uint64_t> duration_hist;
+
+static uint64_t hist_quantile(const duration_hist &hist, uint64_t count, double q)
+{
+    if (count == 0) return 0;
+    std::map<int, uint64_t> ordered(hist.begin(), hist.end());
+    uint64_t rank = (uint64_t)(q * (double)(count - 1));
+    uint64_t seen = 0;
+    for (const auto &b : ordered) {
+        if (seen + b.second > rank) {
+            /* Interpolate within the bucket */
+            uint64_t lower = hist_lower(b.first);
+            uint64_t width = hist_lower(b.first + 1) - lower;
+            double fraction = ((double)(rank - seen) + 0.5) / (double)b.second;
+            return lower + (uint64_t)(fraction * (double)width);
+        }
+        seen += b.second;
+    }
+    return hist_lower(ordered.rbegin()->first);
+}
+
+/* ============================================================================
+ * Accumulators
+ * ============================================================================ */
+
+struct section_totals {
+    uint64_t count = 0;                 /* Outermost activations that ended */
+    uint64_t inclusive_ns = 0;
+    uint64_t self_ns = 0;
+    uint64_t max_ns = 0;
+    duration_hist durations;
+};
+
+/* Calling-context tree node, identified by its parent and section */
+struct cct_node {
+    int parent;
+    uint32_t section;
+    uint64_t count = 0;
+    uint64_t inclusive_ns = 0;
+    uint64_t self_ns = 0;
+};
+
+struct cct {
+    std::vector<cct_node> nodes;
+    std::unordered_map<uint64_t, int> children; /* (parent << 32 | section) -> node */
+
+    cct() { nodes.push_back(cct_node{ -1, UINT32_MAX }); }
+
+    int child(int parent, uint32_t section)
+    {
+        uint64_t key = ((uint64_t)(uint32_t)parent << 32) | section;
+        auto it = children.find(key);
+        if (it != children.end()) return it->second;
+        int id = (int)nodes.size();
+        nodes.push_back(cct_node{ parent, section });
+        children.emplace(key, id);
+        return id;
+    }
+};
+
+struct accumulator {
+    std::vector<section_totals> sections;
+    cct tree;
+    uint64_t events = 0;
+    uint64_t truncated = 0;             /* Chunks whose snapshot missed inner frames */
+
+    section_totals &section(uint32_t index)
+    {
+        if (index >= sections.size()) sections.resize(index + 1);
+        return sections[index];
+    }
+};
+
+/* ============================================================================
+ * Chunk Processing
+ * ============================================================================ */
+
+struct work_item {
+    narwhalyzer_trace_index_entry_t entry;
+    uint64_t covers_from;               /* End of the previous chunk of the thread */
+};
+
+struct open_frame {
+    uint32_t section;
+    uint64_t start_ns;
+    int node;                           /* CCT node of this activation */
+    bool outermost;                     /* No other activation of the section below */
+};
+
+/*
+ * Process one chunk. The chunk accounts for the time from the end of the
+ * previous chunk of its thread up to its last event, clipped to [from, to].
+ */
+static void process_chunk(const trace_file &trace, const work_item &item,
+                          uint64_t from, uint64_t to, accumulator &acc)
+{
+    trace_chunk c = trace.chunk(item.entry);
+    std::vector<open_frame> stack;
+    std::vector<uint32_t> active;       /* Activations on the stack per section */
+
+    auto push = [&](uint32_t section, uint64_t start_ns) {
+        int parent = stack.empty() ? 0 : stack.back().node;
+        if (section >= active.size()) active.resize(section + 1);
+        bool outermost = active[section]++ == 0;
+        stack.push_back(open_frame{ section, start_ns, acc.tree.child(parent, section), outermost });
+    };
+
+    /* Attribute [begin, end] to the sections on the stack */
+    auto account_self = [&](uint64_t begin, uint64_t end) {
+        if (end <= begin || stack.empty()) return;
+        acc.section(stack.back().section).self_ns += end - begin;
+        acc.tree.nodes[stack.back().node].self_ns += end - begin;
+    };
+
+    /* Inclusive time of an activation, clipped to the window */
+    auto clipped = [&](uint64_t start_ns, uint64_t end_ns) -> uint64_t {
+        uint64_t begin = start_ns > from ? start_ns : from;
+        return end_ns > begin ? end_ns - begin : 0;
+    };
+
+    if (c.header->open_count < c.header->open_depth) acc.truncated++;
+    for (uint32_t i = 0; i < c.header->open_count; i++) {
+        push(c.frames[i].section, c.frames[i].start_ns);
+    }
+
+    uint64_t cursor = item.covers_from > from ? item.covers_from : from;
+    bool reached_end = false;
+
+    for (const auto *ev = c.begin(); ev != c.end(); ev++) {
+        if (ev->timestamp_ns > to) {
+            reached_end = true;
+            break;
+        }
+        acc.events++;
+        account_self(cursor, ev->timestamp_ns);
+        if (ev->timestamp_ns > cursor) cursor = ev->timestamp_ns;
+
+        if (ev->kind == NARWHALYZER_TRACE_ENTER) {
+            push(ev->section, ev->timestamp_ns);
+            continue;
+        }
+
+        /* Exits normally match the top; tolerate out-of-order regions */
+        int pos = (int)stack.size() - 1;
+        while (pos >= 0 && stack[pos].section != ev->section) pos--;
+        if (pos < 0) continue;
+
+        open_frame frame = stack[pos];
+        stack.erase(stack.begin() + pos);
+        active[frame.section]--;
+
+        uint64_t duration = ev->timestamp_ns - frame.start_ns;
+        uint64_t in_window = clipped(frame.start_ns, ev->timestamp_ns);
+
+        cct_node &node = acc.tree.nodes[frame.node];
+        node.count++;
+        node.inclusive_ns += in_window;
+
+        if (frame.outermost) {
+            section_totals &s = acc.section(frame.section);
+            s.count++;
+            s.inclusive_ns += in_window;
+            if (duration > s.max_ns) s.max_ns = duration;
+            s.durations[hist_bucket(duration)]++;
+        }
+    }
+
+    /* Activations still open at the end of the window */
+    if (reached_end || (to != UINT64_MAX && c.header->t_max >= to)) {
+        account_self(cursor, to);
+        for (const auto &frame : stack) {
+            uint64_t in_window = clipped(frame.start_ns, to);
+            acc.tree.nodes[frame.node].inclusive_ns += in_window;
+            if (frame.outermost) {
+                acc.section(frame.section).inclusive_ns += in_window;
+            }
+        }
+    }
+}
+
+/*
+ * Merge a worker's accumulator into the result.
+ */
+static void merge_tree(cct &into, const cct &from, std::vector<int> &mapping)
+{
+    /* Parents always precede their children */
+    mapping.assign(from.nodes.size(), 0);
+    for (size_t i = 1; i < from.nodes.size(); i++) {
+        const cct_node &n = from.nodes[i];
+        int id = into.child(mapping[n.parent], n.section);
+        mapping[i] = id;
+        into.nodes[id].count += n.count;
+        into.nodes[id].inclusive_ns += n.inclusive_ns;
+        into.nodes[id].self_ns += n.self_ns;
+    }
+}
+
+static void merge(accumulator &into, const accumulator &from)
+{
+    into.events += from.events;
+    into.truncated += from.truncated;
+    for (uint32_t i = 0; i < from.sections.size(); i++) {
+        const section_totals &src = from.sections[i];
+        if (src.count == 0 && src.inclusive_ns == 0 && src.self_ns == 0) continue;
+        section_totals &dst = into.section(i);
+        dst.count += src.count;
+        dst.inclusive_ns += src.inclusive_ns;
+        dst.self_ns += src.self_ns;
+        if (src.max_ns > dst.max_ns) dst.max_ns = src.max_ns;
+        for (const auto &b : src.durations) dst.durations[b.first] += b.second;
+    }
+    std::vector<int> mapping;
+    merge_tree(into.tree, from.tree, mapping);
+}
+
+/* ============================================================================
+ * Output
+ * ============================================================================ */
+
+static std::string format_time(uint64_t ns)
+{
+    char buf[32];
+    if (ns < 1000ULL) snprintf(buf, sizeof(buf), "%lu ns", (unsigned long)ns);
+    else if (ns < 1000000ULL) snprintf(buf, sizeof(buf), "%.3f us", ns / 1e3);
+    else if (ns < 1000000000ULL) snprintf(buf, sizeof(buf), "%.3f ms", ns / 1e6);
+    else snprintf(buf, sizeof(buf), "%.3f s", ns / 1e9);
+    return buf;
+}
+
+static void print_sections(const trace_file &trace, const accumulator &acc)
+{
+    std::vector<uint32_t> order;
+    for (uint32_t i = 0; i < acc.sections.size(); i++) {
+        if (acc.sections[i].inclusive_ns > 0 || acc.sections[i].count > 0) order.push_back(i);
+    }
+    std::sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+        return acc.sections[a].inclusive_ns > acc.sections[b].inclusive_ns;
+    });
+
+    printf("%-32s %10s %12s %12s %12s %12s %12s %12s\n", "Section", "Count",
+           "Inclusive", "Self", "p50", "p90", "p99", "Max");
+    for (uint32_t i : order) {
+        const section_totals &s = acc.sections[i];
+        printf("%-32.32s %10lu %12s %12s %12s %12s %12s %12s\n",
+               trace.section_name(i).c_str(), (unsigned long)s.count,
+               format_time(s.inclusive_ns).c_str(), format_time(s.self_ns).c_str(),
+               format_time(hist_quantile(s.durations, s.count, 0.50)).c_str(),
+               format_time(hist_quantile(s.durations, s.count, 0.90)).c_str(),
+               format_time(hist_quantile(s.durations, s.count, 0.99)).c_str(),
+               format_time(s.max_ns).c_str());
+    }
+}
+
+static void print_tree(const trace_file &trace, const cct &tree, uint64_t total_ns,
+                       double min_percent)
+{
+    std::vector<std::vector<int>> children(tree.nodes.size());
+    for (size_t i = 1; i < tree.nodes.size(); i++) {
+        children[tree.nodes[i].parent].push_back((int)i);
+    }
+    for (auto &list : children) {
+        std::sort(list.begin(), list.end(), [&](int a, int b) {
+            return tree.nodes[a].inclusive_ns > tree.nodes[b].inclusive_ns;
+        });
+    }
+
+    printf("\nCalling-context tree (inclusive / self / count):\n\n");
+
+    /* Iterative depth-first walk; prefix holds the tree drawing per level */
+    struct item { int node; std::string prefix; bool last; };
+    std::vector<item> todo;
+    for (auto it = children[0].rbegin(); it != children[0].rend(); ++it) {
+        todo.push_back(item{ *it, "", false });
+    }
+    while (!todo.empty()) {
+        item cur = todo.back();
+        todo.pop_back();
+        const cct_node &n = tree.nodes[cur.node];
+        double percent = total_ns ? 100.0 * (double)n.inclusive_ns / (double)total_ns : 0.0;
+        if (percent < min_percent) continue;
+
+        bool root = n.parent == 0;
+        printf("%s%s%s  %s / %s / %lu  (%.1f%%)\n", cur.prefix.c_str(),
+               root ? "" : (cur.last ? "└── " : "├── "),
+               trace.section_name(n.section).c_str(),
+               format_time(n.inclusive_ns).c_str(), format_time(n.self_ns).c_str(),
+               (unsigned long)n.count, percent);
+
+        std::string prefix = root ? "" : cur.prefix + (cur.last ? "    " : "│   ");
+        const auto &kids = children[cur.node];
+        for (size_t k = kids.size(); k-- > 0;) {
+            todo.push_back(item{ kids[k], prefix, k == kids.size() - 1 });
+        }
+    }
+}
+
+/* ============================================================================
+ * Main
+ * ============================================================================ */
+
+static void usage(void)
+{
+    fprintf(stderr,
+            "Usage: narwhalyzer-trace-stats <trace> [options]\n"
+            "\n"
+            "Options (times in seconds since trace start):\n"
+            "  --from S          Start of the window\n"
+            "  --to S            End of the window\n"
+            "  --around S        Center of the window\n"
+            "  --window S        Width of the window with --around (default 3)\n"
+            "  --thread TID      Only this thread\n"
+            "  --jobs N          Worker threads (default: all cores)\n"
+            "  --cct             Print the calling-context tree\n"
+            "  --min-percent P   Hide tree nodes below P%% of the total (default 0.1)\n");
+}
+
+static bool parse_seconds(const char *text, double *out)
+{
+    char *end;
+    *out = strtod(text, &end);
+    return end != text && *end == '\0' && *out >= 0.0;
+}
+
+static uint64_t seconds_to_ns(double seconds)
+{
+    return (uint64_t)(seconds * 1e9 + 0.5);
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 2) {
+        usage();
+        return 2;
+    }
+
+    double from_s = 0.0, to_s = -1.0, around_s = -1.0, window_s = 3.0, min_percent = 0.1;
+    uint32_t tid = 0;
+    unsigned jobs = std::thread::hardware_concurrency();
+    bool show_tree = false;
+
+    for (int i = 2; i < argc; i++) {
+        const char *arg = argv[i];
+        const char *value = i + 1 < argc ? argv[i + 1] : nullptr;
+        bool ok = true;
+
+        if (strcmp(arg, "--cct") == 0) {
+            show_tree = true;
+            continue;
+        }
+        if (!value) {
+            ok = false;
+        } else if (strcmp(arg, "--from") == 0) {
+            ok = parse_seconds(value, &from_s);
+        } else if (strcmp(arg, "--to") == 0) {
+            ok = parse_seconds(value, &to_s);
+        } else if (strcmp(arg, "--around") == 0) {
+            ok = parse_seconds(value, &around_s);
+        } else if (strcmp(arg, "--window") == 0) {
+            ok = parse_seconds(value, &window_s);
+        } else if (strcmp(arg, "--min-percent") == 0) {
+            ok = parse_seconds(value, &min_percent);
+        } else if (strcmp(arg, "--thread") == 0) {
+            tid = (uint32_t)strtoul(value, nullptr, 10);
+        } else if (strcmp(arg, "--jobs") == 0) {
+            jobs = (unsigned)strtoul(value, nullptr, 10);
+        } else {
+            ok = false;
+        }
+
+        if (!ok) {
+            fprintf(stderr, "narwhalyzer-trace-stats: invalid argument %s\n", arg);
+            usage();
+            return 2;
+        }
+        i++;
+    }
+    if (jobs == 0) jobs = 1;
+
+    trace_file trace;
+    if (!trace.open(argv[1])) {
+        fprintf(stderr, "narwhalyzer-trace-stats: %s\n", trace.error().c_str());
+        return 1;
+    }
+    if (!trace.warning().empty()) {
+        fprintf(stderr, "narwhalyzer-trace-stats: warning: %s\n", trace.warning().c_str());
+    }
+
+    if (around_s >= 0.0) {
+        from_s = around_s > window_s / 2 ? around_s - window_s / 2 : 0.0;
+        to_s = around_s + window_s / 2;
+    }
+    uint64_t base = trace.header().start_clock.monotonic_ns;
+    uint64_t from = base + seconds_to_ns(from_s);
+    uint64_t to = to_s >= 0.0 ? base + seconds_to_ns(to_s) : UINT64_MAX;
+
+    auto started = std::chrono::steady_clock::now();
+
+    /*
+     * A chunk covers the time since the previous chunk of its thread ended,
+     * so select by that span rather than by its own events only.
+     */
+    std::map<uint32_t, uint64_t> thread_end;
+    std::vector<work_item> work;
+    for (const auto &entry : trace.index()) { /* Sorted by t_min */
+        if (tid != 0 && entry.tid != tid) continue;
+        auto it = thread_end.find(entry.tid);
+        uint64_t covers_from = it != thread_end.end() ? it->second : entry.t_min;
+        thread_end[entry.tid] = entry.t_max;
+        if (covers_from > to || entry.t_max < from) continue;
+        work.push_back(work_item{ entry, covers_from });
+    }
+
+    /* Largest chunks first for better load balance */
+    std::sort(work.begin(), work.end(), [](const work_item &a, const work_item &b) {
+        return a.entry.size > b.entry.size;
+    });
+
+    if (jobs > work.size()) jobs = work.empty() ? 1 : (unsigned)work.size();
+    std::vector<accumulator> partial(jobs);
+    std::atomic<size_t> next{ 0 };
+    std::vector<std::thread> workers;
+    for (unsigned j = 0; j < jobs; j++) {
+        workers.emplace_back([&, j]() {
+            for (size_t k = next++; k < work.size(); k = next++) {
+                process_chunk(trace, work[k], from, to, partial[j]);
+            }
+        });
+    }
+    for (auto &w : workers) w.join();
+
+    accumulator result = std::move(partial[0]);
+    for (unsigned j = 1; j < jobs; j++) merge(result, partial[j]);
+
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+
+    uint64_t window_begin = std::max(from, trace.t_min());
+    uint64_t window_end = std::min(to, trace.t_max());
+    printf("Trace: %s, window %.6f s - %.6f s%s\n", trace.path().c_str(),
+           (double)(window_begin - base) / 1e9, (double)(window_end - base) / 1e9,
+           tid ? (", thread " + std::to_string(tid)).c_str() : "");
+    printf("Processed %zu chunks, %lu events with %u workers in %.3f s\n\n",
+           work.size(), (unsigned long)result.events, jobs, elapsed);
+
+    if (result.truncated) {
+        printf("Note: %lu chunks started deeper than their stored snapshot; "
+               "times of the innermost sections there are lower bounds\n\n",
+               (unsigned long)result.truncated);
+    }
+
+    print_sections(trace, result);
+
+    if (show_tree) {
+        uint64_t total = 0;
+        for (size_t i = 1; i < result.tree.nodes.size(); i++) {
+            if (result.tree.nodes[i].parent == 0) total += result.tree.nodes[i].inclusive_ns;
+        }
+        print_tree(trace, result.tree, total, min_percent);
+    }
+
+    return 0;
+}
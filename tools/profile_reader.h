@@ -0,0 +1,300 @@
+/*
+ * profile_reader.h
+ *
+ * Reader for the calling-context profiles written with NARWHALYZER_PROFILE
+ * (see src/narwhalyzer_profile.c for the format).
+ *
+ * Copyright (c) 2026
+ * Licensed under GPL-3.0 License
+ */
+
+#ifndef NARWHALYZER_PROFILE_READER_H
+#define NARWHALYZER_PROFILE_READER_H
+
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace narwhalyzer {
+
+struct profile_section {
+    uint64_t entries = 0;
+    uint64_t cumulative_ns = 0;
+    uint64_t min_ns = 0;
+    uint64_t max_ns = 0;
+    int line = 0;
+    std::string name;
+    std::string file;
+    /* Histogram kind -> (bucket lower bound, count), in bucket order */
+    std::map<std::string, std::vector<std::pair<uint64_t, uint64_t>>> histograms;
+
+    /*
+     * Outermost activations: the duration histogram's count, which leaves
+     * out recursive entries, or the entries if it was not recorded.
+     */
+    uint64_t activations() const
+    {
+        auto it = histograms.find("duration");
+        if (it == histograms.end()) return entries;
+        uint64_t n = 0;
+        for (const auto &b : it->second) n += b.second;
+        return n ? n : entries;
+    }
+};
+
+/* Duration in ns as "12 ns", "1.234 us", ... or "-" for NaN */
+inline std::string format_time(double ns)
+{
+    char buf[32];
+    if (std::isnan(ns)) return "-";
+    if (ns < 1e3) snprintf(buf, sizeof(buf), "%.0f ns", ns);
+    else if (ns < 1e6) snprintf(buf, sizeof(buf), "%.3f us", ns / 1e3);
+    else if (ns < 1e9) snprintf(buf, sizeof(buf), "%.3f ms", ns / 1e6);
+    else snprintf(buf, sizeof(buf), "%.3f s", ns / 1e9);
+    return buf;
+}
+
+/* Exclusive upper bound of the runtime histogram bucket starting at lower */
+inline uint64_t histogram_bucket_upper(uint64_t lower)
+{
+    if (lower < 4) return lower + 1;
+    int exp = 63 - __builtin_clzll(lower);
+    return lower + (1ULL << (exp - 2));
+}
+
+/*
+ * Quantile of (lower bound, count) buckets in ascending order, interpolated
+ * linearly within its bucket. NaN if the histogram is empty.
+ */
+template <typename Buckets>
+double histogram_quantile(const Buckets &hist, double q)
+{
+    uint64_t total = 0;
+    for (const auto &b : hist) total += b.second;
+    if (total == 0) return NAN;
+
+    double target = q * (double)total;
+    double seen = 0.0;
+    uint64_t last = 0;
+    for (const auto &b : hist) {
+        if (b.second && seen + (double)b.second >= target) {
+            double frac = (target - seen) / (double)b.second;
+            return (double)b.first + frac * (double)(histogram_bucket_upper(b.first) - b.first);
+        }
+        seen += (double)b.second;
+        last = b.first;
+    }
+    return (double)last;
+}
+
+struct profile_node {
+    int parent = -1;
+    int section = -1;                   /* -1 for the root */
+    uint64_t count = 0;
+    uint64_t inclusive_ns = 0;
+    uint64_t self_ns = 0;               /* Inclusive minus the children's inclusive */
+    std::vector<int> children;
+};
+
+/*
+ * Calling-context tree of one thread, or of several threads merged.
+ * Node 0 is the root; parents precede their children.
+ */
+struct profile_tree {
+    uint32_t tid = 0;                   /* 0 for a merged tree */
+    uint64_t dropped = 0;               /* Activations beyond the runtime's node limit */
+    std::vector<profile_node> nodes;
+    std::unordered_map<uint64_t, int> lookup; /* (parent << 32 | section) -> node */
+
+    profile_tree() { nodes.emplace_back(); }
+
+    int child(int parent, int section)
+    {
+        uint64_t key = ((uint64_t)(uint32_t)parent << 32) | (uint32_t)section;
+        auto it = lookup.find(key);
+        if (it != lookup.end()) return it->second;
+        int id = (int)nodes.size();
+        nodes.emplace_back();
+        nodes[id].parent = parent;
+        nodes[id].section = section;
+        nodes[parent].children.push_back(id);
+        lookup.emplace(key, id);
+        return id;
+    }
+
+    /* Fill in self time and the root's inclusive time */
+    void finish()
+    {
+        nodes[0].inclusive_ns = 0;
+        for (int c : nodes[0].children) nodes[0].inclusive_ns += nodes[c].inclusive_ns;
+        for (auto &n : nodes) {
+            uint64_t children = 0;
+            for (int c : n.children) children += nodes[c].inclusive_ns;
+            n.self_ns = n.inclusive_ns > children ? n.inclusive_ns - children : 0;
+        }
+    }
+
+    /* Add another tree of the same profile, matching nodes by path */
+    void merge(const profile_tree &other)
+    {
+        std::vector<int> mapping(other.nodes.size(), 0);
+        for (size_t i = 1; i < other.nodes.size(); i++) {
+            const profile_node &n = other.nodes[i];
+            int id = child(mapping[n.parent], n.section);
+            mapping[i] = id;
+            nodes[id].count += n.count;
+            nodes[id].inclusive_ns += n.inclusive_ns;
+        }
+        dropped += other.dropped;
+    }
+};
+
+class profile {
+public:
+    /*
+     * Load a profile file. Returns false and sets error() on failure.
+     */
+    bool load(const std::string &path)
+    {
+        m_path = path;
+        FILE *in = fopen(path.c_str(), "r");
+        if (!in) return fail("cannot open file");
+
+        std::string line;
+        bool header = false;
+        profile_tree *tree = nullptr;
+        std::vector<int> id_map;        /* File node id -> tree node */
+
+        while (read_line(in, line)) {
+            std::vector<std::string> f = split(line);
+            if (f.empty()) continue;
+            const std::string &kind = f[0];
+
+            if (!header) {
+                if (kind != "narwhalyzer-profile" || f.size() < 2 || f[1] != "1") {
+                    fclose(in);
+                    return fail("not a narwhalyzer profile");
+                }
+                header = true;
+            } else if (kind == "pid" && f.size() >= 2) {
+                pid = (uint32_t)strtoul(f[1].c_str(), nullptr, 10);
+            } else if (kind == "command" && f.size() >= 2) {
+                command = f[1];
+            } else if (kind == "total_ns" && f.size() >= 2) {
+                total_ns = strtoull(f[1].c_str(), nullptr, 10);
+            } else if (kind == "section" && f.size() >= 9) {
+                size_t index = strtoul(f[1].c_str(), nullptr, 10);
+                if (index >= sections.size()) sections.resize(index + 1);
+                profile_section &s = sections[index];
+                s.entries = strtoull(f[2].c_str(), nullptr, 10);
+                s.cumulative_ns = strtoull(f[3].c_str(), nullptr, 10);
+                s.min_ns = strtoull(f[4].c_str(), nullptr, 10);
+                s.max_ns = strtoull(f[5].c_str(), nullptr, 10);
+                s.line = atoi(f[6].c_str());
+                s.name = f[7];
+                s.file = f[8];
+            } else if (kind == "hist" && f.size() >= 3) {
+                size_t index = strtoul(f[1].c_str(), nullptr, 10);
+                if (index >= sections.size()) sections.resize(index + 1);
+                auto &hist = sections[index].histograms[f[2]];
+                for (size_t i = 3; i < f.size(); i++) {
+                    size_t colon = f[i].find(':');
+                    if (colon == std::string::npos) continue;
+                    hist.emplace_back(strtoull(f[i].c_str(), nullptr, 10),
+                                      strtoull(f[i].c_str() + colon + 1, nullptr, 10));
+                }
+            } else if (kind == "thread" && f.size() >= 4) {
+                threads.emplace_back();
+                tree = &threads.back();
+                tree->tid = (uint32_t)strtoul(f[1].c_str(), nullptr, 10);
+                tree->dropped = strtoull(f[3].c_str(), nullptr, 10);
+                id_map.assign(1, 0);
+            } else if (kind == "node" && f.size() >= 6 && tree) {
+                size_t id = strtoul(f[1].c_str(), nullptr, 10);
+                size_t parent = strtoul(f[2].c_str(), nullptr, 10);
+                if (parent >= id_map.size() || id != id_map.size()) continue;
+                int node = tree->child(id_map[parent], atoi(f[3].c_str()));
+                tree->nodes[node].count += strtoull(f[4].c_str(), nullptr, 10);
+                tree->nodes[node].inclusive_ns += strtoull(f[5].c_str(), nullptr, 10);
+                id_map.push_back(node);
+            }
+        }
+        fclose(in);
+
+        if (!header) return fail("not a narwhalyzer profile");
+        for (auto &t : threads) t.finish();
+        return true;
+    }
+
+    const std::string &error() const { return m_error; }
+    const std::string &path() const { return m_path; }
+
+    std::string section_name(int index) const
+    {
+        if (index >= 0 && (size_t)index < sections.size() && !sections[index].name.empty()) {
+            return sections[index].name;
+        }
+        return "section_" + std::to_string(index);
+    }
+
+    /* All threads merged into one tree */
+    profile_tree merged() const
+    {
+        profile_tree tree;
+        for (const auto &t : threads) tree.merge(t);
+        tree.finish();
+        return tree;
+    }
+
+    uint32_t pid = 0;
+    std::string command;
+    uint64_t total_ns = 0;
+    std::vector<profile_section> sections;
+    std::vector<profile_tree> threads;
+
+private:
+    bool fail(const std::string &message)
+    {
+        m_error = m_path + ": " + message;
+        return false;
+    }
+
+    static bool read_line(FILE *in, std::string &line)
+    {
+        line.clear();
+        int ch;
+        while ((ch = fgetc(in)) != EOF && ch != '\n') line.push_back((char)ch);
+        return ch != EOF || !line.empty();
+    }
+
+    /* Split on tabs and undo the writer's escapes */
+    static std::vector<std::string> split(const std::string &line)
+    {
+        std::vector<std::string> fields(1);
+        for (size_t i = 0; i < line.size(); i++) {
+            char ch = line[i];
+            if (ch == '\t') {
+                fields.emplace_back();
+            } else if (ch == '\\' && i + 1 < line.size()) {
+                char next = line[++i];
+                fields.back().push_back(next == 't' ? '\t' : next == 'n' ? '\n' : next);
+            } else {
+                fields.back().push_back(ch);
+            }
+        }
+        return fields;
+    }
+
+    std::string m_path;
+    std::string m_error;
+};
+
+} // namespace narwhalyzer
+
+#endif /* NARWHALYZER_PROFILE_READER_H */
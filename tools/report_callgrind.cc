@@ -0,0 +1,139 @@
+/*
+ * report_callgrind.cc
+ *
+ * Callgrind export for KCachegrind and QCachegrind.
+ *
+ * Callgrind describes costs per function and per caller/callee edge, so
+ * the calling contexts are folded onto sections: the self time of every
+ * context counts for its section, and every context contributes a call
+ * edge from its parent's section with its count and inclusive time.
+ * Positions are source lines (the section's pragma line); the cost unit is
+ * nanoseconds.
+ *
+ * Output is written while walking the aggregated sections, and file and
+ * function names use callgrind's "(id) name" compression, so the file stays
+ * small and memory use is proportional to the number of distinct edges.
+ *
+ * Copyright (c) 2026
+ * Licensed under GPL-3.0 License
+ */
+
+#include "report_formats.h"
+
+#include <map>
+#include <string>
+
+namespace narwhalyzer {
+
+struct callgrind_edge {
+    uint64_t calls = 0;
+    uint64_t inclusive_ns = 0;
+};
+
+struct callgrind_function {
+    uint64_t self_ns = 0;
+    std::map<int, callgrind_edge> callees; /* Callee section -> edge */
+};
+
+/*
+ * Writes names with callgrind's compression: the first use of a name is
+ * "(id) name", later uses are just "(id)".
+ */
+class callgrind_names {
+public:
+    explicit callgrind_names(FILE *out) : m_out(out) {}
+
+    void write(const char *key, const std::string &name)
+    {
+        auto it = m_ids.find(name);
+        if (it != m_ids.end()) {
+            fprintf(m_out, "%s=(%d)\n", key, it->second);
+            return;
+        }
+        int id = (int)m_ids.size() + 1;
+        m_ids.emplace(name, id);
+        fprintf(m_out, "%s=(%d) %s\n", key, id, name.c_str());
+    }
+
+private:
+    FILE *m_out;
+    std::map<std::string, int> m_ids;
+};
+
+/*
+ * Write one part: the costs of one tree. Name ids are shared by all parts.
+ */
+static void write_part(const profile &prof, const profile_tree &tree, callgrind_names &files,
+                       callgrind_names &names, FILE *out)
+{
+    std::map<int, callgrind_function> functions;
+    for (size_t i = 1; i < tree.nodes.size(); i++) {
+        const profile_node &n = tree.nodes[i];
+        functions[n.section].self_ns += n.self_ns;
+        if (n.parent > 0) {
+            callgrind_edge &edge = functions[tree.nodes[n.parent].section].callees[n.section];
+            edge.calls += n.count;
+            edge.inclusive_ns += n.inclusive_ns;
+        }
+    }
+
+    uint64_t total = 0;
+    for (const auto &f : functions) total += f.second.self_ns;
+    fprintf(out, "summary: %llu\n\n", (unsigned long long)total);
+
+    auto file_of = [&](int section) {
+        if (section < 0 || (size_t)section >= prof.sections.size()) return std::string("???");
+        const std::string &file = prof.sections[section].file;
+        return file.empty() ? std::string("???") : file;
+    };
+    auto line_of = [&](int section) {
+        if (section < 0 || (size_t)section >= prof.sections.size()) return 0;
+        return prof.sections[section].line;
+    };
+
+    for (const auto &f : functions) {
+        int section = f.first;
+        files.write("fl", file_of(section));
+        names.write("fn", prof.section_name(section));
+        fprintf(out, "%d %llu\n", line_of(section), (unsigned long long)f.second.self_ns);
+
+        for (const auto &c : f.second.callees) {
+            files.write("cfi", file_of(c.first));
+            names.write("cfn", prof.section_name(c.first));
+            fprintf(out, "calls=%llu %d\n", (unsigned long long)c.second.calls, line_of(c.first));
+            fprintf(out, "%d %llu\n", line_of(section), (unsigned long long)c.second.inclusive_ns);
+        }
+        fputc('\n', out);
+    }
+
+    fprintf(out, "totals: %llu\n", (unsigned long long)total);
+}
+
+int write_callgrind(const profile &prof, uint32_t tid, bool per_thread, FILE *out)
+{
+    fprintf(out, "# callgrind format\n");
+    fprintf(out, "version: 1\n");
+    fprintf(out, "creator: narwhalyzer\n");
+    fprintf(out, "pid: %u\n", prof.pid);
+    fprintf(out, "cmd: %s\n", prof.command.c_str());
+    fprintf(out, "positions: line\n");
+    fprintf(out, "event: Time : Time (ns)\n");
+    fprintf(out, "events: Time\n");
+
+    callgrind_names files(out), names(out);
+    if (tid == 0 && !per_thread) {
+        fprintf(out, "\n");
+        write_part(prof, prof.merged(), files, names, out);
+        return ferror(out) ? 1 : 0;
+    }
+
+    int part = 0;
+    for (const auto &tree : prof.threads) {
+        if (tid != 0 && tree.tid != tid) continue;
+        fprintf(out, "\npart: %d\nthread: %u\n", ++part, tree.tid);
+        write_part(prof, tree, files, names, out);
+    }
+    return ferror(out) ? 1 : 0;
+}
+
+} // namespace narwhalyzer
@@ -0,0 +1,38 @@
+/*
+ * report_formats.h
+ *
+ * Profile exporters of narwhalyzer-report, one translation unit each.
+ *
+ * Copyright (c) 2026
+ * Licensed under GPL-3.0 License
+ */
+
+#ifndef NARWHALYZER_REPORT_FORMATS_H
+#define NARWHALYZER_REPORT_FORMATS_H
+
+#include "profile_reader.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+namespace narwhalyzer {
+
+/* Gzipped pprof profile.proto (report_pprof.cc). Returns 0 on success. */
+int write_pprof(const profile &prof, FILE *out);
+
+/*
+ * Callgrind format (report_callgrind.cc): all threads merged, one part per
+ * thread, or only thread tid if non-zero. Returns 0 on success.
+ */
+int write_callgrind(const profile &prof, uint32_t tid, bool per_thread, FILE *out);
+
+/* Gzip member with a fixed-Huffman deflate stream (report_pprof.cc) */
+std::vector<uint8_t> gzip_compress(const std::vector<uint8_t> &data);
+
+/* Self-contained HTML page (report_html.cc). Returns 0 on success. */
+int write_html(const profile &prof, FILE *out);
+
+} // namespace narwhalyzer
+
+#endif /* NARWHALYZER_REPORT_FORMATS_H */
@@ -0,0 +1,507 @@
+/*
+ * report_html.cc
+ *
+ * Self-contained HTML report: one file with the profile data embedded as
+ * JSON and a small script, with no external resources, so it can be
+ * opened offline on any machine with a browser.
+ *
+ * The page has a sortable and filterable section table, a collapsible
+ * calling-context tree, a per-thread breakdown and plots of the section
+ * histograms. The data is embedded column-wise with file names interned,
+ * and the calling-context trees as flat integer arrays, so the page stays
+ * close to the size of the profile file. Tables render a bounded number
+ * of rows and tree nodes are expanded on demand, so large profiles stay
+ * responsive.
+ *
+ * Copyright (c) 2026
+ * Licensed under GPL-3.0 License
+ */
+
+#include "report_formats.h"
+
+#include <algorithm>
+#include <cstdarg>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace narwhalyzer {
+
+/* ============================================================================
+ * Embedded Data
+ * ============================================================================ */
+
+/* Data larger than this is embedded gzip-compressed and base64-encoded */
+#define HTML_COMPRESS_THRESHOLD (1u << 20)
+
+static void appendf(std::string &out, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+
+static void appendf(std::string &out, const char *fmt, ...)
+{
+    char buf[128];
+    va_list ap;
+    va_start(ap, fmt);
+    int len = vsnprintf(buf, sizeof(buf), fmt, ap);
+    va_end(ap);
+    if (len > 0) out.append(buf, std::min((size_t)len, sizeof(buf) - 1));
+}
+
+/* Append a JSON string that is also safe inside a <script> element */
+static void json_string(std::string &out, const std::string &text)
+{
+    out.push_back('"');
+    for (unsigned char ch : text) {
+        if (ch == '"' || ch == '\\') {
+            out.push_back('\\');
+            out.push_back((char)ch);
+        } else if (ch == '<') {
+            out.append("\\u003c");
+        } else if (ch < 0x20) {
+            appendf(out, "\\u%04x", ch);
+        } else {
+            out.push_back((char)ch);
+        }
+    }
+    out.push_back('"');
+}
+
+template <typename Get>
+static void json_column(std::string &out, const char *key, size_t count, Get get)
+{
+    appendf(out, "\"%s\":[", key);
+    for (size_t i = 0; i < count; i++) {
+        appendf(out, "%s%llu", i ? "," : "", (unsigned long long)get(i));
+    }
+    out.push_back(']');
+}
+
+/*
+ * Embedded data:
+ *
+ *   { pid, cmd, total, files: [...],
+ *     sec: { name: [...], file: [...], line, n, cum, min, max },
+ *     hist: [[section, kind, [lower, count, ...]], ...],
+ *     threads: [{ tid, dropped, nodes: [up, section, count, inclusive, ...] }] }
+ *
+ * Section columns are indexed by section; sec.file indexes files. Nodes
+ * are numbered from 1 (0 is the root) and parents precede their children;
+ * "up" is the distance to the parent, mostly 1, which compresses well.
+ */
+static std::string profile_json(const profile &prof)
+{
+    std::string out;
+    std::map<std::string, size_t> file_ids;
+    std::vector<std::string> files;
+    std::vector<size_t> section_file(prof.sections.size());
+    for (size_t i = 0; i < prof.sections.size(); i++) {
+        auto it = file_ids.emplace(prof.sections[i].file, files.size()).first;
+        if (it->second == files.size()) files.push_back(prof.sections[i].file);
+        section_file[i] = it->second;
+    }
+
+    appendf(out, "{\"pid\":%u,\"cmd\":", prof.pid);
+    json_string(out, prof.command);
+    appendf(out, ",\"total\":%llu,\"files\":[", (unsigned long long)prof.total_ns);
+    for (size_t i = 0; i < files.size(); i++) {
+        if (i) out.push_back(',');
+        json_string(out, files[i]);
+    }
+
+    const auto &secs = prof.sections;
+    out.append("],\n\"sec\":{\"name\":[");
+    for (size_t i = 0; i < secs.size(); i++) {
+        if (i) out.push_back(',');
+        json_string(out, prof.section_name((int)i));
+    }
+    out.append("],\n");
+    json_column(out, "file", secs.size(), [&](size_t i) { return section_file[i]; });
+    out.push_back(',');
+    json_column(out, "line", secs.size(), [&](size_t i) { return (uint64_t)secs[i].line; });
+    out.push_back(',');
+    json_column(out, "n", secs.size(), [&](size_t i) { return secs[i].entries; });
+    out.append(",\n");
+    json_column(out, "cum", secs.size(), [&](size_t i) { return secs[i].cumulative_ns; });
+    out.append(",\n");
+    json_column(out, "min", secs.size(), [&](size_t i) { return secs[i].min_ns; });
+    out.append(",\n");
+    json_column(out, "max", secs.size(), [&](size_t i) { return secs[i].max_ns; });
+
+    out.append("},\n\"hist\":[");
+    bool first = true;
+    for (size_t i = 0; i < secs.size(); i++) {
+        for (const auto &h : secs[i].histograms) {
+            appendf(out, "%s[%zu,", first ? "" : ",\n", i);
+            json_string(out, h.first);
+            out.append(",[");
+            for (size_t b = 0; b < h.second.size(); b++) {
+                appendf(out, "%s%llu,%llu", b ? "," : "", (unsigned long long)h.second[b].first,
+                        (unsigned long long)h.second[b].second);
+            }
+            out.append("]]");
+            first = false;
+        }
+    }
+
+    out.append("],\n\"threads\":[");
+    for (size_t t = 0; t < prof.threads.size(); t++) {
+        const profile_tree &tree = prof.threads[t];
+        appendf(out, "%s{\"tid\":%u,\"dropped\":%llu,\"nodes\":[", t ? ",\n" : "", tree.tid,
+                (unsigned long long)tree.dropped);
+        for (size_t i = 1; i < tree.nodes.size(); i++) {
+            const profile_node &n = tree.nodes[i];
+            appendf(out, "%s%zu,%d,%llu,%llu", i > 1 ? "," : "", i - (size_t)n.parent, n.section,
+                    (unsigned long long)n.count, (unsigned long long)n.inclusive_ns);
+        }
+        out.append("]}");
+    }
+    out.append("]}");
+    return out;
+}
+
+static std::string base64(const std::vector<uint8_t> &data)
+{
+    static const char digits[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    std::string out;
+    out.reserve((data.size() + 2) / 3 * 4);
+    for (size_t i = 0; i < data.size(); i += 3) {
+        uint32_t v = (uint32_t)data[i] << 16;
+        if (i + 1 < data.size()) v |= (uint32_t)data[i + 1] << 8;
+        if (i + 2 < data.size()) v |= data[i + 2];
+        out.push_back(digits[(v >> 18) & 63]);
+        out.push_back(digits[(v >> 12) & 63]);
+        out.push_back(i + 1 < data.size() ? digits[(v >> 6) & 63] : '=');
+        out.push_back(i + 2 < data.size() ? digits[v & 63] : '=');
+    }
+    return out;
+}
+
+/* ============================================================================
+ * Page
+ * ============================================================================ */
+
+static const char page_head[] = R"HTML(<!DOCTYPE html>
+<html>
+<head>
+<meta charset="utf-8">
+<title>narwhalyzer report</title>
+<style>
+body { font: 13px sans-serif; margin: 16px; color: #222; }
+h1 { font-size: 18px; margin: 0 0 4px; }
+nav button { font: inherit; padding: 4px 12px; border: 1px solid #999; background: #eee; cursor: pointer; }
+nav button.on { background: #fff; border-bottom-color: #fff; font-weight: bold; }
+.controls { margin: 8px 0; }
+table { border-collapse: collapse; }
+th, td { padding: 2px 8px; border-bottom: 1px solid #ddd; text-align: right; white-space: nowrap; }
+th { background: #f4f4f4; cursor: pointer; user-select: none; position: sticky; top: 0; }
+td.l, th.l { text-align: left; }
+tr.sel td { background: #ffe9a8; }
+tbody tr:hover td { background: #f0f6ff; cursor: pointer; }
+.node { white-space: nowrap; line-height: 18px; }
+.node .t { display: inline-block; width: 14px; cursor: pointer; color: #666; }
+.bar { display: inline-block; height: 9px; background: #e8724a; margin-right: 6px; vertical-align: middle; }
+.muted { color: #777; }
+.plots svg { margin: 8px 16px 0 0; border: 1px solid #ddd; }
+</style>
+</head>
+<body>
+<h1>narwhalyzer report</h1>
+<div id="summary" class="muted"></div>
+<nav><button data-tab="sections" class="on">Sections</button><button data-tab="tree">Calling contexts</button><button data-tab="threads">Threads</button></nav>
+<div class="controls">
+Thread <select id="thread"></select>
+Filter <input id="filter" size="30" placeholder="section or file">
+</div>
+<div id="sections"><table><thead></thead><tbody></tbody></table><p id="more" class="muted"></p><div id="plots" class="plots"></div></div>
+<div id="tree" hidden></div>
+<div id="threads" hidden><table><thead></thead><tbody></tbody></table></div>
+)HTML";
+
+static const char page_tail[] = R"HTML(<script>
+"use strict";
+const $ = (id) => document.getElementById(id);
+const ROWS = 1000;
+let D, S, threads, merged, tree, T;
+const histograms = new Map();
+
+/* The data is plain JSON, or gzip and base64 for large profiles */
+async function load() {
+    const data = $("data");
+    if (data.type === "application/json") return JSON.parse(data.textContent);
+    const bytes = Uint8Array.from(atob(data.textContent.trim()), (c) => c.charCodeAt(0));
+    const stream = new Blob([bytes]).stream().pipeThrough(new DecompressionStream("gzip"));
+    return JSON.parse(await new Response(stream).text());
+}
+
+function fmt(ns) {
+    if (ns < 1e3) return ns + " ns";
+    if (ns < 1e6) return (ns / 1e3).toFixed(3) + " us";
+    if (ns < 1e9) return (ns / 1e6).toFixed(3) + " ms";
+    return (ns / 1e9).toFixed(3) + " s";
+}
+function esc(text) {
+    return String(text).replace(/[&<>"]/g, (c) => "&#" + c.charCodeAt(0) + ";");
+}
+
+/* Calling-context trees: one per thread, and all threads merged */
+function unpack(t) {
+    const n = t.nodes, count = n.length / 4 + 1;
+    const tree = { tid: t.tid, dropped: t.dropped, parent: [-1], section: [-1], count: [0],
+                   incl: [0], kids: [[]] };
+    for (let i = 1; i < count; i++) {
+        const p = i - n[4 * i - 4];
+        tree.parent.push(p); tree.section.push(n[4 * i - 3]);
+        tree.count.push(n[4 * i - 2]); tree.incl.push(n[4 * i - 1]);
+        tree.kids.push([]); tree.kids[p].push(i);
+    }
+    return finish(tree);
+}
+function finish(tree) {
+    tree.self = tree.incl.slice();
+    for (let i = 1; i < tree.parent.length; i++) tree.self[tree.parent[i]] -= tree.incl[i];
+    tree.incl[0] = tree.kids[0].reduce((a, k) => a + tree.incl[k], 0);
+    tree.self[0] = 0;
+    for (let i = 0; i < tree.self.length; i++) if (tree.self[i] < 0) tree.self[i] = 0;
+    return tree;
+}
+function merge(trees) {
+    const m = { tid: 0, dropped: 0, parent: [-1], section: [-1], count: [0], incl: [0], kids: [[]] };
+    const lookup = new Map();
+    for (const t of trees) {
+        const map = [0];
+        for (let i = 1; i < t.parent.length; i++) {
+            const p = map[t.parent[i]], key = p + ":" + t.section[i];
+            let id = lookup.get(key);
+            if (id === undefined) {
+                id = m.parent.length;
+                lookup.set(key, id);
+                m.parent.push(p); m.section.push(t.section[i]); m.count.push(0); m.incl.push(0);
+                m.kids.push([]); m.kids[p].push(id);
+            }
+            m.count[id] += t.count[i]; m.incl[id] += t.incl[i];
+            map.push(id);
+        }
+        m.dropped += t.dropped;
+    }
+    return finish(m);
+}
+/* Per-section totals of a tree; inclusive time counts outermost activations only */
+function totals(t) {
+    const n = S.name.length;
+    const r = { calls: new Array(n).fill(0), self: new Array(n).fill(0), incl: new Array(n).fill(0) };
+    const active = new Int32Array(n);
+    const stack = t.kids[0].slice();
+    while (stack.length) {
+        const i = stack.pop();
+        if (i < 0) { active[t.section[~i]]--; continue; }
+        const s = t.section[i];
+        r.calls[s] += t.count[i]; r.self[s] += t.self[i];
+        if (!active[s]) r.incl[s] += t.incl[i];
+        active[s]++;
+        stack.push(~i, ...t.kids[i]);
+    }
+    return r;
+}
+
+/* ---- Section table ---- */
+
+const columns = [
+    { key: "name", title: "Section", cls: "l", get: (i) => S.name[i] },
+    { key: "file", title: "Location", cls: "l", get: (i) => D.files[S.file[i]] + (S.line[i] ? ":" + S.line[i] : "") },
+    { key: "n", title: "Entries", get: (i) => S.n[i] },
+    { key: "cum", title: "Cumulative", get: (i) => S.cum[i], time: true },
+    { key: "mean", title: "Mean", get: (i) => S.n[i] ? S.cum[i] / S.n[i] : 0, time: true },
+    { key: "min", title: "Min", get: (i) => S.min[i], time: true },
+    { key: "max", title: "Max", get: (i) => S.max[i], time: true },
+    { key: "calls", title: "Calls (thread)", get: (i) => T.calls[i] },
+    { key: "incl", title: "Inclusive (thread)", get: (i) => T.incl[i], time: true },
+    { key: "self", title: "Self (thread)", get: (i) => T.self[i], time: true },
+    { key: "pct", title: "Self %", get: (i) => tree.incl[0] ? 100 * T.self[i] / tree.incl[0] : 0 },
+];
+let sortKey = "cum", sortDown = true, selected = -1;
+
+function renderSections() {
+    const head = $("sections").querySelector("thead");
+    head.innerHTML = "<tr>" + columns.map((c) => "<th class='" + (c.cls || "") + "' data-key='" + c.key + "'>" +
+        c.title + (c.key === sortKey ? (sortDown ? " &#9660;" : " &#9650;") : "") + "</th>").join("") + "</tr>";
+    const filter = $("filter").value.toLowerCase();
+    const col = columns.find((c) => c.key === sortKey);
+    let rows = [];
+    for (let i = 0; i < S.name.length; i++) {
+        if (!S.n[i] && !T.calls[i]) continue;
+        if (filter && !(S.name[i] + " " + D.files[S.file[i]]).toLowerCase().includes(filter)) continue;
+        rows.push(i);
+    }
+    rows.sort((a, b) => {
+        const x = col.get(a), y = col.get(b);
+        const c = x < y ? -1 : x > y ? 1 : 0;
+        return sortDown ? -c : c;
+    });
+    $("more").textContent = rows.length > ROWS ? "Showing " + ROWS + " of " + rows.length + " sections; refine the filter to see more." : "";
+    $("sections").querySelector("tbody").innerHTML = rows.slice(0, ROWS).map((i) =>
+        "<tr data-i='" + i + "'" + (i === selected ? " class='sel'" : "") + ">" + columns.map((c) => {
+            const v = c.get(i);
+            const text = c.time ? fmt(Math.round(v)) : c.key === "pct" ? v.toFixed(2) : v;
+            return "<td class='" + (c.cls || "") + "'>" + esc(text) + "</td>";
+        }).join("") + "</tr>").join("");
+}
+
+$("sections").querySelector("thead").addEventListener("click", (e) => {
+    const key = e.target.closest("th")?.dataset.key;
+    if (!key) return;
+    if (key === sortKey) sortDown = !sortDown; else { sortKey = key; sortDown = key !== "name" && key !== "file"; }
+    renderSections();
+});
+$("sections").querySelector("tbody").addEventListener("click", (e) => {
+    const row = e.target.closest("tr");
+    if (!row) return;
+    selected = +row.dataset.i;
+    renderSections();
+    renderPlots(selected);
+});
+
+/* ---- Histograms ---- */
+
+const histTitles = {
+    duration: ["Duration", "activations", fmt],
+    recursion: ["Recursion depth", "activations", (x) => x],
+    concurrency: ["Concurrent threads", "time", (x) => x],
+    interarrival: ["Time between entries", "entries", fmt],
+};
+
+function plot(kind, b) {
+    const [title, unit, label] = histTitles[kind] || [kind, "count", (x) => x];
+    const W = 420, H = 180, L = 40, B = 30, n = b.length / 2;
+    let max = 0;
+    for (let k = 0; k < n; k++) max = Math.max(max, b[2 * k + 1]);
+    const w = (W - L - 10) / Math.max(n, 1);
+    let svg = "<svg width='" + W + "' height='" + H + "'><text x='" + L + "' y='14' font-weight='bold'>" +
+        esc(title) + "</text><text x='" + (W - 10) + "' y='14' text-anchor='end' fill='#777'>" + unit + "</text>";
+    for (let k = 0; k < n; k++) {
+        const v = b[2 * k + 1], h = max ? (H - B - 24) * v / max : 0;
+        const x = L + k * w, y = H - B - h;
+        svg += "<rect x='" + x.toFixed(1) + "' y='" + y.toFixed(1) + "' width='" + Math.max(w - 1, 1).toFixed(1) +
+            "' height='" + h.toFixed(1) + "' fill='#e8724a'><title>&ge; " + esc(label(b[2 * k])) + ": " +
+            esc(kind === "concurrency" ? fmt(v) : v) + "</title></rect>";
+    }
+    svg += "<line x1='" + L + "' y1='" + (H - B) + "' x2='" + (W - 10) + "' y2='" + (H - B) + "' stroke='#999'/>";
+    if (n) {
+        svg += "<text x='" + L + "' y='" + (H - B + 14) + "' fill='#777'>" + esc(label(b[0])) + "</text>";
+        svg += "<text x='" + (W - 10) + "' y='" + (H - B + 14) + "' text-anchor='end' fill='#777'>" +
+            esc(label(b[2 * n - 2])) + "</text>";
+    }
+    return svg + "</svg>";
+}
+
+function renderPlots(s) {
+    const list = histograms.get(s) || [];
+    $("plots").innerHTML = "<h3>" + esc(S.name[s]) + "</h3>" +
+        (list.length ? list.map(([k, b]) => plot(k, b)).join("") : "<p class='muted'>No histograms recorded.</p>");
+}
+
+/* ---- Calling-context tree ---- */
+
+function nodeHtml(i, depth) {
+    const t = tree, open = t.kids[i].length ? "&#9656;" : "";
+    const pct = t.incl[0] ? 100 * t.incl[i] / t.incl[0] : 0;
+    return "<div class='node' data-i='" + i + "' style='padding-left:" + 16 * depth + "px'><span class='t'>" + open +
+        "</span><span class='bar' style='width:" + Math.max(pct, 0.5).toFixed(1) + "px'></span>" +
+        esc(S.name[t.section[i]]) + " <span class='muted'>" + fmt(t.incl[i]) + " incl, " + fmt(t.self[i]) +
+        " self, " + t.count[i] + " calls, " + pct.toFixed(1) + "%</span></div>";
+}
+function childrenHtml(i, depth) {
+    const kids = tree.kids[i].slice().sort((a, b) => tree.incl[b] - tree.incl[a]);
+    return kids.slice(0, ROWS).map((k) => nodeHtml(k, depth) + "<div class='kids' hidden></div>").join("") +
+        (kids.length > ROWS ? "<div class='muted' style='padding-left:" + 16 * depth + "px'>" +
+         (kids.length - ROWS) + " smaller contexts not shown</div>" : "");
+}
+function renderTree() {
+    $("tree").innerHTML = (tree.dropped ? "<p class='muted'>" + tree.dropped +
+        " activations beyond the per-thread node limit are counted in their deepest recorded ancestor.</p>" : "") +
+        childrenHtml(0, 0);
+}
+$("tree").addEventListener("click", (e) => {
+    const node = e.target.closest(".node");
+    if (!node || !tree.kids[+node.dataset.i].length) return;
+    const kids = node.nextElementSibling;
+    if (!kids.dataset.done) {
+        kids.innerHTML = childrenHtml(+node.dataset.i, parseInt(node.style.paddingLeft) / 16 + 1);
+        kids.dataset.done = 1;
+    }
+    kids.hidden = !kids.hidden;
+    node.firstChild.innerHTML = kids.hidden ? "&#9656;" : "&#9662;";
+});
+
+/* ---- Threads ---- */
+
+function renderThreads() {
+    $("threads").querySelector("thead").innerHTML =
+        "<tr><th>Thread</th><th>Contexts</th><th>Calls</th><th>Time in sections</th><th>Share</th><th>Dropped</th></tr>";
+    const total = merged.incl[0];
+    $("threads").querySelector("tbody").innerHTML = threads.slice().sort((a, b) => b.incl[0] - a.incl[0]).map((t) =>
+        "<tr data-tid='" + t.tid + "'" + (t === tree ? " class='sel'" : "") + "><td>" + t.tid + "</td><td>" +
+        (t.parent.length - 1) + "</td><td>" + t.count.reduce((a, c) => a + c, 0) + "</td><td>" + fmt(t.incl[0]) +
+        "</td><td>" + (total ? (100 * t.incl[0] / total).toFixed(1) : "0.0") + "%</td><td>" + t.dropped +
+        "</td></tr>").join("");
+}
+$("threads").querySelector("tbody").addEventListener("click", (e) => {
+    const row = e.target.closest("tr");
+    if (row) selectThread(+row.dataset.tid);
+});
+
+/* ---- Page ---- */
+
+function selectThread(tid) {
+    tree = tid ? threads.find((t) => t.tid === tid) : merged;
+    $("thread").value = tid;
+    T = totals(tree);
+    renderSections();
+    renderTree();
+    renderThreads();
+}
+
+function main(data) {
+    D = data;
+    S = D.sec;
+    threads = D.threads.map(unpack);
+    merged = merge(threads);
+    for (const [s, kind, b] of D.hist) {
+        if (!histograms.has(s)) histograms.set(s, []);
+        histograms.get(s).push([kind, b]);
+    }
+    $("summary").textContent = D.cmd + " (pid " + D.pid + "), total " + fmt(D.total) + ", " +
+        threads.length + " threads, " + S.name.length + " sections";
+    $("thread").innerHTML = "<option value='0'>All threads</option>" +
+        threads.map((t) => "<option value='" + t.tid + "'>" + t.tid + "</option>").join("");
+    selectThread(0);
+}
+
+$("thread").addEventListener("change", (e) => selectThread(+e.target.value));
+$("filter").addEventListener("input", renderSections);
+document.querySelector("nav").addEventListener("click", (e) => {
+    const tab = e.target.dataset.tab;
+    if (!tab) return;
+    for (const b of document.querySelectorAll("nav button")) b.classList.toggle("on", b === e.target);
+    for (const id of ["sections", "tree", "threads"]) $(id).hidden = id !== tab;
+});
+load().then(main, (e) => { $("summary").textContent = "Cannot read the embedded profile data: " + e; });
+</script>
+</body>
+</html>
+)HTML";
+
+int write_html(const profile &prof, FILE *out)
+{
+    std::string data = profile_json(prof);
+    fputs(page_head, out);
+    if (data.size() > HTML_COMPRESS_THRESHOLD) {
+        std::vector<uint8_t> raw(data.begin(), data.end());
+        fprintf(out, "<script id=\"data\" type=\"application/gzip\">%s</script>\n",
+                base64(gzip_compress(raw)).c_str());
+    } else {
+        fprintf(out, "<script id=\"data\" type=\"application/json\">%s</script>\n", data.c_str());
+    }
+    fputs(page_tail, out);
+    return ferror(out) ? 1 : 0;
+}
+
+} // namespace narwhalyzer
@@ -0,0 +1,367 @@
+/*
+ * report_pprof.cc
+ *
+ * pprof export: a gzip-compressed profile.proto message, readable by
+ * `pprof -http` and `go tool pprof -diff_base`.
+ *
+ * Every section becomes a function and a location (name, file, line).
+ * Every calling-context node of every thread becomes one sample whose
+ * location list is the section path, leaf first, with a "thread" label.
+ * Sample values are the activation count and the self time of the
+ * context; pprof derives inclusive time as its cumulative value, so
+ * storing inclusive time in the samples would count it twice.
+ *
+ * Both encoders are self-contained: protobuf fields are written by hand
+ * and gzip uses a small deflate compressor with fixed Huffman codes.
+ *
+ * Copyright (c) 2026
+ * Licensed under GPL-3.0 License
+ */
+
+#include "report_formats.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace narwhalyzer {
+
+/* ============================================================================
+ * Protocol Buffer Encoding
+ * ============================================================================ */
+
+class proto_writer {
+public:
+    void varint(uint64_t value)
+    {
+        while (value >= 0x80) {
+            m_data.push_back((uint8_t)(value | 0x80));
+            value >>= 7;
+        }
+        m_data.push_back((uint8_t)value);
+    }
+
+    /* Field of wire type 0; zero values are omitted as in proto3 */
+    void field_varint(int field, uint64_t value)
+    {
+        if (value == 0) return;
+        varint((uint64_t)field << 3);
+        varint(value);
+    }
+
+    /* Field of wire type 2 */
+    void field_bytes(int field, const void *data, size_t size)
+    {
+        varint(((uint64_t)field << 3) | 2);
+        varint(size);
+        const uint8_t *p = static_cast<const uint8_t *>(data);
+        m_data.insert(m_data.end(), p, p + size);
+    }
+
+    void field_message(int field, const proto_writer &message)
+    {
+        field_bytes(field, message.m_data.data(), message.m_data.size());
+    }
+
+    void field_packed(int field, const std::vector<uint64_t> &values)
+    {
+        proto_writer packed;
+        for (uint64_t v : values) packed.varint(v);
+        field_message(field, packed);
+    }
+
+    const std::vector<uint8_t> &data() const { return m_data; }
+
+private:
+    std::vector<uint8_t> m_data;
+};
+
+/* String table; index 0 is the empty string as profile.proto requires */
+class string_table {
+public:
+    string_table() { index(""); }
+
+    uint64_t index(const std::string &text)
+    {
+        auto it = m_index.find(text);
+        if (it != m_index.end()) return it->second;
+        uint64_t id = m_strings.size();
+        m_strings.push_back(text);
+        m_index.emplace(text, id);
+        return id;
+    }
+
+    const std::vector<std::string> &strings() const { return m_strings; }
+
+private:
+    std::map<std::string, uint64_t> m_index;
+    std::vector<std::string> m_strings;
+};
+
+/* profile.proto field numbers */
+enum {
+    PROFILE_SAMPLE_TYPE = 1, PROFILE_SAMPLE = 2, PROFILE_LOCATION = 4,
+    PROFILE_FUNCTION = 5, PROFILE_STRING_TABLE = 6, PROFILE_DURATION_NANOS = 10,
+    PROFILE_PERIOD_TYPE = 11, PROFILE_PERIOD = 12, PROFILE_COMMENT = 13,
+    PROFILE_DEFAULT_SAMPLE_TYPE = 14,
+    VALUE_TYPE_TYPE = 1, VALUE_TYPE_UNIT = 2,
+    SAMPLE_LOCATION_ID = 1, SAMPLE_VALUE = 2, SAMPLE_LABEL = 3,
+    LABEL_KEY = 1, LABEL_NUM = 3,
+    LOCATION_ID = 1, LOCATION_LINE = 4,
+    LINE_FUNCTION_ID = 1, LINE_LINE = 2,
+    FUNCTION_ID = 1, FUNCTION_NAME = 2, FUNCTION_SYSTEM_NAME = 3, FUNCTION_FILENAME = 4,
+    FUNCTION_START_LINE = 5,
+};
+
+static proto_writer value_type(string_table &strings, const char *type, const char *unit)
+{
+    proto_writer vt;
+    vt.field_varint(VALUE_TYPE_TYPE, strings.index(type));
+    vt.field_varint(VALUE_TYPE_UNIT, strings.index(unit));
+    return vt;
+}
+
+static std::vector<uint8_t> encode_profile(const profile &prof)
+{
+    proto_writer out;
+    string_table strings;
+
+    out.field_message(PROFILE_SAMPLE_TYPE, value_type(strings, "calls", "count"));
+    out.field_message(PROFILE_SAMPLE_TYPE, value_type(strings, "time", "nanoseconds"));
+
+    /* Samples: one per context and thread, locations leaf first */
+    uint64_t thread_key = strings.index("thread");
+    for (const auto &tree : prof.threads) {
+        for (size_t i = 1; i < tree.nodes.size(); i++) {
+            const profile_node &n = tree.nodes[i];
+            if (n.count == 0 && n.self_ns == 0) continue;
+
+            std::vector<uint64_t> locations;
+            for (int id = (int)i; id > 0; id = tree.nodes[id].parent) {
+                locations.push_back((uint64_t)tree.nodes[id].section + 1);
+            }
+
+            proto_writer label;
+            label.field_varint(LABEL_KEY, thread_key);
+            label.field_varint(LABEL_NUM, tree.tid);
+
+            proto_writer sample;
+            sample.field_packed(SAMPLE_LOCATION_ID, locations);
+            sample.field_packed(SAMPLE_VALUE, { n.count, n.self_ns });
+            sample.field_message(SAMPLE_LABEL, label);
+            out.field_message(PROFILE_SAMPLE, sample);
+        }
+    }
+
+    /* One function and one location per section */
+    for (size_t s = 0; s < prof.sections.size(); s++) {
+        const profile_section &section = prof.sections[s];
+        uint64_t name = strings.index(prof.section_name((int)s));
+
+        proto_writer function;
+        function.field_varint(FUNCTION_ID, s + 1);
+        function.field_varint(FUNCTION_NAME, name);
+        function.field_varint(FUNCTION_SYSTEM_NAME, name);
+        function.field_varint(FUNCTION_FILENAME, strings.index(section.file));
+        function.field_varint(FUNCTION_START_LINE, (uint64_t)section.line);
+        out.field_message(PROFILE_FUNCTION, function);
+
+        proto_writer line;
+        line.field_varint(LINE_FUNCTION_ID, s + 1);
+        line.field_varint(LINE_LINE, (uint64_t)section.line);
+
+        proto_writer location;
+        location.field_varint(LOCATION_ID, s + 1);
+        location.field_message(LOCATION_LINE, line);
+        out.field_message(PROFILE_LOCATION, location);
+    }
+
+    out.field_varint(PROFILE_DURATION_NANOS, prof.total_ns);
+    out.field_message(PROFILE_PERIOD_TYPE, value_type(strings, "time", "nanoseconds"));
+    out.field_varint(PROFILE_PERIOD, 1);
+    out.field_varint(PROFILE_COMMENT, strings.index("narwhalyzer: " + prof.command));
+    out.field_varint(PROFILE_DEFAULT_SAMPLE_TYPE, strings.index("time"));
+
+    /* The string table goes last: encoding the fields above fills it */
+    for (const auto &text : strings.strings()) {
+        out.field_bytes(PROFILE_STRING_TABLE, text.data(), text.size());
+    }
+
+    return out.data();
+}
+
+/* ============================================================================
+ * Gzip Encoding
+ * ============================================================================ */
+
+static uint32_t crc32(const uint8_t *data, size_t size)
+{
+    static uint32_t table[256];
+    if (table[1] == 0) {
+        for (uint32_t i = 0; i < 256; i++) {
+            uint32_t c = i;
+            for (int k = 0; k < 8; k++) c = (c & 1) ? 0xedb88320u ^ (c >> 1) : c >> 1;
+            table[i] = c;
+        }
+    }
+
+    uint32_t crc = 0xffffffffu;
+    for (size_t i = 0; i < size; i++) crc = table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+    return crc ^ 0xffffffffu;
+}
+
+/* Deflate output: bits are packed starting with the least significant */
+class bit_writer {
+public:
+    explicit bit_writer(std::vector<uint8_t> &out) : m_out(out) {}
+
+    void bits(uint32_t value, int count)
+    {
+        m_buffer |= (uint64_t)value << m_count;
+        m_count += count;
+        while (m_count >= 8) {
+            m_out.push_back((uint8_t)m_buffer);
+            m_buffer >>= 8;
+            m_count -= 8;
+        }
+    }
+
+    /* Huffman codes are defined most significant bit first */
+    void code(uint32_t code, int length)
+    {
+        uint32_t reversed = 0;
+        for (int i = 0; i < length; i++) reversed |= ((code >> i) & 1) << (length - 1 - i);
+        bits(reversed, length);
+    }
+
+    void flush()
+    {
+        if (m_count > 0) m_out.push_back((uint8_t)m_buffer);
+        m_buffer = 0;
+        m_count = 0;
+    }
+
+private:
+    std::vector<uint8_t> &m_out;
+    uint64_t m_buffer = 0;
+    int m_count = 0;
+};
+
+static const uint16_t LENGTH_BASE[29] = {
+    3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+    35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+static const uint8_t LENGTH_EXTRA[29] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+    3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+static const uint16_t DIST_BASE[30] = {
+    1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+    257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+static const uint8_t DIST_EXTRA[30] = {
+    0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+    7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+
+/* Fixed Huffman code of a literal/length symbol (RFC 1951, 3.2.6) */
+static void write_symbol(bit_writer &w, int symbol)
+{
+    if (symbol < 144) w.code(0x30 + symbol, 8);
+    else if (symbol < 256) w.code(0x190 + symbol - 144, 9);
+    else if (symbol < 280) w.code(symbol - 256, 7);
+    else w.code(0xc0 + symbol - 280, 8);
+}
+
+static void write_match(bit_writer &w, int length, int distance)
+{
+    int l = 28;
+    while (LENGTH_BASE[l] > length) l--;
+    write_symbol(w, 257 + l);
+    w.bits(length - LENGTH_BASE[l], LENGTH_EXTRA[l]);
+
+    int d = 29;
+    while (DIST_BASE[d] > distance) d--;
+    w.code(d, 5);
+    w.bits(distance - DIST_BASE[d], DIST_EXTRA[d]);
+}
+
+/*
+ * One deflate block with fixed codes and greedy LZ77 matching over hash
+ * chains. Protobuf output is repetitive (field tags, similar paths), so
+ * this gets most of the gain of a full compressor at a fraction of the code.
+ */
+static void deflate_fixed(const std::vector<uint8_t> &in, std::vector<uint8_t> &out)
+{
+    const int WINDOW = 32768, HASH_SIZE = 1 << 15, MAX_CHAIN = 64, MIN_MATCH = 3, MAX_MATCH = 258;
+    std::vector<int> head(HASH_SIZE, -1), prev(in.size(), -1);
+    auto hash = [&](size_t i) {
+        return ((in[i] << 10) ^ (in[i + 1] << 5) ^ in[i + 2]) & (HASH_SIZE - 1);
+    };
+
+    bit_writer w(out);
+    w.bits(1, 1); /* Final block */
+    w.bits(1, 2); /* Fixed Huffman codes */
+
+    size_t n = in.size();
+    size_t i = 0;
+    while (i < n) {
+        int best_length = 0, best_distance = 0;
+        if (i + MIN_MATCH <= n) {
+            int h = hash(i);
+            int chain = MAX_CHAIN;
+            for (int j = head[h]; j >= 0 && (int)i - j <= WINDOW && chain-- > 0; j = prev[j]) {
+                int limit = (int)std::min<size_t>(MAX_MATCH, n - i);
+                int length = 0;
+                while (length < limit && in[j + length] == in[i + length]) length++;
+                if (length > best_length) {
+                    best_length = length;
+                    best_distance = (int)i - j;
+                    if (length == limit) break;
+                }
+            }
+        }
+
+        size_t advance = 1;
+        if (best_length >= MIN_MATCH) {
+            write_match(w, best_length, best_distance);
+            advance = (size_t)best_length;
+        } else {
+            write_symbol(w, in[i]);
+        }
+
+        for (size_t k = 0; k < advance; k++, i++) {
+            if (i + MIN_MATCH <= n) {
+                int h = hash(i);
+                prev[i] = head[h];
+                head[h] = (int)i;
+            }
+        }
+    }
+
+    write_symbol(w, 256); /* End of block */
+    w.flush();
+}
+
+std::vector<uint8_t> gzip_compress(const std::vector<uint8_t> &data)
+{
+    std::vector<uint8_t> out = { 0x1f, 0x8b, 8, 0, 0, 0, 0, 0, 0, 3 };
+    deflate_fixed(data, out);
+
+    uint32_t crc = crc32(data.data(), data.size());
+    uint32_t size = (uint32_t)data.size();
+    for (int i = 0; i < 4; i++) out.push_back((uint8_t)(crc >> (8 * i)));
+    for (int i = 0; i < 4; i++) out.push_back((uint8_t)(size >> (8 * i)));
+    return out;
+}
+
+/* ============================================================================
+ * Export
+ * ============================================================================ */
+
+int write_pprof(const profile &prof, FILE *out)
+{
+    std::vector<uint8_t> compressed = gzip_compress(encode_profile(prof));
+    return fwrite(compressed.data(), 1, compressed.size(), out) == compressed.size() ? 0 : 1;
+}
+
+} // namespace narwhalyzer
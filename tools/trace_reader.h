@@ -0,0 +1,300 @@
+/*
+ * trace_reader.h
+ *
+ * Read-only access to Narwhalyzer trace files for the command-line tools.
+ * The file is mapped with mmap and only the pages of the chunks actually
+ * visited are read from disk, so time-range and per-thread queries on
+ * very large traces only touch the index and the selected chunks.
+ *
+ * Copyright (c) 2026
+ * Licensed under GPL-3.0 License
+ */
+
+#ifndef NARWHALYZER_TRACE_READER_H
+#define NARWHALYZER_TRACE_READER_H
+
+#include "narwhalyzer_trace_format.h"
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+namespace narwhalyzer {
+
+struct trace_section {
+    std::string name;
+    std::string file;
+    int line = 0;
+    int parent_index = -1;
+};
+
+/*
+ * View of one chunk inside the mapping.
+ */
+struct trace_chunk {
+    const narwhalyzer_trace_chunk_header_t *header = nullptr;
+    const narwhalyzer_trace_frame_t *frames = nullptr;
+    const narwhalyzer_trace_event_t *events = nullptr;
+
+    const narwhalyzer_trace_event_t *begin() const { return events; }
+    const narwhalyzer_trace_event_t *end() const { return events + header->event_count; }
+
+    /* First event at or after a timestamp (events are sorted within a chunk) */
+    const narwhalyzer_trace_event_t *lower_bound(uint64_t timestamp_ns) const
+    {
+        return std::lower_bound(begin(), end(), timestamp_ns,
+            [](const narwhalyzer_trace_event_t &ev, uint64_t t) {
+                return ev.timestamp_ns < t;
+            });
+    }
+};
+
+class trace_file {
+public:
+    trace_file() = default;
+    trace_file(const trace_file &) = delete;
+    trace_file &operator=(const trace_file &) = delete;
+
+    ~trace_file()
+    {
+        if (m_data) munmap(const_cast<uint8_t *>(m_data), m_size);
+    }
+
+    /*
+     * Map a trace file and load its index and section table.
+     * Returns false and sets error() on failure.
+     */
+    bool open(const std::string &path)
+    {
+        m_path = path;
+
+        int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) return fail("cannot open file");
+
+        struct stat st;
+        if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(narwhalyzer_trace_file_header_t)) {
+            ::close(fd);
+            return fail("not a narwhalyzer trace (too short)");
+        }
+        m_size = (size_t)st.st_size;
+
+        void *data = mmap(nullptr, m_size, PROT_READ, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if (data == MAP_FAILED) return fail("cannot map file");
+        m_data = static_cast<const uint8_t *>(data);
+
+        /* Chunks are visited in index order, rarely sequentially */
+        madvise(data, m_size, MADV_RANDOM);
+
+        m_header = reinterpret_cast<const narwhalyzer_trace_file_header_t *>(m_data);
+        if (m_header->magic != NARWHALYZER_TRACE_MAGIC) {
+            return fail("not a narwhalyzer trace (bad magic)");
+        }
+        if (m_header->version != NARWHALYZER_TRACE_VERSION) {
+            return fail("unsupported trace version");
+        }
+
+        if (!load_footer()) {
+            /* Writer did not finish: rebuild the index from the chunk headers */
+            m_complete = false;
+            scan_chunks();
+        }
+
+        /* Order chunks by start time so range queries can stop early */
+        std::sort(m_index.begin(), m_index.end(),
+                  [](const narwhalyzer_trace_index_entry_t &a,
+                     const narwhalyzer_trace_index_entry_t &b) {
+                      return a.t_min < b.t_min;
+                  });
+
+        return true;
+    }
+
+    const std::string &error() const { return m_error; }
+    /* Set when damaged chunks were left out of the index */
+    const std::string &warning() const { return m_warning; }
+    const std::string &path() const { return m_path; }
+    const narwhalyzer_trace_file_header_t &header() const { return *m_header; }
+    const narwhalyzer_trace_footer_t *footer() const { return m_complete ? &m_footer : nullptr; }
+    const std::vector<narwhalyzer_trace_index_entry_t> &index() const { return m_index; }
+    const std::vector<trace_section> &sections() const { return m_sections; }
+    bool complete() const { return m_complete; }
+
+    /* Section name, also for indices missing from the table */
+    std::string section_name(uint32_t index) const
+    {
+        if (index < m_sections.size()) return m_sections[index].name;
+        return "section_" + std::to_string(index);
+    }
+
+    trace_chunk chunk(const narwhalyzer_trace_index_entry_t &entry) const
+    {
+        trace_chunk c;
+        const uint8_t *p = m_data + entry.offset;
+        c.header = reinterpret_cast<const narwhalyzer_trace_chunk_header_t *>(p);
+        p += sizeof(narwhalyzer_trace_chunk_header_t);
+        c.frames = reinterpret_cast<const narwhalyzer_trace_frame_t *>(p);
+        p += c.header->open_count * sizeof(narwhalyzer_trace_frame_t);
+        c.events = reinterpret_cast<const narwhalyzer_trace_event_t *>(p);
+        return c;
+    }
+
+    /* Time range covered by the events */
+    uint64_t t_min() const
+    {
+        uint64_t t = UINT64_MAX;
+        for (const auto &e : m_index) t = std::min(t, e.t_min);
+        return t == UINT64_MAX ? m_header->start_clock.monotonic_ns : t;
+    }
+
+    uint64_t t_max() const
+    {
+        uint64_t t = 0;
+        for (const auto &e : m_index) t = std::max(t, e.t_max);
+        return t;
+    }
+
+    /*
+     * Chunks overlapping [from, to], optionally of one thread (tid 0 = all).
+     */
+    std::vector<narwhalyzer_trace_index_entry_t> select(uint64_t from, uint64_t to,
+                                                        uint32_t tid = 0) const
+    {
+        std::vector<narwhalyzer_trace_index_entry_t> out;
+        for (const auto &e : m_index) {
+            if (e.t_min > to) break;
+            if (e.t_max < from) continue;
+            if (tid != 0 && e.tid != tid) continue;
+            out.push_back(e);
+        }
+        return out;
+    }
+
+private:
+    bool fail(const std::string &message)
+    {
+        m_error = m_path + ": " + message;
+        return false;
+    }
+
+    bool in_file(uint64_t offset, uint64_t size) const
+    {
+        return offset <= m_size && size <= m_size - offset;
+    }
+
+    /* Whether the chunk lies in the file and its frames and events fit in it */
+    bool chunk_fits(uint64_t offset, uint64_t size) const
+    {
+        if (size < sizeof(narwhalyzer_trace_chunk_header_t) || !in_file(offset, size)) {
+            return false;
+        }
+        const auto *h = reinterpret_cast<const narwhalyzer_trace_chunk_header_t *>(m_data + offset);
+        uint64_t payload = (uint64_t)h->open_count * sizeof(narwhalyzer_trace_frame_t) +
+                           (uint64_t)h->event_count * sizeof(narwhalyzer_trace_event_t);
+        return h->magic == NARWHALYZER_TRACE_CHUNK_MAGIC &&
+               payload <= size - sizeof(narwhalyzer_trace_chunk_header_t);
+    }
+
+    bool load_footer()
+    {
+        if (m_size < sizeof(narwhalyzer_trace_file_header_t) + sizeof(narwhalyzer_trace_footer_t)) {
+            return false;
+        }
+        std::memcpy(&m_footer, m_data + m_size - sizeof(m_footer), sizeof(m_footer));
+        if (m_footer.magic != NARWHALYZER_TRACE_FOOTER_MAGIC) return false;
+
+        if (m_footer.index_count > m_size / sizeof(narwhalyzer_trace_index_entry_t)) return false;
+        uint64_t index_size = m_footer.index_count * sizeof(narwhalyzer_trace_index_entry_t);
+        if (!in_file(m_footer.index_offset, index_size) ||
+            !in_file(m_footer.section_table_offset, m_footer.section_table_size)) {
+            return false;
+        }
+
+        /* Leave out entries pointing at damaged or truncated chunks */
+        const auto *entries = reinterpret_cast<const narwhalyzer_trace_index_entry_t *>(
+            m_data + m_footer.index_offset);
+        uint64_t dropped = 0;
+        for (uint64_t i = 0; i < m_footer.index_count; i++) {
+            if (chunk_fits(entries[i].offset, entries[i].size)) {
+                m_index.push_back(entries[i]);
+            } else {
+                dropped++;
+            }
+        }
+        if (dropped) {
+            m_warning = m_path + ": skipped " + std::to_string(dropped) +
+                        " damaged chunks listed in the index";
+        }
+
+        /* Section entries, then the string blob */
+        const uint8_t *table = m_data + m_footer.section_table_offset;
+        size_t entries_size = m_footer.section_count * sizeof(narwhalyzer_trace_section_entry_t);
+        if (entries_size > m_footer.section_table_size) return false;
+        const char *blob = reinterpret_cast<const char *>(table + entries_size);
+        size_t blob_size = m_footer.section_table_size - entries_size;
+
+        for (uint32_t i = 0; i < m_footer.section_count; i++) {
+            narwhalyzer_trace_section_entry_t entry;
+            std::memcpy(&entry, table + i * sizeof(entry), sizeof(entry));
+            trace_section s;
+            if (entry.name_offset < blob_size) {
+                s.name = std::string(blob + entry.name_offset,
+                                     strnlen(blob + entry.name_offset, blob_size - entry.name_offset));
+            }
+            if (entry.file_offset < blob_size) {
+                s.file = std::string(blob + entry.file_offset,
+                                     strnlen(blob + entry.file_offset, blob_size - entry.file_offset));
+            }
+            s.line = entry.line;
+            s.parent_index = entry.parent_index;
+            m_sections.push_back(s);
+        }
+
+        m_complete = true;
+        return true;
+    }
+
+    void scan_chunks()
+    {
+        m_index.clear();
+        m_warning.clear();
+        uint64_t offset = m_header->header_size;
+        while (in_file(offset, sizeof(narwhalyzer_trace_chunk_header_t))) {
+            const auto *h = reinterpret_cast<const narwhalyzer_trace_chunk_header_t *>(m_data + offset);
+            if (h->magic != NARWHALYZER_TRACE_CHUNK_MAGIC || !chunk_fits(offset, h->size)) {
+                break;
+            }
+            narwhalyzer_trace_index_entry_t e;
+            e.offset = offset;
+            e.size = h->size;
+            e.t_min = h->t_min;
+            e.t_max = h->t_max;
+            e.tid = h->tid;
+            e.event_count = h->event_count;
+            m_index.push_back(e);
+            offset += h->size;
+        }
+    }
+
+    std::string m_path;
+    std::string m_error;
+    std::string m_warning;
+    const uint8_t *m_data = nullptr;
+    size_t m_size = 0;
+    const narwhalyzer_trace_file_header_t *m_header = nullptr;
+    narwhalyzer_trace_footer_t m_footer{};
+    bool m_complete = false;
+    std::vector<narwhalyzer_trace_index_entry_t> m_index;
+    std::vector<trace_section> m_sections;
+};
+
+} // namespace narwhalyzer
+
+#endif /* NARWHALYZER_TRACE_READER_H */